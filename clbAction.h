@@ -0,0 +1,94 @@
+#ifndef CLBACTION_H
+#define CLBACTION_H
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <stdint.h>
+
+/* COMPARE MATCH ACTION TABLES
+ *
+ * Most compare match reactions are a few register writes: toggle a pin, reload an OCR, start another timer.
+ * An action table lists those writes in flash and the compare match ISR runs them inline, without calling a user function.
+ * Tables live in PROGMEM and end with CLB_ACTION_END:
+ *
+ *     const clb::Action PROGMEM s_on_match[] = {
+ *         CLB_ACTION_WRITE8(PINB, BIT0 << PB7),         //toggle the led, writing 1 to PINx toggles the pin
+ *         CLB_ACTION_ADD16(OCR1A, 2000),               //next match 2000 ticks later
+ *         CLB_ACTION_SET(TCCR3B, BIT0 << CS30),         //start Timer3 at clk/1
+ *         CLB_ACTION_END
+ *     };
+ *     clb::Timer1::instance().setInterruptActions(clb::TInterrupt16::COMPMATCHA, s_on_match);
+ *
+ * The actions run before the callback of the same interrupt, and for an async delay only when the delay finishes.
+ * Registers are given by name and stored as data space addresses, so any memory mapped register works.
+ * 16 bit writes go high byte first and 16 bit reads low byte first as the datasheet requires for the timer registers.
+ */
+
+#define CLB_ACTION_REG(reg) ((uint16_t)_SFR_MEM_ADDR(reg))
+
+#define CLB_ACTION_SET(reg, mask) { clb::TAction::SET, CLB_ACTION_REG(reg), (uint16_t)(mask) } //reg |= mask
+#define CLB_ACTION_CLEAR(reg, mask) { clb::TAction::CLEAR, CLB_ACTION_REG(reg), (uint16_t)(mask) } //reg &= ~mask
+#define CLB_ACTION_TOGGLE(reg, mask) { clb::TAction::TOGGLE, CLB_ACTION_REG(reg), (uint16_t)(mask) } //reg ^= mask, for pins prefer WRITE8 to PINx
+#define CLB_ACTION_WRITE8(reg, value) { clb::TAction::WRITE8, CLB_ACTION_REG(reg), (uint16_t)(value) } //reg = value
+#define CLB_ACTION_WRITE16(reg, value) { clb::TAction::WRITE16, CLB_ACTION_REG(reg), (uint16_t)(value) } //16 bit reg = value
+#define CLB_ACTION_ADD16(reg, value) { clb::TAction::ADD16, CLB_ACTION_REG(reg), (uint16_t)(value) } //16 bit reg += value
+#define CLB_ACTION_END { clb::TAction::END, 0, 0 }
+
+namespace clb {
+    //operations an action table entry can do
+    enum class TAction : uint8_t {
+        END = 0, //end of the table
+        SET = 1,
+        CLEAR = 2,
+        TOGGLE = 3,
+        WRITE8 = 4,
+        WRITE16 = 5,
+        ADD16 = 6
+    };
+
+    struct Action {
+        TAction op;
+        uint16_t reg; //data space address of the register
+        uint16_t value; //mask or value, only the low byte is used by the 8 bit operations
+    };
+
+    class Actions {
+        public:
+            //runs a PROGMEM table up to its END entry, does nothing for nullptr, inlined into the ISRs
+            static inline __attribute__((always_inline)) void run(const Action* actions) {
+                if (!actions) {
+                    return;
+                }
+                for (;;) {
+                    TAction _op = static_cast<TAction>(pgm_read_byte(&actions->op));
+                    if (_op == TAction::END) {
+                        return;
+                    }
+                    volatile uint8_t* _reg = reinterpret_cast<volatile uint8_t*>(pgm_read_word(&actions->reg));
+                    uint16_t _value = pgm_read_word(&actions->value);
+
+                    switch (_op) {
+                        case TAction::SET: *_reg |= _value; break;
+                        case TAction::CLEAR: *_reg &= ~_value; break;
+                        case TAction::TOGGLE: *_reg ^= _value; break;
+                        case TAction::WRITE8: *_reg = _value; break;
+                        case TAction::WRITE16:
+                            _reg[1] = _value >> 8;
+                            _reg[0] = _value & 0xFF;
+                            break;
+                        case TAction::ADD16: {
+                            uint8_t _low = _reg[0];
+                            uint16_t _sum = ((_reg[1] << 8) | _low) + _value;
+                            _reg[1] = _sum >> 8;
+                            _reg[0] = _sum & 0xFF;
+                            break;
+                        }
+                        default: break;
+                    }
+                    actions++;
+                }
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include "clbAdc.h"
+
+static struct AdcState {
+    uint8_t admux[CLB_ADC_MAX_CHANNELS]; //REFS and MUX4:0 per scan step
+    uint8_t adcsrb[CLB_ADC_MAX_CHANNELS]; //ADTS and MUX5 per scan step
+    uint8_t channelCount = 0;
+    uint8_t step = 0; //scan step of the conversion running
+    volatile uint8_t* timsk = nullptr; //interrupt mask and flag register of the trigger
+    volatile uint8_t* tifr = nullptr;
+    uint8_t flag = 0; //trigger flag, the interrupt enable has the same position
+    uint16_t* buffer = nullptr;
+    uint16_t length = 0; //samples per half
+    uint16_t* write = nullptr;
+    uint16_t* end = nullptr; //end of the half being filled
+    uint8_t half = 0; //half being filled
+    volatile uint8_t full = 0; //BIT0 << half for halves waiting for or in the callback
+    bool inCallback = false;
+    void (*callback)(const uint16_t* samples, uint16_t length) = nullptr;
+    uint16_t overruns = 0;
+    uint8_t adps = 0; //ADPS2:0 while running
+} s_adc;
+
+//calls the callback for every full half, with interrupts on so the ISR keeps sampling, interrupts must be off
+static void dispatchAdcBlocks() {
+    s_adc.inCallback = true;
+    //only the half not being filled can be full, and s_adc.half changes under the callback
+    for (;;) {
+        uint8_t _half = s_adc.half ^ 1;
+        if (!(s_adc.full & (BIT0 << _half))) {
+            break;
+        }
+        sei();
+        s_adc.callback(s_adc.buffer + _half * s_adc.length, s_adc.length);
+        cli();
+        s_adc.full &= ~(BIT0 << _half);
+    }
+    s_adc.inCallback = false;
+}
+
+ISR(ADC_vect) {
+    uint16_t _sample = ADC;
+
+    //the conversion starts on the rising edge of the trigger flag, cleared here unless the timer ISR clears it
+    if (!(*s_adc.timsk & s_adc.flag)) {
+        *s_adc.tifr = s_adc.flag;
+    }
+    //channel of the next conversion, the next trigger is a full sample period away
+    uint8_t _step = s_adc.step + 1;
+    if (_step == s_adc.channelCount) {
+        _step = 0;
+    }
+    s_adc.step = _step;
+    ADMUX = s_adc.admux[_step];
+    ADCSRB = s_adc.adcsrb[_step];
+
+    *s_adc.write++ = _sample;
+    if (s_adc.write != s_adc.end) {
+        return;
+    }
+    uint8_t _filled = s_adc.half;
+    uint8_t _next = _filled ^ 1;
+    if (s_adc.full & (BIT0 << _next)) {
+        //the callback still holds the other half, this one is dropped and filled again
+        if (s_adc.overruns != 0xFFFF) {
+            s_adc.overruns++;
+        }
+        s_adc.write = s_adc.end - s_adc.length;
+        return;
+    }
+    s_adc.full |= BIT0 << _filled;
+    s_adc.half = _next;
+    s_adc.write = s_adc.buffer + _next * s_adc.length;
+    s_adc.end = s_adc.write + s_adc.length;
+    if (!s_adc.inCallback) {
+        dispatchAdcBlocks();
+    }
+}
+
+bool clb::Adc::begin(TAdcTrigger trigger, uint32_t sampleRate, const uint8_t* channels, uint8_t channelCount, uint16_t* buffer,
+                     uint16_t length, void (*callback)(const uint16_t* samples, uint16_t length), TAdcReference reference) {
+    if (channels == nullptr || channelCount == 0 || channelCount > CLB_ADC_MAX_CHANNELS) {
+        CRITICAL("Adc::begin() needs 1 to CLB_ADC_MAX_CHANNELS channels");
+        return false;
+    }
+    if (buffer == nullptr || callback == nullptr || length == 0 || length % channelCount != 0) {
+        CRITICAL("Adc::begin() needs a buffer, a callback and a length that is a multiple of the scan length");
+        return false;
+    }
+    //slowest ADC clock that converts at the sample rate, 13.5 ADC clocks per auto triggered conversion, at most DIV_16
+    uint8_t _adps = 0;
+    for (uint8_t i = 7; i >= 4; i--) {
+        if ((F_CPU >> i) * 2 >= sampleRate * 27ULL) {
+            _adps = i;
+            break;
+        }
+    }
+    if (sampleRate == 0 || _adps == 0) {
+        CRITICAL("Adc::begin() sample rate out of range, at most F_CPU / 16 / 13.5");
+        return false;
+    }
+
+    volatile uint8_t* _timsk;
+    volatile uint8_t* _tifr;
+    uint8_t _flag;
+    switch (trigger) {
+        case TAdcTrigger::TIMER0_COMPARE_A: _timsk = &TIMSK0; _tifr = &TIFR0; _flag = BIT0 << OCF0A; break;
+        case TAdcTrigger::TIMER0_OVERFLOW: _timsk = &TIMSK0; _tifr = &TIFR0; _flag = BIT0 << TOV0; break;
+        case TAdcTrigger::TIMER1_COMPARE_B: _timsk = &TIMSK1; _tifr = &TIFR1; _flag = BIT0 << OCF1B; break;
+        case TAdcTrigger::TIMER1_OVERFLOW: _timsk = &TIMSK1; _tifr = &TIFR1; _flag = BIT0 << TOV1; break;
+        case TAdcTrigger::TIMER1_CAPTURE: _timsk = &TIMSK1; _tifr = &TIFR1; _flag = BIT0 << ICF1; break;
+        default:
+            CRITICAL("Adc::begin() invalid trigger");
+            return false;
+    }
+
+    end();
+
+    CLB_CRITICAL_SECTION();
+
+    uint8_t _refs = static_cast<uint8_t>(reference) << REFS0;
+    uint8_t _adts = static_cast<uint8_t>(trigger);
+    uint8_t _didr0 = 0;
+    uint8_t _didr2 = 0;
+    for (uint8_t i = 0; i < channelCount; i++) {
+        uint8_t _channel = channels[i] & 0x0F;
+        s_adc.admux[i] = _refs | (_channel & 0x07);
+        s_adc.adcsrb[i] = _adts | ((_channel & 0x08) ? (BIT0 << MUX5) : 0);
+        if (_channel & 0x08) {
+            _didr2 |= BIT0 << (_channel & 0x07);
+        }
+        else {
+            _didr0 |= BIT0 << _channel;
+        }
+    }
+    s_adc.channelCount = channelCount;
+    s_adc.step = 0;
+    s_adc.timsk = _timsk;
+    s_adc.tifr = _tifr;
+    s_adc.flag = _flag;
+    s_adc.buffer = buffer;
+    s_adc.length = length;
+    s_adc.write = buffer;
+    s_adc.end = buffer + length;
+    s_adc.half = 0;
+    s_adc.full = 0;
+    s_adc.inCallback = false;
+    s_adc.callback = callback;
+    s_adc.overruns = 0;
+    s_adc.adps = _adps;
+
+    PRR0 &= ~(BIT0 << PRADC);
+    DIDR0 |= _didr0; //the digital input buffers only add noise on analog pins
+    DIDR2 |= _didr2;
+    ADMUX = s_adc.admux[0];
+    ADCSRB = s_adc.adcsrb[0];
+    *_tifr = _flag; //a flag already set has no rising edge left, the first trigger would be lost
+    ADCSRA = (BIT0 << ADEN) | (BIT0 << ADATE) | (BIT0 << ADIF) | (BIT0 << ADIE) | _adps;
+    return true;
+}
+
+void clb::Adc::end() {
+    CLB_CRITICAL_SECTION();
+
+    //ADEN with DIV_128 and no auto trigger is what the Arduino core sets up for analogRead()
+    ADCSRA = (BIT0 << ADIF);
+    ADCSRB = 0;
+    ADCSRA = (BIT0 << ADEN) | (BIT0 << ADPS2) | (BIT0 << ADPS1) | (BIT0 << ADPS0);
+    if (s_adc.channelCount != 0) {
+        DIDR0 = 0;
+        DIDR2 = 0;
+    }
+    s_adc.channelCount = 0;
+    s_adc.adps = 0;
+}
+
+bool clb::Adc::isRunning() { return s_adc.adps != 0; }
+
+uint32_t clb::Adc::adcClock() {
+    if (s_adc.adps == 0) {
+        return 0;
+    }
+    return F_CPU >> s_adc.adps;
+}
+
+uint16_t clb::Adc::overruns() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _overruns = s_adc.overruns;
+    return _overruns;
+}
+
+void clb::Adc::resetOverruns() {
+    CLB_CRITICAL_SECTION();
+    s_adc.overruns = 0;
+}
@@ -0,0 +1,84 @@
+#ifndef CLBADC_H
+#define CLBADC_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+#include "clbCriticalSection.h"
+
+/* TIMER TRIGGERED ADC SAMPLING
+ *
+ * Runs the ADC in auto trigger mode from a timer flag, so every conversion starts on the timer tick with no software in
+ * between, and stores the results from the ADC ISR into two halves of one buffer (ping-pong). While the callback works on
+ * a full half the ISR keeps filling the other, sampling never stops for it:
+ *
+ *     static uint16_t s_samples[2 * 256];
+ *     static const uint8_t s_scan[] = {0, 1, 2, 3}; //A0..A3, one conversion each per trigger in turn
+ *
+ *     void onBlock(const uint16_t* samples, uint16_t length) { ... } //A0 A1 A2 A3 A0 A1 ... interleaved
+ *
+ *     clb::Adc::begin(clb::TAdcTrigger::TIMER1_CAPTURE, 40000, s_scan, 4, s_samples, 256, onBlock, clb::TAdcReference::AVCC);
+ *     clb::Adc::startTimer1(40000); //or set up clb::Timer0/Timer1 for the trigger yourself
+ *
+ * Triggers (ADTS2:0 on the 2560): Timer0 compare match A or overflow, Timer1 compare match B, overflow or capture event.
+ * The ADC starts a conversion on the rising edge of the flag, so the flag has to be cleared between triggers. The ADC ISR
+ * does that when the interrupt of the flag is off, and leaves it to the timer ISR when it is on (Timer0 overflow for
+ * millis() for example). startTimer1() runs Timer1 in CTC with TOP in ICR1, where ICF1 is set at TOP.
+ *
+ * Scan sequences: the ISR writes the channel of the next conversion into ADMUX (and MUX5 into ADCSRB for A8..A15) right
+ * after the current one, well before the next trigger. Samples are stored in scan order and every half starts with the
+ * first channel, so the length of a half has to be a multiple of the scan length.
+ *
+ * Callbacks run inside the ADC ISR with interrupts enabled again, so they may take up to the time the ISR needs to fill
+ * the other half. The ADC ISR nests into them to keep sampling, but never calls the callback twice at once. A half that
+ * fills while the callback still holds the other one is dropped and counted by overruns().
+ *
+ * The ADC clock is the slowest one that still converts at the sample rate (13.5 ADC clocks per conversion), 125 kHz for
+ * full 10 bit accuracy up to 9 kS/s and at most 1 MHz (DIV_16) for about 71 kS/s. Above 200 kHz the datasheet only
+ * specifies lower resolution, about 8 bits at 1 MHz. Each sample costs roughly 60 cycles of ISR, about 25% of the cpu at
+ * 70 kS/s. The module owns the ADC, analogRead() cant be used until end().
+ */
+
+#define CLB_ADC_MAX_CHANNELS 16 //longest scan sequence
+
+namespace clb {
+    //auto trigger source, ADTS2:0
+    enum class TAdcTrigger : uint8_t {
+        TIMER0_COMPARE_A = 0b011, //OCF0A
+        TIMER0_OVERFLOW = 0b100, //TOV0
+        TIMER1_COMPARE_B = 0b101, //OCF1B
+        TIMER1_OVERFLOW = 0b110, //TOV1
+        TIMER1_CAPTURE = 0b111 //ICF1, also set at TOP when ICR1 is TOP
+    };
+    //voltage reference, REFS1:0
+    enum class TAdcReference : uint8_t {
+        AREF = 0b00, //external on the AREF pin
+        AVCC = 0b01, //AVCC, needs a capacitor on AREF
+        INTERNAL_1V1 = 0b10,
+        INTERNAL_2V56 = 0b11
+    };
+
+    class Adc {
+        public:
+            //starts sampling channels (0..15 for A0..A15) in turn on every trigger into two halves of length samples each
+            //in buffer (2 * length in total), calling callback for every full half. sampleRate picks the ADC clock. Returns
+            //false if an argument is out of range
+            static bool begin(TAdcTrigger trigger, uint32_t sampleRate, const uint8_t* channels, uint8_t channelCount, uint16_t* buffer,
+                              uint16_t length, void (*callback)(const uint16_t* samples, uint16_t length), TAdcReference reference);
+            static void end(); //stops sampling and leaves the ADC set up as analogRead() expects it
+
+            //Timer1 as the sample clock, in clbAdc1.cpp so Timer1 is only claimed when it is used
+            static uint32_t startTimer1(uint32_t sampleRate); //CTC with TOP in ICR1 for TIMER1_CAPTURE, returns the rate it makes in Hz, 0 if out of range
+            static void stopTimer1();
+
+            static bool isRunning();
+            static uint32_t adcClock(); //ADC clock in Hz
+            static uint16_t overruns(); //halves dropped because the callback still held the other one, saturates at 0xFFFF
+            static void resetOverruns();
+    };
+}
+
+#endif
@@ -0,0 +1,45 @@
+#include "clbAdc.h"
+#include "clbResource.h"
+
+#include <avr/pgmspace.h>
+
+CLB_CLAIM_TIMER(1);
+
+static const uint16_t s_adc_clock_prescalers[5] PROGMEM = {1, 8, 64, 256, 1024}; //CSn2:0 = index + 1
+
+uint32_t clb::Adc::startTimer1(uint32_t sampleRate) {
+    //smallest prescaler that fits TOP = F_CPU / (N * rate) - 1 in 16 bits, for the closest rate
+    uint8_t _clock = 0;
+    uint32_t _counts = 0;
+    for (uint8_t i = 0; i < 5 && sampleRate != 0; i++) {
+        uint32_t _divider = (uint32_t)pgm_read_word(&s_adc_clock_prescalers[i]) * sampleRate;
+        _counts = (F_CPU + _divider / 2) / _divider;
+        if (_counts <= 0x10000UL) {
+            if (_counts >= 2) {
+                _clock = i + 1;
+            }
+            break;
+        }
+    }
+    if (_clock == 0) {
+        CRITICAL("Adc::startTimer1() sample rate out of range");
+        return 0;
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    PRR0 &= ~(BIT0 << PRTIM1);
+    TCCR1B = 0;
+    TIMSK1 = 0; //ICF1 is cleared by the ADC ISR
+    TCCR1A = 0; //WGM11:0 = 0 for CTC with TOP in ICR1, the outputs stay disconnected
+    TCNT1 = 0;
+    ICR1 = (uint16_t)(_counts - 1);
+    TIFR1 = 0xFF; //writing a 1 clears a flag, the unused bits ignore it
+    TCCR1B = (BIT0 << WGM13) | (BIT0 << WGM12) | _clock;
+    return (F_CPU / pgm_read_word(&s_adc_clock_prescalers[_clock - 1]) + _counts / 2) / _counts;
+}
+
+void clb::Adc::stopTimer1() {
+    CLB_CRITICAL_SECTION();
+    TCCR1B = 0;
+}
@@ -26,4 +26,7 @@ To write to a bit using the bits macro, use BIT0 << BIT_MACRO
 #define BIT14 BIT6 << 8
 #define BIT15 BIT7 << 8
 
+//16.16 fixed point constant, folded by the compiler: CLB_Q16(0.25) = 0x4000
+#define CLB_Q16(x) ((uint32_t)((x) * 65536.0 + 0.5))
+
 #endif
\ No newline at end of file
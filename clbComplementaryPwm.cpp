@@ -0,0 +1,162 @@
+#include "clbComplementaryPwm.h"
+
+#include <avr/pgmspace.h>
+
+static const uint16_t s_bridge_prescalers[5] PROGMEM = {1, 8, 64, 256, 1024}; //CSn2:0 = index + 1
+
+clb::ComplementaryPwm::ComplementaryPwm(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint8_t* tccrc,
+                                        volatile uint16_t* tcnt, volatile uint16_t* icr, volatile uint16_t* ocr,
+                                        volatile uint8_t* timsk, volatile uint8_t* tifr, volatile uint8_t* prr, uint8_t prrBit,
+                                        volatile uint8_t* port, volatile uint8_t* ddr, uint8_t pinBitA)
+    : _tccra(tccra), _tccrb(tccrb), _tccrc(tccrc), _tcnt(tcnt), _icr(icr), _ocr(ocr), _timsk(timsk), _tifr(tifr), _prr(prr),
+      _prrBit(prrBit), _port(port), _ddr(ddr), _pinMask((BIT0 << pinBitA) | (BIT0 << (pinBitA + 1))) { }
+
+uint16_t clb::ComplementaryPwm::deadTicks(uint32_t deadTimeNs, uint8_t clock) {
+    uint64_t _tick = 1000000000ULL * pgm_read_word(&s_bridge_prescalers[clock - 1]); //one tick in ns, times F_CPU
+    uint64_t _ticks = ((uint64_t)deadTimeNs * F_CPU + _tick - 1) / _tick;
+    if (_ticks == 0) {
+        return 1;
+    }
+    return (_ticks > 0xFFFF) ? 0xFFFF : (uint16_t)_ticks;
+}
+
+//OCRnA for the duty, held low enough that OCRnB = OCRnA + dead time stays within TOP
+void clb::ComplementaryPwm::queue() {
+    uint16_t _ocrA = (_duty >= 0x10000UL) ? _top : (uint16_t)((_duty * _top + 0x8000UL) >> 16);
+    if (_ocrA > _top - _dead) {
+        _ocrA = _top - _dead;
+    }
+    _pendingOcrA = _ocrA;
+    _pendingOcrB = _ocrA + _dead;
+    if (!(*_timsk & (BIT0 << TOIE1))) {
+        *_tifr = (BIT0 << TOV1); //a stale flag would run the ISR at once, in the middle of a period
+        *_timsk |= (BIT0 << TOIE1);
+    }
+}
+
+bool clb::ComplementaryPwm::begin(uint32_t frequency, uint32_t deadTimeNs) {
+    //smallest prescaler that fits TOP = F_CPU / (2 * N * f) in 16 bits
+    uint8_t _newClock = 0;
+    uint16_t _newTop = 0;
+    for (uint8_t i = 0; i < 5 && frequency != 0; i++) {
+        uint64_t _divider = 2ULL * pgm_read_word(&s_bridge_prescalers[i]) * frequency;
+        uint64_t _counts = (((uint64_t)F_CPU << 16) + _divider / 2) / _divider;
+        if (_counts <= 0xFFFFUL) {
+            if (_counts >= 255) {
+                _newClock = i + 1;
+                _newTop = (uint16_t)_counts;
+            }
+            break;
+        }
+    }
+    if (_newClock == 0) {
+        CRITICAL("ComplementaryPwm::begin() frequency out of range, TOP would be below 255 or above 65535 with DIV_1024");
+        return false;
+    }
+    uint16_t _newDead = deadTicks(deadTimeNs, _newClock);
+    if (_newDead >= _newTop) {
+        CRITICAL("ComplementaryPwm::begin() dead time is longer than half the period");
+        return false;
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    *_prr &= ~(BIT0 << _prrBit);
+
+    *_tccrb = 0;
+    *_timsk = 0;
+    //both latches low to start from, FOCnx only works in a non PWM mode. The low side comes on once TCNTn passes OCRnB
+    *_tccra = (BIT0 << COM1A1) | (BIT0 << COM1B1);
+    *_tccrc = (BIT0 << FOC1A) | (BIT0 << FOC1B);
+    *_tcnt = 0;
+    *_icr = _newTop;
+    _ocr[0] = 0;
+    _ocr[1] = _newDead;
+    *_tifr = 0xFF; //writing a 1 clears a flag, the unused bits ignore it
+
+    *_port &= ~_pinMask;
+    *_tccra = (BIT0 << COM1A1) | (BIT0 << COM1B1) | (BIT0 << COM1B0); //WGMn1:0 = 0 for TOP in ICRn
+    *_ddr |= _pinMask;
+
+    _clock = _newClock;
+    _top = _newTop;
+    _dead = _newDead;
+    _duty = 0;
+    _pendingOcrA = 0;
+    _pendingOcrB = _newDead;
+
+    *_tccrb = (BIT0 << WGM13) | _newClock;
+    return true;
+}
+
+void clb::ComplementaryPwm::end() {
+    CLB_CRITICAL_SECTION();
+
+    *_timsk = 0;
+    *_tccrb = 0;
+    *_tccra = 0;
+    *_port &= ~_pinMask;
+    _clock = 0;
+}
+
+void clb::ComplementaryPwm::shutdown() {
+    //the timer stopped in normal mode, where the strobes work, both channels cleared on the forced match
+    CLB_CRITICAL_SECTION();
+    *_timsk = 0;
+    *_tccrb = 0;
+    *_tccra = (BIT0 << COM1A1) | (BIT0 << COM1B1);
+    *_tccrc = (BIT0 << FOC1A) | (BIT0 << FOC1B);
+    _clock = 0;
+}
+
+void clb::ComplementaryPwm::setDuty(uint32_t duty) {
+    if (_clock == 0) {
+        CRITICAL("ComplementaryPwm::setDuty() called before begin() or after shutdown()");
+        return;
+    }
+    CLB_CRITICAL_SECTION();
+    _duty = duty;
+    queue();
+}
+
+bool clb::ComplementaryPwm::setDeadTime(uint32_t deadTimeNs) {
+    if (_clock == 0) {
+        CRITICAL("ComplementaryPwm::setDeadTime() called before begin() or after shutdown()");
+        return false;
+    }
+    uint16_t _newDead = deadTicks(deadTimeNs, _clock);
+    if (_newDead >= _top) {
+        CRITICAL("ComplementaryPwm::setDeadTime() dead time is longer than half the period");
+        return false;
+    }
+    CLB_CRITICAL_SECTION();
+    _dead = _newDead;
+    queue();
+    return true;
+}
+
+uint32_t clb::ComplementaryPwm::frequency() {
+    if (_clock == 0) {
+        return 0;
+    }
+    uint64_t _divider = 2ULL * pgm_read_word(&s_bridge_prescalers[_clock - 1]) * _top;
+    return (uint32_t)((((uint64_t)F_CPU << 16) + _divider / 2) / _divider);
+}
+
+uint32_t clb::ComplementaryPwm::deadTime() {
+    if (_clock == 0) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)_dead * pgm_read_word(&s_bridge_prescalers[_clock - 1]) * 1000000000ULL / F_CPU);
+}
+
+uint16_t clb::ComplementaryPwm::deadTimeTicks() { return _dead; }
+
+uint32_t clb::ComplementaryPwm::maxDuty() {
+    if (_top == 0) {
+        return 0;
+    }
+    return ((uint32_t)(_top - _dead) << 16) / _top;
+}
+
+uint16_t clb::ComplementaryPwm::top() { return _top; }
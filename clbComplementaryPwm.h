@@ -0,0 +1,110 @@
+#ifndef CLBCOMPLEMENTARYPWM_H
+#define CLBCOMPLEMENTARYPWM_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+#include "clbCriticalSection.h"
+
+/* COMPLEMENTARY PWM WITH DEAD TIME
+ *
+ * Drives the two switches of a half bridge from one 16 bit timer: OCnA the high side, OCnB the low side. The AVR timers have
+ * no dead time generator, so it is built from the two compare channels in phase and frequency correct PWM with TOP in ICRn
+ * (TMode16::PWM_PHASE_FREQUENCY_CORRECT_ICR):
+ *
+ *   OCnA  TCMOM::CLEAR, high while TCNTn < OCRnA         OCRnB = OCRnA + dead time in ticks
+ *   OCnB  TCMOM::SET,   high while TCNTn > OCRnB
+ *
+ *   TCNTn   0 .. OCRnA .. OCRnB .. TOP .. OCRnB .. OCRnA .. 0
+ *   OCnA    -------|_____________________________|-------
+ *   OCnB    ________________|-----------|________________
+ *
+ * Both edges of both outputs come from the counter, so the gap between one switch turning off and the other turning on is
+ * exactly OCRnB - OCRnA ticks on both slopes, with no software timing involved.
+ *
+ *     clb::ComplementaryPwm& _bridge = clb::ComplementaryPwm::timer3();
+ *     _bridge.begin(CLB_Q16(20000), 250); //20 kHz, 250 ns dead time (4 ticks at DIV_1 and 16 MHz)
+ *     _bridge.setDuty(CLB_Q16(0.4)); //high side on for 40% of the period
+ *
+ * The dead time is rounded up to whole ticks and is at least one tick. Every update keeps OCRnB = OCRnA + dead time with
+ * OCRnB <= TOP, so the high side duty is capped at maxDuty() and the outputs can never be on together. Both compare
+ * values are written by the overflow ISR right after BOTTOM and latched together at the next BOTTOM, so no period ever
+ * mixes an old OCRnB with a new OCRnA.
+ *
+ * shutdown() turns both switches off at once: it switches the timer to normal mode and forces both outputs low with
+ * FOCnA/FOCnB (the strobes only work outside the PWM modes). It only writes registers, so it can be called from a fault
+ * interrupt. begin() starts the bridge again.
+ *
+ *   Timer1  OC1A pin 11, OC1B pin 12    Timer4  OC4A pin 6,  OC4B pin 7
+ *   Timer3  OC3A pin 5,  OC3B pin 2     Timer5  OC5A pin 46, OC5B pin 45
+ *
+ * At 20 kHz TOP is 400 with DIV_1, so the duty has 400 steps and one tick of dead time is 62.5 ns at 16 MHz.
+ *
+ * Each bridge takes over its whole timer (claimed with CLB_CLAIM_TIMER, see clbResource.h).
+ */
+
+namespace clb {
+    class ComplementaryPwm {
+        public:
+            static ComplementaryPwm& timer1(); //OC1A pin 11, OC1B pin 12 on the Mega
+            static ComplementaryPwm& timer3(); //OC3A pin 5, OC3B pin 2 on the Mega
+            static ComplementaryPwm& timer4(); //OC4A pin 6, OC4B pin 7 on the Mega
+            static ComplementaryPwm& timer5(); //OC5A pin 46, OC5B pin 45 on the Mega
+
+            //powers up and starts the timer at frequency (16.16 Hz) with duty 0 (low side on), false if the frequency or dead time is out of range
+            bool begin(uint32_t frequency, uint32_t deadTimeNs);
+            void end(); //stops the timer, disconnects both outputs and drives them low
+
+            void setDuty(uint32_t duty); //high side duty as 16.16 fraction, capped at maxDuty(), committed at the next BOTTOM
+            bool setDeadTime(uint32_t deadTimeNs); //new dead time for the current duty, false if it leaves no room in the period
+            void shutdown(); //both outputs low right now and the timer stopped, safe from ISRs
+
+            uint32_t frequency(); //frequency the timer actually runs at, 16.16 Hz
+            uint32_t deadTime(); //dead time the timer actually makes, in ns
+            uint16_t deadTimeTicks();
+            uint32_t maxDuty(); //largest high side duty the dead time leaves, 16.16 fraction
+            uint16_t top(); //current TOP, the duty resolution is TOP steps
+
+            //called from the overflow ISR, dont call it yourself
+            inline __attribute__((always_inline)) void onOverflow() {
+                _ocr[0] = _pendingOcrA;
+                _ocr[1] = _pendingOcrB;
+                *_timsk &= ~(BIT0 << TOIE1); //TOIEn is bit 0 on all 16 bit timers
+            }
+        private:
+            ComplementaryPwm(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint8_t* tccrc, volatile uint16_t* tcnt,
+                             volatile uint16_t* icr, volatile uint16_t* ocr, volatile uint8_t* timsk, volatile uint8_t* tifr,
+                             volatile uint8_t* prr, uint8_t prrBit, volatile uint8_t* port, volatile uint8_t* ddr, uint8_t pinBitA);
+            ComplementaryPwm(const ComplementaryPwm&) = delete;
+            ComplementaryPwm& operator=(const ComplementaryPwm&) = delete;
+
+            uint16_t deadTicks(uint32_t deadTimeNs, uint8_t clock); //dead time in ticks, rounded up, at least 1
+            void queue(); //hands the compare values for _duty to the ISR, interrupts must be off
+
+            volatile uint8_t* const _tccra;
+            volatile uint8_t* const _tccrb;
+            volatile uint8_t* const _tccrc;
+            volatile uint16_t* const _tcnt;
+            volatile uint16_t* const _icr;
+            volatile uint16_t* const _ocr; //OCRnA, OCRnB follows it
+            volatile uint8_t* const _timsk;
+            volatile uint8_t* const _tifr;
+            volatile uint8_t* const _prr;
+            const uint8_t _prrBit;
+            volatile uint8_t* const _port;
+            volatile uint8_t* const _ddr;
+            const uint8_t _pinMask; //OCnA and OCnB, next to each other on the same port on all 16 bit timers
+
+            uint8_t _clock = 0; //CSn2:0 bits while running
+            uint16_t _top = 0;
+            uint16_t _dead = 1; //dead time in ticks
+            uint32_t _duty = 0; //16.16 fraction as asked for, capped when the compare values are computed
+            uint16_t _pendingOcrA = 0;
+            uint16_t _pendingOcrB = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,18 @@
+#include "clbComplementaryPwm.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(1);
+
+static clb::ComplementaryPwm* s_bridge1 = nullptr;
+
+//only enabled while an update is pending, so the pointer is always set here
+ISR(TIMER1_OVF_vect) {
+    s_bridge1->onOverflow();
+}
+
+clb::ComplementaryPwm& clb::ComplementaryPwm::timer1() {
+    static clb::ComplementaryPwm s_bridge(&TCCR1A, &TCCR1B, &TCCR1C, &TCNT1, &ICR1, &OCR1A, &TIMSK1, &TIFR1, &PRR0, PRTIM1,
+                                          &PORTB, &DDRB, PB5);
+    s_bridge1 = &s_bridge;
+    return s_bridge;
+}
@@ -0,0 +1,18 @@
+#include "clbComplementaryPwm.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(3);
+
+static clb::ComplementaryPwm* s_bridge3 = nullptr;
+
+//only enabled while an update is pending, so the pointer is always set here
+ISR(TIMER3_OVF_vect) {
+    s_bridge3->onOverflow();
+}
+
+clb::ComplementaryPwm& clb::ComplementaryPwm::timer3() {
+    static clb::ComplementaryPwm s_bridge(&TCCR3A, &TCCR3B, &TCCR3C, &TCNT3, &ICR3, &OCR3A, &TIMSK3, &TIFR3, &PRR1, PRTIM3,
+                                          &PORTE, &DDRE, PE3);
+    s_bridge3 = &s_bridge;
+    return s_bridge;
+}
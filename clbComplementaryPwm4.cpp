@@ -0,0 +1,18 @@
+#include "clbComplementaryPwm.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(4);
+
+static clb::ComplementaryPwm* s_bridge4 = nullptr;
+
+//only enabled while an update is pending, so the pointer is always set here
+ISR(TIMER4_OVF_vect) {
+    s_bridge4->onOverflow();
+}
+
+clb::ComplementaryPwm& clb::ComplementaryPwm::timer4() {
+    static clb::ComplementaryPwm s_bridge(&TCCR4A, &TCCR4B, &TCCR4C, &TCNT4, &ICR4, &OCR4A, &TIMSK4, &TIFR4, &PRR1, PRTIM4,
+                                          &PORTH, &DDRH, PH3);
+    s_bridge4 = &s_bridge;
+    return s_bridge;
+}
@@ -0,0 +1,18 @@
+#include "clbComplementaryPwm.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(5);
+
+static clb::ComplementaryPwm* s_bridge5 = nullptr;
+
+//only enabled while an update is pending, so the pointer is always set here
+ISR(TIMER5_OVF_vect) {
+    s_bridge5->onOverflow();
+}
+
+clb::ComplementaryPwm& clb::ComplementaryPwm::timer5() {
+    static clb::ComplementaryPwm s_bridge(&TCCR5A, &TCCR5B, &TCCR5C, &TCNT5, &ICR5, &OCR5A, &TIMSK5, &TIFR5, &PRR1, PRTIM5,
+                                          &PORTL, &DDRL, PL3);
+    s_bridge5 = &s_bridge;
+    return s_bridge;
+}
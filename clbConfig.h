@@ -0,0 +1,47 @@
+#ifndef CLBCONFIG_H
+#define CLBCONFIG_H
+
+/* BUILD OPTIONS
+ *
+ * Optional clb features are switched on here. Uncomment the define (or pass it as a -D build flag) to compile the feature in.
+ * Everything in this file is off by default, and a feature that is off adds no code, RAM or ISR cycles.
+ */
+
+//lets clb::Timer0::instance() compile, Timer0 runs millis(), micros() and delay() so only define this if nothing uses them
+//#define CLB_ALLOW_TIMER0
+
+//records the entry latency of the Timer0, Timer1 and Timer2 compare match and overflow ISRs (see clbLatency.h)
+//#define CLB_ENABLE_ISR_LATENCY
+
+//counts entries and cpu cycles of the Timer0, Timer1 and Timer2 ISRs for clb::Stats::snapshot() (see clbStats.h), uses the cycle clock
+//#define CLB_ENABLE_STATS
+
+//records compare matches, overflows, async delays, callbacks and register writes of the timer classes into a ring buffer (see clbTrace.h), uses the cycle clock
+//#define CLB_ENABLE_TRACE
+
+//records the longest step ISR of every clb::Stepper axis for maxIsrCycles() (see clbStepper.h), uses the cycle clock
+//#define CLB_ENABLE_STEPPER_PROFILE
+
+//records the longest interrupts off span of every CLB_CRITICAL_SECTION() call site (see clbCriticalSection.h), uses the cycle clock
+//#define CLB_ENABLE_CRITICAL_PROFILE
+
+//stamps clb::ExtInterrupt events with the cycle clock instead of micros() (see clbExtInterrupt.h), uses the cycle clock
+//#define CLB_ENABLE_EXT_INTERRUPT_CYCLES
+
+//timers clb::TimerPool never hands out, as a mask of (1 << n), for code that uses a timer without claiming it like Servo or tone() (see clbTimerPool.h)
+//#define CLB_TIMER_POOL_RESERVED ((1 << 2) | (1 << 5))
+
+//USART (1, 2 or 3) clb::Telemetry streams its frames on, USART0 belongs to Serial (see clbTelemetry.h)
+//#define CLB_TELEMETRY_USART 1
+
+//16 bit timer (3, 4 or 5) used as the free running cycle clock by the features that need one (see clbCycleClock.h)
+//#define CLB_CYCLE_CLOCK_TIMER 5
+
+
+//features below here are derived from the ones above, dont edit
+#if (defined(CLB_ENABLE_STATS) || defined(CLB_ENABLE_TRACE) || defined(CLB_ENABLE_STEPPER_PROFILE) || defined(CLB_ENABLE_CRITICAL_PROFILE) || \
+     defined(CLB_ENABLE_EXT_INTERRUPT_CYCLES)) && !defined(CLB_ENABLE_CYCLE_CLOCK)
+#define CLB_ENABLE_CYCLE_CLOCK
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+#include "clbCriticalSection.h"
+#include "clbException.h"
+
+#ifdef CLB_ENABLE_CRITICAL_PROFILE
+
+static clb::CriticalSite* s_critical_sites = nullptr;
+
+//runs with interrupts still off, at the end of the outermost section
+void clb::CriticalProfile::record(clb::CriticalSite* site, uint32_t cycles) {
+    if (!site->listed) {
+        site->listed = true;
+        site->next = s_critical_sites;
+        s_critical_sites = site;
+    }
+    site->entries++;
+    if (cycles > site->maxCycles) {
+        site->maxCycles = cycles;
+    }
+}
+
+void clb::CriticalProfile::begin() {
+    clb::CycleClock::begin();
+}
+
+const clb::CriticalSite* clb::CriticalProfile::first() { return s_critical_sites; }
+
+void clb::CriticalProfile::print(Print& out) {
+    for (const clb::CriticalSite* _site = first(); _site; _site = _site->next) {
+        //copied under the lock so the numbers of one line belong together
+        uint8_t _sreg = SREG;
+        cli();
+        uint32_t _entries = _site->entries;
+        uint32_t _cycles = _site->maxCycles;
+        SREG = _sreg;
+
+        out.print(reinterpret_cast<const __FlashStringHelper*>(_site->file));
+        out.print(':');
+        out.print(_site->line);
+        out.print(F(" entries "));
+        out.print(_entries);
+        out.print(F(" max "));
+        out.print(_cycles);
+        out.print(F(" cycles "));
+        out.print(_cycles / (F_CPU / 1000000UL));
+        out.println(F(" us"));
+    }
+}
+
+void clb::CriticalProfile::reset() {
+    uint8_t _sreg = SREG;
+    cli();
+    for (clb::CriticalSite* _site = s_critical_sites; _site; _site = _site->next) {
+        _site->entries = 0;
+        _site->maxCycles = 0;
+    }
+    SREG = _sreg;
+}
+
+bool clb::CriticalProfile::isEnabled() { return true; }
+
+#else
+
+void clb::CriticalProfile::begin() { CRITICAL("CriticalProfile::begin() called but CLB_ENABLE_CRITICAL_PROFILE is not defined in clbConfig.h"); }
+void clb::CriticalProfile::record(clb::CriticalSite* site, uint32_t cycles) { }
+const clb::CriticalSite* clb::CriticalProfile::first() { return nullptr; }
+void clb::CriticalProfile::print(Print& out) { out.println(F("critical section profile not compiled in")); }
+void clb::CriticalProfile::reset() { }
+bool clb::CriticalProfile::isEnabled() { return false; }
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef CLBCRITICALSECTION_H
+#define CLBCRITICALSECTION_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbBits.h"
+#ifdef CLB_ENABLE_CRITICAL_PROFILE
+#include "clbCycleClock.h"
+#endif
+
+/* CRITICAL SECTIONS
+ *
+ * CLB_CRITICAL_SECTION() turns interrupts off until the end of the enclosing block and then puts SREG back the way it was,
+ * so sections nest and a section entered with interrupts already off leaves them off:
+ *
+ *     void clb::Timer1::setCompareMatchValueA(uint16_t value) {
+ *         CLB_CRITICAL_SECTION();
+ *         OCR1A = value;
+ *     } //SREG restored here, on every return path
+ *
+ * With CLB_ENABLE_CRITICAL_PROFILE (see clbConfig.h) every section records how long it kept interrupts off, measured on the
+ * cycle clock. Only the outermost section measures, the inner ones are part of its span. Each call site gets its own
+ * record, clb::CriticalProfile::print() lists file, line, entries and the longest span of every site that ran so far.
+ * Spans over two cycle clock wraps (8 ms at 16 MHz) lose the extra wraps, the overflow ISR cant run while they last.
+ *
+ * When the define is off the section is just the SREG save, cli() and restore.
+ */
+
+#ifdef CLB_ENABLE_CRITICAL_PROFILE
+#define CLB_CRITICAL_SECTION() \
+    static const char _clbCriticalFile[] PROGMEM = __FILE__; \
+    static clb::CriticalSite _clbCriticalSite = { _clbCriticalFile, __LINE__, 0, 0, nullptr, false }; \
+    clb::CriticalSection _clbCriticalSection(&_clbCriticalSite)
+#else
+#define CLB_CRITICAL_SECTION() clb::CriticalSection _clbCriticalSection
+#endif
+
+namespace clb {
+    //one per CLB_CRITICAL_SECTION() call site, only used with CLB_ENABLE_CRITICAL_PROFILE
+    struct CriticalSite {
+        const char* file; //PROGMEM
+        uint16_t line;
+        uint32_t entries; //outermost entries with interrupts on before
+        uint32_t maxCycles; //longest span with interrupts off
+        CriticalSite* next;
+        bool listed;
+    };
+
+    class CriticalProfile {
+        public:
+            static void begin(); //starts the cycle clock, call before the spans are needed
+            static void record(CriticalSite* site, uint32_t cycles); //called when a section ends, not meant for user code
+            static const CriticalSite* first(); //sites that ran at least once, follow next, nullptr when compiled out
+            static void print(Print& out = Serial); //one line per site: file:line entries max cycles and microseconds
+            static void reset(); //clears the counts of every site
+            static bool isEnabled(); //returns true if CLB_ENABLE_CRITICAL_PROFILE was defined when the library was built
+    };
+
+    //interrupts off for its lifetime, use through CLB_CRITICAL_SECTION
+    class CriticalSection {
+        public:
+#ifdef CLB_ENABLE_CRITICAL_PROFILE
+            inline __attribute__((always_inline)) explicit CriticalSection(CriticalSite* site) : _sreg(SREG), _site(site) {
+                cli();
+                if (_sreg & (BIT0 << SREG_I)) {
+                    _start = CycleClock::now32();
+                }
+            }
+            inline __attribute__((always_inline)) ~CriticalSection() {
+                if (_sreg & (BIT0 << SREG_I)) {
+                    CriticalProfile::record(_site, CycleClock::now32() - _start);
+                }
+                SREG = _sreg;
+            }
+#else
+            inline __attribute__((always_inline)) CriticalSection() : _sreg(SREG) { cli(); }
+            inline __attribute__((always_inline)) ~CriticalSection() { SREG = _sreg; }
+#endif
+            CriticalSection(const CriticalSection&) = delete;
+            CriticalSection& operator=(const CriticalSection&) = delete;
+        private:
+            uint8_t _sreg;
+#ifdef CLB_ENABLE_CRITICAL_PROFILE
+            CriticalSite* _site;
+            uint32_t _start = 0;
+#endif
+    };
+}
+
+#endif
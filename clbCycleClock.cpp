@@ -0,0 +1,77 @@
+#include "clbCycleClock.h"
+#include "clbTimer.h"
+#include "clbResource.h"
+
+#ifdef CLB_ENABLE_CYCLE_CLOCK
+
+CLB_CLAIM_TIMER(CLB_CYCLE_CLOCK_TIMER);
+
+static volatile uint16_t s_cycle_clock_overflows = 0;
+static bool s_cycle_clock_running = false;
+
+ISR(CLB_CYCLE_CLOCK_OVF_vect) {
+    s_cycle_clock_overflows++;
+}
+
+void clb::CycleClock::begin() {
+    if (s_cycle_clock_running) {
+        return;
+    }
+
+    uint8_t _sreg = SREG;
+    cli();
+
+    PRR1 &= ~(BIT0 << CLB_CYCLE_CLOCK_PRR_BIT);
+
+    CLB_CYCLE_CLOCK_TCCRB = 0;
+    CLB_CYCLE_CLOCK_TCCRA = 0; //normal mode, TOP = 0xFFFF
+    CLB_CYCLE_CLOCK_TCNT = 0;
+    CLB_CYCLE_CLOCK_TIFR = (BIT0 << CLB_CYCLE_CLOCK_TOV);
+    CLB_CYCLE_CLOCK_TIMSK = (BIT0 << CLB_CYCLE_CLOCK_TOIE);
+    s_cycle_clock_overflows = 0;
+    CLB_CYCLE_CLOCK_TCCRB = static_cast<uint8_t>(clb::TSyncClock::DIV_1);
+
+    s_cycle_clock_running = true;
+
+    SREG = _sreg;
+}
+
+void clb::CycleClock::end() {
+    uint8_t _sreg = SREG;
+    cli();
+
+    CLB_CYCLE_CLOCK_TCCRB = 0;
+    CLB_CYCLE_CLOCK_TIMSK = 0;
+    CLB_CYCLE_CLOCK_TIFR = (BIT0 << CLB_CYCLE_CLOCK_TOV);
+    CLB_CYCLE_CLOCK_TCNT = 0;
+
+    s_cycle_clock_running = false;
+
+    SREG = _sreg;
+}
+
+bool clb::CycleClock::isRunning() { return s_cycle_clock_running; }
+
+uint32_t clb::CycleClock::now32() {
+    uint8_t _sreg = SREG;
+    cli();
+
+    uint16_t _overflows = s_cycle_clock_overflows;
+    uint16_t _tcnt = CLB_CYCLE_CLOCK_TCNT;
+    if ((CLB_CYCLE_CLOCK_TIFR & (BIT0 << CLB_CYCLE_CLOCK_TOV)) && _tcnt < 0x8000) {
+        _overflows++; //wrapped after cli() but the overflow ISR hasnt run yet
+    }
+
+    SREG = _sreg;
+
+    return ((uint32_t)_overflows << 16) | _tcnt;
+}
+
+#else
+
+void clb::CycleClock::begin() { CRITICAL("CycleClock::begin() called but no feature using the cycle clock is enabled in clbConfig.h"); }
+void clb::CycleClock::end() { }
+bool clb::CycleClock::isRunning() { return false; }
+uint32_t clb::CycleClock::now32() { return 0; }
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef CLBCYCLECLOCK_H
+#define CLBCYCLECLOCK_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbBits.h"
+
+/* CYCLE CLOCK
+ *
+ * One of the 16 bit timers 3, 4 or 5 (CLB_CYCLE_CLOCK_TIMER, Timer5 by default) runs free in normal mode with no prescaler,
+ * so TCNTn counts cpu cycles. Its overflow ISR extends the count to 32 bits (wraps after ~268 seconds at 16MHz).
+ * The clock is shared by the instrumentation features (stats, trace) and only gets compiled in when one of them is enabled,
+ * so the timer is free for other uses otherwise. While it is compiled in dont use the chosen timer for anything else.
+ */
+
+#ifndef CLB_CYCLE_CLOCK_TIMER
+#define CLB_CYCLE_CLOCK_TIMER 5
+#endif
+
+#if CLB_CYCLE_CLOCK_TIMER == 3
+#define CLB_CYCLE_CLOCK_TCNT TCNT3
+#define CLB_CYCLE_CLOCK_TCCRA TCCR3A
+#define CLB_CYCLE_CLOCK_TCCRB TCCR3B
+#define CLB_CYCLE_CLOCK_TIMSK TIMSK3
+#define CLB_CYCLE_CLOCK_TIFR TIFR3
+#define CLB_CYCLE_CLOCK_PRR_BIT PRTIM3
+#define CLB_CYCLE_CLOCK_TOIE TOIE3
+#define CLB_CYCLE_CLOCK_TOV TOV3
+#define CLB_CYCLE_CLOCK_OVF_vect TIMER3_OVF_vect
+#elif CLB_CYCLE_CLOCK_TIMER == 4
+#define CLB_CYCLE_CLOCK_TCNT TCNT4
+#define CLB_CYCLE_CLOCK_TCCRA TCCR4A
+#define CLB_CYCLE_CLOCK_TCCRB TCCR4B
+#define CLB_CYCLE_CLOCK_TIMSK TIMSK4
+#define CLB_CYCLE_CLOCK_TIFR TIFR4
+#define CLB_CYCLE_CLOCK_PRR_BIT PRTIM4
+#define CLB_CYCLE_CLOCK_TOIE TOIE4
+#define CLB_CYCLE_CLOCK_TOV TOV4
+#define CLB_CYCLE_CLOCK_OVF_vect TIMER4_OVF_vect
+#elif CLB_CYCLE_CLOCK_TIMER == 5
+#define CLB_CYCLE_CLOCK_TCNT TCNT5
+#define CLB_CYCLE_CLOCK_TCCRA TCCR5A
+#define CLB_CYCLE_CLOCK_TCCRB TCCR5B
+#define CLB_CYCLE_CLOCK_TIMSK TIMSK5
+#define CLB_CYCLE_CLOCK_TIFR TIFR5
+#define CLB_CYCLE_CLOCK_PRR_BIT PRTIM5
+#define CLB_CYCLE_CLOCK_TOIE TOIE5
+#define CLB_CYCLE_CLOCK_TOV TOV5
+#define CLB_CYCLE_CLOCK_OVF_vect TIMER5_OVF_vect
+#else
+#error "CLB_CYCLE_CLOCK_TIMER must be 3, 4 or 5"
+#endif
+
+namespace clb {
+    class CycleClock {
+        public:
+            static void begin(); //powers up the timer and starts it counting cpu cycles, safe to call more than once
+            static void end(); //stops the timer and resets its registers
+            static bool isRunning(); //returns true if begin() was called
+            static inline uint16_t now16() { return CLB_CYCLE_CLOCK_TCNT; } //low 16 bits of the cycle count, cheap enough for ISRs
+            static uint32_t now32(); //full 32 bit cycle count, safe to call from ISRs and with interrupts on or off
+    };
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include "clbDebounce.h"
+
+#if (CLB_DEBOUNCE_QUEUE_SIZE & (CLB_DEBOUNCE_QUEUE_SIZE - 1)) != 0 || CLB_DEBOUNCE_QUEUE_SIZE > 128
+#error "CLB_DEBOUNCE_QUEUE_SIZE must be a power of 2 and at most 128"
+#endif
+
+//one port, the counter bits of pin n are bit n of count1:count0. 11 is the reset value, the state flips when the count
+//wraps from 00 back to 11
+struct DebouncePort {
+    volatile uint8_t* pin;
+    uint8_t mask;
+    uint8_t invert; //pins read inverted
+    uint8_t state; //debounced state, only pins in mask are ever 1
+    uint8_t count0;
+    uint8_t count1;
+};
+
+static DebouncePort s_debounce_ports[CLB_DEBOUNCE_PORTS];
+
+static struct DebounceState {
+    volatile uint8_t ports = 0; //ports in use, scan() only reads this many
+    uint16_t scans = 0;
+    clb::DebounceEvent queue[CLB_DEBOUNCE_QUEUE_SIZE];
+    volatile uint8_t head = 0; //written by scan() only
+    volatile uint8_t tail = 0; //written by the main loop only
+    volatile uint16_t dropped = 0;
+} s_debounce;
+
+uint8_t clb::Debounce::addPort(volatile uint8_t* pinRegister, uint8_t mask, bool pullUp) {
+    if (pinRegister == nullptr || mask == 0) {
+        CRITICAL("Debounce::addPort() needs a PINx register and pins");
+        return CLB_DEBOUNCE_PORTS;
+    }
+    if (s_debounce.ports >= CLB_DEBOUNCE_PORTS) {
+        CRITICAL("Debounce::addPort() no free port, raise CLB_DEBOUNCE_PORTS");
+        return CLB_DEBOUNCE_PORTS;
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    //DDRx and PORTx follow PINx for every port of the ATmega2560
+    pinRegister[1] &= ~mask;
+    if (pullUp) {
+        pinRegister[2] |= mask;
+    }
+    else {
+        pinRegister[2] &= ~mask;
+    }
+
+    uint8_t _port = s_debounce.ports;
+    DebouncePort& _entry = s_debounce_ports[_port];
+    _entry.pin = pinRegister;
+    _entry.mask = mask;
+    _entry.invert = pullUp ? mask : 0;
+    //starts from the level the pins have now, without an event. With the pull-ups just on the pins may still be rising,
+    //a pin that settles the other way shows up as a change 4 scans later
+    _entry.state = (*pinRegister ^ _entry.invert) & mask;
+    _entry.count0 = 0xFF;
+    _entry.count1 = 0xFF;
+    s_debounce.ports = _port + 1;
+    return _port;
+}
+
+void clb::Debounce::end() {
+    CLB_CRITICAL_SECTION();
+    s_debounce.ports = 0;
+    s_debounce.head = 0;
+    s_debounce.tail = 0;
+    s_debounce.dropped = 0;
+}
+
+void clb::Debounce::scan() {
+    uint16_t _scan = ++s_debounce.scans;
+    uint8_t _ports = s_debounce.ports;
+    for (uint8_t i = 0; i < _ports; i++) {
+        DebouncePort& _entry = s_debounce_ports[i];
+        uint8_t _changed = ((*_entry.pin ^ _entry.invert) & _entry.mask) ^ _entry.state;
+        //pins that read the same as their state go back to 11, the others count down one step
+        uint8_t _count0 = ~(_entry.count0 & _changed);
+        uint8_t _count1 = _count0 ^ (_entry.count1 & _changed);
+        _entry.count0 = _count0;
+        _entry.count1 = _count1;
+        _changed &= _count0 & _count1; //pins that wrapped, they differed in the last 4 scans
+        if (_changed == 0) {
+            continue;
+        }
+        uint8_t _state = _entry.state ^ _changed;
+        _entry.state = _state;
+
+        uint8_t _slot = s_debounce.head;
+        uint8_t _next = (_slot + 1) & (CLB_DEBOUNCE_QUEUE_SIZE - 1);
+        if (_next == s_debounce.tail) {
+            if (s_debounce.dropped != 0xFFFF) {
+                s_debounce.dropped++;
+            }
+            continue;
+        }
+        DebounceEvent& _event = s_debounce.queue[_slot];
+        _event.scan = _scan;
+        _event.port = i;
+        _event.changed = _changed;
+        _event.state = _state;
+        asm volatile("" ::: "memory"); //the event is complete before the main loop can see it
+        s_debounce.head = _next;
+    }
+}
+
+bool clb::Debounce::read(clb::DebounceEvent& event) {
+    uint8_t _slot = s_debounce.tail;
+    if (_slot == s_debounce.head) {
+        return false;
+    }
+    event = s_debounce.queue[_slot];
+    asm volatile("" ::: "memory"); //the copy is done before scan() can reuse the slot
+    s_debounce.tail = (_slot + 1) & (CLB_DEBOUNCE_QUEUE_SIZE - 1);
+    return true;
+}
+
+uint8_t clb::Debounce::available() { return (s_debounce.head - s_debounce.tail) & (CLB_DEBOUNCE_QUEUE_SIZE - 1); }
+
+uint16_t clb::Debounce::dropped() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _dropped = s_debounce.dropped;
+    return _dropped;
+}
+
+void clb::Debounce::resetDropped() {
+    CLB_CRITICAL_SECTION();
+    s_debounce.dropped = 0;
+}
+
+uint8_t clb::Debounce::state(uint8_t port) {
+    if (port >= s_debounce.ports) {
+        return 0;
+    }
+    return s_debounce_ports[port].state; //a single byte, scan() cant tear it
+}
+
+bool clb::Debounce::state(uint8_t port, uint8_t bit) { return (state(port) >> (bit & 0b111)) & BIT0; }
+
+uint16_t clb::Debounce::scans() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _scans = s_debounce.scans;
+    return _scans;
+}
@@ -0,0 +1,73 @@
+#include "clbEventCounter.h"
+
+clb::EventCounter::EventCounter(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint16_t* tcnt, volatile uint8_t* timsk,
+                                volatile uint8_t* tifr, volatile uint8_t* prr, uint8_t prrBit, volatile uint8_t* ddr,
+                                volatile uint8_t* port, uint8_t pinBit)
+    : _tccra(tccra), _tccrb(tccrb), _tcnt(tcnt), _timsk(timsk), _tifr(tifr), _prr(prr), _prrBit(prrBit), _ddr(ddr),
+      _port(port), _pinMask(BIT0 << pinBit) { }
+
+void clb::EventCounter::begin(clb::TSyncClock edge) {
+    if (edge != clb::TSyncClock::EXT_CLK_FE && edge != clb::TSyncClock::EXT_CLK_RE) {
+        CRITICAL("EventCounter counts pin edges, use EXT_CLK_FE or EXT_CLK_RE");
+        return;
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    *_prr &= ~(BIT0 << _prrBit);
+
+    *_tccrb = 0;
+    *_tccra = 0; //normal mode, TOP = 0xFFFF
+    *_ddr &= ~_pinMask; //Tn as input without pullup
+    *_port &= ~_pinMask;
+    *_tcnt = 0;
+    _overflows = 0;
+    *_tifr = (BIT0 << TOV1); //TOVn and TOIEn are bit 0 on all 16 bit timers
+    *_timsk = (BIT0 << TOIE1);
+    *_tccrb = static_cast<uint8_t>(edge);
+}
+
+void clb::EventCounter::end() {
+    CLB_CRITICAL_SECTION();
+    *_tccrb = 0;
+    *_timsk = 0;
+}
+
+uint32_t clb::EventCounter::count() {
+    CLB_CRITICAL_SECTION();
+    uint32_t _count = read();
+    return _count;
+}
+
+void clb::EventCounter::reset() {
+    CLB_CRITICAL_SECTION();
+    *_tcnt = 0;
+    _overflows = 0;
+    *_tifr = (BIT0 << TOV1);
+    _gateLast = 0;
+}
+
+bool clb::EventCounter::frequencyAvailable() { return _windowReady; }
+
+uint32_t clb::EventCounter::windowCount() {
+    CLB_CRITICAL_SECTION();
+    uint32_t _count = _windowCount;
+    return _count;
+}
+
+uint32_t clb::EventCounter::frequency() {
+    uint32_t _count;
+    uint16_t _window;
+    {
+        CLB_CRITICAL_SECTION();
+        _count = _windowCount;
+        _window = _gateWindow;
+        _windowReady = false;
+    }
+
+    if (_window == 0) {
+        return 0;
+    }
+    //split so the scaling to Hz cant overflow 32 bits
+    return (_count / _window) * 1000UL + ((_count % _window) * 1000UL) / _window;
+}
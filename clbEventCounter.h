@@ -0,0 +1,108 @@
+#ifndef CLBEVENTCOUNTER_H
+#define CLBEVENTCOUNTER_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+#include "clbCriticalSection.h"
+
+/* EXTERNAL EVENT COUNTER
+ *
+ * Counts edges on the Tn pin of a 16 bit timer in hardware (TSyncClock::EXT_CLK_FE or EXT_CLK_RE) and extends the count to
+ * 32 bits in the overflow ISR, so there is one interrupt every 65536 edges and none per edge. The pin is synchronized to the
+ * cpu clock, the input has to stay below F_CPU / 2.5 (6.4 MHz at 16 MHz) with high and low times over one cpu cycle.
+ *
+ *   Timer1  T1 = PD6    Timer3  T3 = PE6    Timer4  T4 = PH7    Timer5  T5 = PL2 (pin 47)
+ *
+ * Only T5 is on a header of the Mega 2560 board, the others need a custom board.
+ *
+ * count() reads TCNTn and the overflow count with interrupts off and corrects for an overflow that is still pending, so the
+ * 32 bit value is always consistent, also from inside other ISRs.
+ *
+ * Gated mode measures frequency: beginGate() runs Timer2 as a 1 ms time base and snapshots the count every windowMs
+ * milliseconds from its compare match ISR. Each result is the difference between two snapshots taken at the same point in
+ * the same ISR, so a fixed ISR latency cancels out. The latency isnt fixed though: another ISR running or interrupts off
+ * when the match comes delay the snapshot, so each window is off by the difference between the entry latencies of its two
+ * snapshots, up to the longest interrupts off span in the program (see CLB_ENABLE_CRITICAL_PROFILE and clbLatency.h).
+ * Only one counter can be gated at a time.
+ *
+ * Each counter takes over its whole timer and the gate takes over Timer2 (claimed with CLB_CLAIM_TIMER, see clbResource.h),
+ * so the gate cant be used together with clb::Timer2 or tone().
+ */
+
+namespace clb {
+    class EventCounter {
+        public:
+            static EventCounter& timer1(); //counts T1 (PD6)
+            static EventCounter& timer3(); //counts T3 (PE6)
+            static EventCounter& timer4(); //counts T4 (PH7)
+            static EventCounter& timer5(); //counts T5 (PL2, pin 47 on the Mega)
+
+            void begin(TSyncClock edge); //powers up the timer and starts counting, edge is EXT_CLK_FE or EXT_CLK_RE
+            void end(); //stops counting, call endGate() first if gated (end() doesnt touch Timer2 so it doesnt pull the gate in)
+
+            uint32_t count(); //edges since begin() or reset(), wraps at 2^32
+            void reset();
+
+            bool beginGate(uint16_t windowMs); //starts measuring frequency over windowMs long windows, takes Timer2
+            void endGate();
+            bool frequencyAvailable(); //true once a new window finished since the last frequency() call
+            uint32_t frequency(); //edges per second over the last finished window, 0 before the first one
+            uint32_t windowCount(); //raw edges in the last finished window
+
+            //called from the ISRs, dont call them yourself
+            inline __attribute__((always_inline)) void onOverflow() { _overflows++; }
+            inline __attribute__((always_inline)) void onGateTick() {
+                if (--_gateTicks != 0) {
+                    return;
+                }
+                _gateTicks = _gateWindow;
+                uint32_t _now = read();
+                _windowCount = _now - _gateLast;
+                _gateLast = _now;
+                _windowReady = true;
+            }
+        private:
+            EventCounter(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint16_t* tcnt, volatile uint8_t* timsk,
+                         volatile uint8_t* tifr, volatile uint8_t* prr, uint8_t prrBit, volatile uint8_t* ddr,
+                         volatile uint8_t* port, uint8_t pinBit);
+            EventCounter(const EventCounter&) = delete;
+            EventCounter& operator=(const EventCounter&) = delete;
+
+            //full count with the pending overflow folded in, interrupts must be off
+            inline __attribute__((always_inline)) uint32_t read() {
+                uint16_t _low = *_tcnt;
+                uint16_t _high = _overflows;
+                //TOVn is bit 0 on all 16 bit timers, a small TCNT means the wrap happened before the read
+                if ((*_tifr & (BIT0 << TOV1)) && _low < 0x8000) {
+                    _high++;
+                }
+                return ((uint32_t)_high << 16) | _low;
+            }
+
+            volatile uint8_t* const _tccra;
+            volatile uint8_t* const _tccrb;
+            volatile uint16_t* const _tcnt;
+            volatile uint8_t* const _timsk;
+            volatile uint8_t* const _tifr;
+            volatile uint8_t* const _prr;
+            const uint8_t _prrBit;
+            volatile uint8_t* const _ddr;
+            volatile uint8_t* const _port;
+            const uint8_t _pinMask;
+
+            volatile uint16_t _overflows = 0; //high word of the count
+
+            //gate state, written by the Timer2 ISR while gated
+            uint16_t _gateWindow = 0; //window length in gate ticks (ms)
+            volatile uint16_t _gateTicks = 0;
+            uint32_t _gateLast = 0;
+            volatile uint32_t _windowCount = 0;
+            volatile bool _windowReady = false;
+    };
+}
+
+#endif
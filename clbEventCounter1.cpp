@@ -0,0 +1,17 @@
+#include "clbEventCounter.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(1);
+
+static clb::EventCounter* s_event_counter1 = nullptr;
+
+//only enabled by begin(), so the pointer is always set here
+ISR(TIMER1_OVF_vect) {
+    s_event_counter1->onOverflow();
+}
+
+clb::EventCounter& clb::EventCounter::timer1() {
+    static clb::EventCounter s_counter(&TCCR1A, &TCCR1B, &TCNT1, &TIMSK1, &TIFR1, &PRR0, PRTIM1, &DDRD, &PORTD, PD6);
+    s_event_counter1 = &s_counter;
+    return s_counter;
+}
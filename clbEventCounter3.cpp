@@ -0,0 +1,17 @@
+#include "clbEventCounter.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(3);
+
+static clb::EventCounter* s_event_counter3 = nullptr;
+
+//only enabled by begin(), so the pointer is always set here
+ISR(TIMER3_OVF_vect) {
+    s_event_counter3->onOverflow();
+}
+
+clb::EventCounter& clb::EventCounter::timer3() {
+    static clb::EventCounter s_counter(&TCCR3A, &TCCR3B, &TCNT3, &TIMSK3, &TIFR3, &PRR1, PRTIM3, &DDRE, &PORTE, PE6);
+    s_event_counter3 = &s_counter;
+    return s_counter;
+}
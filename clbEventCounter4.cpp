@@ -0,0 +1,17 @@
+#include "clbEventCounter.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(4);
+
+static clb::EventCounter* s_event_counter4 = nullptr;
+
+//only enabled by begin(), so the pointer is always set here
+ISR(TIMER4_OVF_vect) {
+    s_event_counter4->onOverflow();
+}
+
+clb::EventCounter& clb::EventCounter::timer4() {
+    static clb::EventCounter s_counter(&TCCR4A, &TCCR4B, &TCNT4, &TIMSK4, &TIFR4, &PRR1, PRTIM4, &DDRH, &PORTH, PH7);
+    s_event_counter4 = &s_counter;
+    return s_counter;
+}
@@ -0,0 +1,17 @@
+#include "clbEventCounter.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(5);
+
+static clb::EventCounter* s_event_counter5 = nullptr;
+
+//only enabled by begin(), so the pointer is always set here
+ISR(TIMER5_OVF_vect) {
+    s_event_counter5->onOverflow();
+}
+
+clb::EventCounter& clb::EventCounter::timer5() {
+    static clb::EventCounter s_counter(&TCCR5A, &TCCR5B, &TCNT5, &TIMSK5, &TIFR5, &PRR1, PRTIM5, &DDRL, &PORTL, PL2);
+    s_event_counter5 = &s_counter;
+    return s_counter;
+}
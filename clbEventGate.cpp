@@ -0,0 +1,59 @@
+#include "clbEventCounter.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(2);
+
+//Timer2 in CTC mode at clk/64 with one compare match per millisecond
+#define CLB_EVENT_GATE_TOP (F_CPU / 64 / 1000 - 1)
+#if CLB_EVENT_GATE_TOP > 255 || F_CPU % 64000 != 0
+#error "EventCounter gate needs F_CPU to be a multiple of 64 kHz and at most 16.384 MHz"
+#endif
+
+static clb::EventCounter* s_gated_counter = nullptr;
+
+//only enabled by beginGate(), so the pointer is always set here
+ISR(TIMER2_COMPA_vect) {
+    s_gated_counter->onGateTick();
+}
+
+bool clb::EventCounter::beginGate(uint16_t windowMs) {
+    if (windowMs == 0) {
+        CRITICAL("EventCounter gate window must be at least 1 ms");
+        return false;
+    }
+    if (s_gated_counter && s_gated_counter != this && s_gated_counter->_gateWindow != 0) {
+        WARNING("EventCounter gate is already used by another counter");
+        return false;
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    PRR0 &= ~(BIT0 << PRTIM2);
+    TCCR2B = 0;
+    TIMSK2 = 0;
+    ASSR &= ~(BIT0 << AS2); //clocked from the cpu clock like the counters
+    TCCR2A = (BIT0 << WGM21); //CTC, TOP = OCR2A
+    TCNT2 = 0;
+    OCR2A = CLB_EVENT_GATE_TOP;
+    TIFR2 = (BIT0 << OCF2A);
+
+    s_gated_counter = this;
+    _gateWindow = windowMs;
+    _gateTicks = windowMs;
+    _gateLast = read();
+    _windowCount = 0;
+    _windowReady = false;
+
+    TIMSK2 = (BIT0 << OCIE2A);
+    TCCR2B = static_cast<uint8_t>(clb::TAsynClock::DIV_64);
+    return true;
+}
+
+void clb::EventCounter::endGate() {
+    CLB_CRITICAL_SECTION();
+    if (s_gated_counter == this) {
+        TIMSK2 = 0;
+        TCCR2B = 0;
+    }
+    _gateWindow = 0;
+}
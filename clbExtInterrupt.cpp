@@ -0,0 +1,116 @@
+#include "clbExtInterrupt.h"
+
+#if (CLB_EXT_INTERRUPT_QUEUE_SIZE & (CLB_EXT_INTERRUPT_QUEUE_SIZE - 1)) != 0 || CLB_EXT_INTERRUPT_QUEUE_SIZE > 128
+#error "CLB_EXT_INTERRUPT_QUEUE_SIZE must be a power of 2 and at most 128"
+#endif
+
+clb::ExtInterrupt& clb::ExtInterrupt::instance() {
+    static clb::ExtInterrupt s_ext_interrupt;
+    return s_ext_interrupt;
+}
+
+clb::ExtInterrupt::ExtInterrupt() {
+    for (uint8_t i = 0; i < CLB_EXT_INTERRUPT_SOURCES; i++) {
+        _callbacks[i] = nullptr;
+        _contexts[i] = nullptr;
+        _lastTime[i] = 0;
+        _shortest[i] = 0;
+    }
+}
+
+bool clb::ExtInterrupt::read(clb::ExtInterruptEvent& event) {
+    uint8_t _slot = _tail;
+    if (_slot == _head) {
+        return false;
+    }
+    event = _queue[_slot];
+    asm volatile("" ::: "memory"); //the copy is done before the ISR can reuse the slot
+    _tail = (_slot + 1) & (CLB_EXT_INTERRUPT_QUEUE_SIZE - 1);
+    measure(event);
+    return true;
+}
+
+void clb::ExtInterrupt::measure(const clb::ExtInterruptEvent& event) {
+    //INTn is source n, pin n of bank b is source 8 + 8 * b + n
+    uint8_t _first = event.vector;
+    uint8_t _changed = event.changed;
+    if (event.vector >= CLB_EXT_INTERRUPT_BANK) {
+        _first = CLB_EXT_INTERRUPT_BANK + (event.vector - CLB_EXT_INTERRUPT_BANK) * 8;
+    }
+    for (uint8_t i = 0; _changed != 0; i++, _changed >>= 1) {
+        if (!(_changed & BIT0)) {
+            continue;
+        }
+        uint8_t _source = _first + i;
+        uint32_t _bit = (uint32_t)BIT0 << _source;
+        if (_seen & _bit) {
+            uint32_t _interval = event.time - _lastTime[_source];
+            if (_interval != 0 && (_shortest[_source] == 0 || _interval < _shortest[_source])) {
+                _shortest[_source] = _interval; //0 is below the resolution of micros(), it doesnt give a rate
+            }
+        }
+        _seen |= _bit;
+        _lastTime[_source] = event.time;
+    }
+}
+
+uint8_t clb::ExtInterrupt::dispatch(uint8_t maxEvents) {
+    uint8_t _count = 0;
+    clb::ExtInterruptEvent _event;
+    while (_count < maxEvents && read(_event)) {
+        _count++;
+        if (_event.vector < CLB_EXT_INTERRUPT_BANK) {
+            if (_callbacks[_event.vector]) {
+                _callbacks[_event.vector](_contexts[_event.vector], _event.levels & BIT0, _event.time);
+            }
+            continue;
+        }
+        uint8_t _first = CLB_EXT_INTERRUPT_BANK + (_event.vector - CLB_EXT_INTERRUPT_BANK) * 8;
+        for (uint8_t i = 0; i < 8; i++) {
+            uint8_t _source = _first + i;
+            if ((_event.changed & (BIT0 << i)) && _callbacks[_source]) {
+                _callbacks[_source](_contexts[_source], _event.levels & (BIT0 << i), _event.time);
+            }
+        }
+    }
+    return _count;
+}
+
+uint8_t clb::ExtInterrupt::available() { return (_head - _tail) & (CLB_EXT_INTERRUPT_QUEUE_SIZE - 1); }
+
+uint16_t clb::ExtInterrupt::dropped() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _count = _dropped;
+    return _count;
+}
+
+void clb::ExtInterrupt::resetDropped() {
+    CLB_CRITICAL_SECTION();
+    _dropped = 0;
+}
+
+uint32_t clb::ExtInterrupt::peakRate(uint8_t source) {
+    if (source >= CLB_EXT_INTERRUPT_SOURCES || _shortest[source] == 0) {
+        return 0;
+    }
+#ifdef CLB_ENABLE_EXT_INTERRUPT_CYCLES
+    return (F_CPU + _shortest[source] / 2) / _shortest[source];
+#else
+    return (1000000UL + _shortest[source] / 2) / _shortest[source];
+#endif
+}
+
+void clb::ExtInterrupt::resetPeakRates() {
+    _seen = 0;
+    for (uint8_t i = 0; i < CLB_EXT_INTERRUPT_SOURCES; i++) {
+        _shortest[i] = 0;
+    }
+}
+
+bool clb::ExtInterrupt::hasCycleTimestamps() {
+#ifdef CLB_ENABLE_EXT_INTERRUPT_CYCLES
+    return true;
+#else
+    return false;
+#endif
+}
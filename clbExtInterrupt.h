@@ -0,0 +1,141 @@
+#ifndef CLBEXTINTERRUPT_H
+#define CLBEXTINTERRUPT_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbBits.h"
+#include "clbException.h"
+#include "clbCycleClock.h"
+#include "clbCriticalSection.h"
+
+/* EXTERNAL INTERRUPTS
+ *
+ * Handles INT0..INT7 and the three pin change banks PCINT0..23. The ISRs only read the pin, take a timestamp and put an
+ * event into a lock free queue, the callbacks run later from dispatch() in the main loop with the context pointer they
+ * were attached with. So the entry path stays short and a burst of edges is queued instead of lost:
+ *
+ *     void onPulse(void* context, bool level, uint32_t time) { static_cast<Encoder*>(context)->edge(level, time); }
+ *
+ *     clb::ExtInterrupt& _ext = clb::ExtInterrupt::instance();
+ *     _ext.attach(4, clb::TExtEdge::RISING, onPulse, &s_encoder); //INT4, pin 2
+ *     _ext.attachPinChange(16, onPulse, &s_button); //PCINT16, A8
+ *     ...
+ *     _ext.dispatch(); //in loop()
+ *
+ *   INT0 pin 21 (PD0)   INT2 pin 19 (PD2)   INT4 pin 2 (PE4)   INT6 PE6 (not on a header)
+ *   INT1 pin 20 (PD1)   INT3 pin 18 (PD3)   INT5 pin 3 (PE5)   INT7 PE7 (not on a header)
+ *   PCINT0..7   PB0..7, pins 53 52 51 50 10 11 12 13
+ *   PCINT8      PE0, pin 0 (RX0)    PCINT9..15  PJ0..6, pins 15 and 14 for PJ0 and PJ1, the others not on a header
+ *   PCINT16..23 PK0..7, A8..A15
+ *
+ * Timestamps are micros() by default. With CLB_ENABLE_EXT_INTERRUPT_CYCLES (see clbConfig.h) they are the 32 bit cycle clock
+ * (see clbCycleClock.h) instead, exact to the cycle of the ISR entry and cheaper to read.
+ *
+ * The queue has one producer, the ISRs dont nest, and one consumer, dispatch() or read(), so neither side locks: the ISR
+ * only writes the head and the main loop only the tail. A full queue drops the new event and counts it in dropped().
+ * A pin change bank puts one event per interrupt into the queue with all its pins that changed, dispatch() calls the
+ * callback of each of them. Two changes of the same pin before the ISR reads the port cancel out and arent seen.
+ *
+ * Edge rate, an unmeasured estimate: the call to micros() makes the ISR save and restore every call clobbered register,
+ * so with micros() an INT vector should take about 120-150 cycles from entry to reti and a pin change vector 150-180, a
+ * limit of roughly 90-130 kHz per pin at 16 MHz if nothing else runs and dispatch() keeps up. The cycle clock is read
+ * inline and should save 40-60 of those cycles. Count the cycles of __vector_1 (INT0) and __vector_9 (PCINT0) in the
+ * avr-objdump listing of your build, or toggle a pin at ISR entry and exit, for the real figure. Faster edges merge in
+ * the interrupt flag. peakRate() returns the highest edge rate a pin actually showed, from the shortest time between two
+ * of its events seen by dispatch() or read(). With micros() it only resolves 4 us at 16 MHz, so it cant report more than
+ * 250 kHz, intervals below 4 us are skipped or read as 4 us.
+ *
+ * The INT vectors are in clbExtInterruptInt.cpp and the pin change vectors in clbExtInterruptPcint.cpp, each only linked
+ * when attach() or attachPinChange() is used. attachInterrupt() defines the INT vectors too and SoftwareSerial the pin change
+ * ones, using either together with the matching half of this module fails to link with a duplicate __vector_N.
+ */
+
+#ifndef CLB_EXT_INTERRUPT_QUEUE_SIZE
+#define CLB_EXT_INTERRUPT_QUEUE_SIZE 32 //events in the queue, must be a power of 2 and at most 128, each event is 7 bytes of RAM
+#endif
+
+#define CLB_EXT_INTERRUPT_SOURCES 32 //INT0..7 are sources 0..7, PCINT0..23 sources 8..31
+#define CLB_EXT_INTERRUPT_BANK 8 //vector of the first pin change bank in an event, the banks are 8, 9 and 10
+
+namespace clb {
+    //sense control of an INTn pin, ISCn1:0
+    enum class TExtEdge : uint8_t {
+        LOW_LEVEL = 0b00, //fires again and again while the pin is low
+        CHANGE = 0b01,
+        FALLING = 0b10,
+        RISING = 0b11
+    };
+
+    //one queued interrupt
+    struct ExtInterruptEvent {
+        uint32_t time; //micros() or cycle clock on ISR entry
+        uint8_t vector; //0..7 for INTn, CLB_EXT_INTERRUPT_BANK + bank for pin changes
+        uint8_t changed; //BIT0 for INTn, the pins of the bank that changed
+        uint8_t levels; //pin levels read on ISR entry, same bit layout as changed
+    };
+
+    class ExtInterrupt {
+        public:
+            static ExtInterrupt& instance(); //returns the only ExtInterrupt, created on the first call
+
+            bool attach(uint8_t interrupt, TExtEdge edge, void (*callback)(void* context, bool level, uint32_t time), void* context); //INT0..7
+            void detach(uint8_t interrupt);
+            bool attachPinChange(uint8_t pcint, void (*callback)(void* context, bool level, uint32_t time), void* context); //PCINT0..23, both edges
+            void detachPinChange(uint8_t pcint);
+
+            uint8_t dispatch(uint8_t maxEvents = CLB_EXT_INTERRUPT_QUEUE_SIZE); //runs the callbacks of queued events, returns how many events
+            bool read(ExtInterruptEvent& event); //takes the oldest event out of the queue without running callbacks, false if it is empty
+            uint8_t available(); //events waiting in the queue
+            uint16_t dropped(); //events lost to a full queue, saturates at 0xFFFF
+            void resetDropped();
+
+            uint32_t peakRate(uint8_t source); //highest edge rate seen on a source (INTn = n, PCINTn = 8 + n) in Hz, 0 before two events
+            void resetPeakRates();
+            static bool hasCycleTimestamps(); //true if CLB_ENABLE_EXT_INTERRUPT_CYCLES was defined when the library was built
+
+            //called from the ISRs, dont call it yourself
+            inline __attribute__((always_inline)) void onEdge(uint8_t vector, uint8_t changed, uint8_t levels) {
+#ifdef CLB_ENABLE_EXT_INTERRUPT_CYCLES
+                uint32_t _time = CycleClock::now32();
+#else
+                uint32_t _time = micros();
+#endif
+                uint8_t _slot = _head;
+                uint8_t _next = (_slot + 1) & (CLB_EXT_INTERRUPT_QUEUE_SIZE - 1);
+                if (_next == _tail) {
+                    if (_dropped != 0xFFFF) {
+                        _dropped++;
+                    }
+                    return;
+                }
+                ExtInterruptEvent& _event = _queue[_slot];
+                _event.time = _time;
+                _event.vector = vector;
+                _event.changed = changed;
+                _event.levels = levels;
+                asm volatile("" ::: "memory"); //the event is complete before the main loop can see it
+                _head = _next;
+            }
+        private:
+            ExtInterrupt();
+            ExtInterrupt(const ExtInterrupt&) = delete;
+            ExtInterrupt& operator=(const ExtInterrupt&) = delete;
+
+            void measure(const ExtInterruptEvent& event); //updates the peak rates of the sources in an event
+
+            ExtInterruptEvent _queue[CLB_EXT_INTERRUPT_QUEUE_SIZE];
+            volatile uint8_t _head = 0; //written by the ISRs only
+            volatile uint8_t _tail = 0; //written by the main loop only
+            volatile uint16_t _dropped = 0;
+            void (*_callbacks[CLB_EXT_INTERRUPT_SOURCES])(void* context, bool level, uint32_t time);
+            void* _contexts[CLB_EXT_INTERRUPT_SOURCES];
+            uint32_t _seen = 0; //BIT0 << source once a source had an event
+            uint32_t _lastTime[CLB_EXT_INTERRUPT_SOURCES]; //time of the last event per source
+            uint32_t _shortest[CLB_EXT_INTERRUPT_SOURCES]; //shortest time between two events per source, 0 for none yet
+    };
+}
+
+#endif
@@ -0,0 +1,73 @@
+#include "clbExtInterrupt.h"
+
+static clb::ExtInterrupt* s_ext_interrupt_int = nullptr;
+
+//only enabled by attach(), so the pointer is always set here. INT0..3 are PD0..3 and INT4..7 PE4..7, INTn is bit n of its port
+ISR(INT0_vect) {
+    s_ext_interrupt_int->onEdge(0, BIT0, (PIND >> PD0) & BIT0);
+}
+
+ISR(INT1_vect) {
+    s_ext_interrupt_int->onEdge(1, BIT0, (PIND >> PD1) & BIT0);
+}
+
+ISR(INT2_vect) {
+    s_ext_interrupt_int->onEdge(2, BIT0, (PIND >> PD2) & BIT0);
+}
+
+ISR(INT3_vect) {
+    s_ext_interrupt_int->onEdge(3, BIT0, (PIND >> PD3) & BIT0);
+}
+
+ISR(INT4_vect) {
+    s_ext_interrupt_int->onEdge(4, BIT0, (PINE >> PE4) & BIT0);
+}
+
+ISR(INT5_vect) {
+    s_ext_interrupt_int->onEdge(5, BIT0, (PINE >> PE5) & BIT0);
+}
+
+ISR(INT6_vect) {
+    s_ext_interrupt_int->onEdge(6, BIT0, (PINE >> PE6) & BIT0);
+}
+
+ISR(INT7_vect) {
+    s_ext_interrupt_int->onEdge(7, BIT0, (PINE >> PE7) & BIT0);
+}
+
+bool clb::ExtInterrupt::attach(uint8_t interrupt, clb::TExtEdge edge, void (*callback)(void* context, bool level, uint32_t time),
+                               void* context) {
+    if (interrupt > 7 || callback == nullptr) {
+        CRITICAL("ExtInterrupt::attach() needs INT0..7 and a callback");
+        return false;
+    }
+#ifdef CLB_ENABLE_EXT_INTERRUPT_CYCLES
+    clb::CycleClock::begin();
+#endif
+
+    CLB_CRITICAL_SECTION();
+
+    s_ext_interrupt_int = this;
+    _callbacks[interrupt] = callback;
+    _contexts[interrupt] = context;
+
+    uint8_t _bit = BIT0 << interrupt;
+    EIMSK &= ~_bit;
+    //ISCn1:0, two bits per interrupt, INT0..3 in EICRA and INT4..7 in EICRB
+    uint8_t _shift = 2 * (interrupt & 0b11);
+    volatile uint8_t& _eicr = (interrupt < 4) ? EICRA : EICRB;
+    _eicr = (_eicr & ~(0b11 << _shift)) | (static_cast<uint8_t>(edge) << _shift);
+    EIFR = _bit; //changing the sense control can set the flag
+    EIMSK |= _bit;
+    return true;
+}
+
+void clb::ExtInterrupt::detach(uint8_t interrupt) {
+    if (interrupt > 7) {
+        CRITICAL("ExtInterrupt::detach() needs INT0..7");
+        return;
+    }
+    CLB_CRITICAL_SECTION();
+    EIMSK &= ~(BIT0 << interrupt);
+    _callbacks[interrupt] = nullptr; //events still in the queue are skipped
+}
@@ -0,0 +1,85 @@
+#include "clbExtInterrupt.h"
+
+static clb::ExtInterrupt* s_ext_interrupt_pcint = nullptr;
+static uint8_t s_pin_change_levels[3] = {0, 0, 0}; //port levels of every bank at its last interrupt
+
+//levels of a bank in PCINT bit order, bank 1 is PE0 for PCINT8 and PJ0..6 for PCINT9..15
+static inline __attribute__((always_inline)) uint8_t pinChangeLevels(uint8_t bank) {
+    switch (bank) {
+        case 0: return PINB;
+        case 1: return (PINE & BIT0) | (PINJ << 1);
+        default: return PINK;
+    }
+}
+
+//queues the pins of the bank that changed and are enabled, a pin that toggled twice since the last interrupt looks unchanged
+static inline __attribute__((always_inline)) void onPinChange(uint8_t bank, uint8_t levels, uint8_t mask) {
+    uint8_t _changed = (levels ^ s_pin_change_levels[bank]) & mask;
+    s_pin_change_levels[bank] = levels;
+    if (_changed) {
+        s_ext_interrupt_pcint->onEdge(CLB_EXT_INTERRUPT_BANK + bank, _changed, levels);
+    }
+}
+
+//only enabled by attachPinChange(), so the pointer is always set here
+ISR(PCINT0_vect) {
+    onPinChange(0, pinChangeLevels(0), PCMSK0);
+}
+
+ISR(PCINT1_vect) {
+    onPinChange(1, pinChangeLevels(1), PCMSK1);
+}
+
+ISR(PCINT2_vect) {
+    onPinChange(2, pinChangeLevels(2), PCMSK2);
+}
+
+static volatile uint8_t& pinChangeMask(uint8_t bank) {
+    switch (bank) {
+        case 0: return PCMSK0;
+        case 1: return PCMSK1;
+        default: return PCMSK2;
+    }
+}
+
+bool clb::ExtInterrupt::attachPinChange(uint8_t pcint, void (*callback)(void* context, bool level, uint32_t time), void* context) {
+    if (pcint > 23 || callback == nullptr) {
+        CRITICAL("ExtInterrupt::attachPinChange() needs PCINT0..23 and a callback");
+        return false;
+    }
+#ifdef CLB_ENABLE_EXT_INTERRUPT_CYCLES
+    clb::CycleClock::begin();
+#endif
+    uint8_t _bank = pcint >> 3;
+
+    CLB_CRITICAL_SECTION();
+
+    s_ext_interrupt_pcint = this;
+    _callbacks[CLB_EXT_INTERRUPT_BANK + pcint] = callback;
+    _contexts[CLB_EXT_INTERRUPT_BANK + pcint] = context;
+
+    //the reference levels are taken now, the first change of the new pin is an edge from here
+    s_pin_change_levels[_bank] = pinChangeLevels(_bank);
+    pinChangeMask(_bank) |= BIT0 << (pcint & 0b111);
+    if (!(PCICR & (BIT0 << _bank))) {
+        PCIFR = BIT0 << _bank; //a stale flag from before would run the ISR with nothing changed
+        PCICR |= BIT0 << _bank;
+    }
+    return true;
+}
+
+void clb::ExtInterrupt::detachPinChange(uint8_t pcint) {
+    if (pcint > 23) {
+        CRITICAL("ExtInterrupt::detachPinChange() needs PCINT0..23");
+        return;
+    }
+    uint8_t _bank = pcint >> 3;
+
+    CLB_CRITICAL_SECTION();
+    volatile uint8_t& _mask = pinChangeMask(_bank);
+    _mask &= ~(BIT0 << (pcint & 0b111));
+    if (_mask == 0) {
+        PCICR &= ~(BIT0 << _bank);
+    }
+    _callbacks[CLB_EXT_INTERRUPT_BANK + pcint] = nullptr; //events still in the queue are skipped
+}
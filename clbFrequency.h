@@ -0,0 +1,92 @@
+#ifndef CLBFREQUENCY_H
+#define CLBFREQUENCY_H
+
+#include <stdint.h>
+
+/* FREQUENCY SYNTHESIS
+ *
+ * Works out the prescaler, waveform mode and TOP value that put a square wave closest to a requested frequency on a
+ * compare output pin. Two ways to make one period:
+ *
+ *   fast PWM, TOP in ICRn/OCRnA, OCRnx at half of it      f = F_CPU / (N * (TOP + 1))
+ *   CTC, TOP in ICRn/OCRnA, the pin toggling on the match  f = F_CPU / (2 * N * (TOP + 1))
+ *
+ * Fast PWM has twice the resolution, toggling reaches half the lowest frequency. Every prescaler N of the timer is tried
+ * with both (where the channel can use them) and the TOP with the smallest error wins, ties go to the smaller prescaler.
+ *
+ * The search is constexpr, so with a constant frequency the whole plan is computed by the compiler:
+ *
+ *     constexpr clb::FrequencyPlan s_plan = clb::Timer1::planFrequency(38000.0f, clb::TOutputChannel::A);
+ *     clb::Timer1::instance().setFrequency(s_plan, clb::TOutputChannel::A); //just the register writes
+ *
+ * setFrequency(hz, channel) runs the same search at runtime (float math, a few hundred microseconds).
+ */
+
+namespace clb {
+    //timer setting for one output frequency, hz and error report what it actually produces
+    struct FrequencyPlan {
+        uint8_t timer; //timer number the plan was made for
+        uint8_t clock; //CSn2:0 bits, 0 if the frequency cant be made (hz <= 0)
+        uint16_t top; //value for the TOP register
+        bool toggle; //CTC with the pin toggling instead of fast PWM
+        float hz; //frequency the setting produces
+        float error; //hz minus the requested frequency
+    };
+
+    namespace frequency {
+        //prescalers in CSn2:0 order, Timer2 has its own set
+        constexpr uint16_t prescaler(bool timer2, uint8_t index) {
+            return timer2 ? (index == 0 ? 1 : index == 1 ? 8 : index == 2 ? 32 : index == 3 ? 64 : index == 4 ? 128 :
+                             index == 5 ? 256 : 1024)
+                          : (index == 0 ? 1 : index == 1 ? 8 : index == 2 ? 64 : index == 3 ? 256 : 1024);
+        }
+
+        constexpr uint8_t prescalerCount(bool timer2) { return timer2 ? 7 : 5; }
+
+        constexpr float absolute(float value) { return (value < 0) ? -value : value; }
+
+        //counter periods (TOP + 1) closest to the wanted ones, within what the TOP register can hold
+        constexpr uint32_t counts(float wanted, uint32_t maxCounts) {
+            return (wanted < 2.0f) ? 2 : (wanted >= maxCounts - 0.5f) ? maxCounts : (uint32_t)(wanted + 0.5f);
+        }
+
+        constexpr float produced(uint16_t divider, bool toggle, uint32_t periods) {
+            return (float)F_CPU / ((toggle ? 2.0f : 1.0f) * divider * periods);
+        }
+
+        constexpr FrequencyPlan make(uint8_t timer, uint8_t index, bool timer2, bool toggle, uint32_t periods, float hz) {
+            return FrequencyPlan{ timer, (uint8_t)(index + 1), (uint16_t)(periods - 1), toggle,
+                                  produced(prescaler(timer2, index), toggle, periods),
+                                  produced(prescaler(timer2, index), toggle, periods) - hz };
+        }
+
+        constexpr FrequencyPlan candidate(uint8_t timer, uint8_t index, bool timer2, bool toggle, uint32_t maxCounts, float hz) {
+            return make(timer, index, timer2, toggle,
+                        counts((float)F_CPU / ((toggle ? 2.0f : 1.0f) * prescaler(timer2, index) * hz), maxCounts), hz);
+        }
+
+        constexpr FrequencyPlan better(const FrequencyPlan& best, const FrequencyPlan& next) {
+            return (best.clock == 0 || absolute(next.error) < absolute(best.error)) ? next : best;
+        }
+
+        //best plan over the prescalers from index on, for one way of making the period
+        constexpr FrequencyPlan search(uint8_t timer, bool timer2, bool toggle, uint32_t maxCounts, float hz, uint8_t index,
+                                       const FrequencyPlan& best) {
+            return (index == prescalerCount(timer2)) ? best
+                 : search(timer, timer2, toggle, maxCounts, hz, index + 1,
+                          better(best, candidate(timer, index, timer2, toggle, maxCounts, hz)));
+        }
+
+        constexpr FrequencyPlan none(uint8_t timer) { return FrequencyPlan{ timer, 0, 0, false, 0.0f, 0.0f }; }
+
+        //pwm and toggle are the ways the channel can make the period, maxCounts is the largest TOP + 1
+        constexpr FrequencyPlan plan(uint8_t timer, bool pwm, bool toggle, uint32_t maxCounts, float hz) {
+            return (hz <= 0.0f) ? none(timer)
+                 : toggle ? search(timer, timer == 2, true, maxCounts, hz, 0,
+                                   pwm ? search(timer, timer == 2, false, maxCounts, hz, 0, none(timer)) : none(timer))
+                 : search(timer, timer == 2, false, maxCounts, hz, 0, none(timer));
+        }
+    }
+}
+
+#endif
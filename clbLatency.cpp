@@ -0,0 +1,106 @@
+#include "clbLatency.h"
+
+#ifdef CLB_ENABLE_ISR_LATENCY
+
+static struct LatencyRecord {
+    uint32_t count;
+    uint32_t sum;
+    uint16_t min;
+    uint16_t max;
+    uint16_t histogram[CLB_LATENCY_BUCKETS];
+} s_latency[static_cast<uint8_t>(clb::TVector::COUNT)];
+
+static void clearRecord(LatencyRecord& record) {
+    record.count = 0;
+    record.sum = 0;
+    record.min = 0xFFFF;
+    record.max = 0;
+    for (uint8_t i = 0; i < CLB_LATENCY_BUCKETS; i++) {
+        record.histogram[i] = 0;
+    }
+}
+
+//runs inside the ISR with interrupts already off
+void clb::Latency::record(clb::TVector vector, uint16_t tcnt, uint16_t ocr, uint16_t top) {
+    uint16_t _latency;
+    if (tcnt >= ocr) {
+        _latency = tcnt - ocr;
+    }
+    else {
+        _latency = tcnt + (top - ocr) + 1; //counter wrapped at TOP after the match
+    }
+
+    LatencyRecord& _record = s_latency[static_cast<uint8_t>(vector)];
+
+    if (_record.count == 0) {
+        _record.min = 0xFFFF; //static storage starts zeroed, reset() only runs on request
+    }
+    _record.count++;
+    _record.sum += _latency;
+    if (_latency < _record.min) {
+        _record.min = _latency;
+    }
+    if (_latency > _record.max) {
+        _record.max = _latency;
+    }
+
+    uint16_t _bucket = _latency >> CLB_LATENCY_BUCKET_SHIFT;
+    if (_bucket >= CLB_LATENCY_BUCKETS) {
+        _bucket = CLB_LATENCY_BUCKETS - 1;
+    }
+    if (_record.histogram[_bucket] != 0xFFFF) {
+        _record.histogram[_bucket]++;
+    }
+}
+
+bool clb::Latency::getStats(clb::TVector vector, clb::LatencyStats& stats) {
+    if (vector >= clb::TVector::COUNT) {
+        CRITICAL("Invalid vector for Latency::getStats()");
+        return false;
+    }
+
+    uint8_t _sreg = SREG;
+    cli();
+
+    const LatencyRecord& _record = s_latency[static_cast<uint8_t>(vector)];
+    stats.count = _record.count;
+    stats.min = (_record.count == 0) ? 0 : _record.min;
+    stats.max = _record.max;
+    stats.mean = (_record.count == 0) ? 0 : _record.sum / _record.count;
+    for (uint8_t i = 0; i < CLB_LATENCY_BUCKETS; i++) {
+        stats.histogram[i] = _record.histogram[i];
+    }
+
+    SREG = _sreg;
+    return true;
+}
+
+void clb::Latency::reset(clb::TVector vector) {
+    if (vector >= clb::TVector::COUNT) {
+        CRITICAL("Invalid vector for Latency::reset()");
+        return;
+    }
+
+    uint8_t _sreg = SREG;
+    cli();
+    clearRecord(s_latency[static_cast<uint8_t>(vector)]);
+    SREG = _sreg;
+}
+
+void clb::Latency::resetAll() {
+    for (uint8_t i = 0; i < static_cast<uint8_t>(clb::TVector::COUNT); i++) {
+        reset(static_cast<clb::TVector>(i));
+    }
+}
+
+bool clb::Latency::isEnabled() { return true; }
+
+#else
+
+void clb::Latency::record(clb::TVector vector, uint16_t tcnt, uint16_t ocr, uint16_t top) { }
+bool clb::Latency::getStats(clb::TVector vector, clb::LatencyStats& stats) { return false; }
+void clb::Latency::reset(clb::TVector vector) { }
+void clb::Latency::resetAll() { }
+bool clb::Latency::isEnabled() { return false; }
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef CLBLATENCY_H
+#define CLBLATENCY_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+
+/* ISR LATENCY INSTRUMENTATION
+ *
+ * When CLB_ENABLE_ISR_LATENCY is defined (see clbConfig.h) every Timer0/1/2 compare match and overflow ISR samples TCNTn as its first statement
+ * and records how many timer ticks passed since the hardware event (TCNTn - OCRnx, wrapped at TOP, or TCNTn for overflows).
+ * The sample is taken after the compiler generated register pushes, so it shows how late the ISR body and the user callback really start.
+ * Latency is only meaningful in up counting modes (normal, CTC, fast PWM), phase correct modes count down after TOP and give garbage.
+ *
+ * When the define is off CLB_LATENCY_RECORD expands to nothing and the getters return false.
+ */
+
+#ifndef CLB_LATENCY_BUCKETS
+#define CLB_LATENCY_BUCKETS 8 //histogram buckets per vector, the last bucket also collects everything that doesnt fit
+#endif
+#ifndef CLB_LATENCY_BUCKET_SHIFT
+#define CLB_LATENCY_BUCKET_SHIFT 0 //each bucket is (1 << shift) timer ticks wide
+#endif
+
+#ifdef CLB_ENABLE_ISR_LATENCY
+#define CLB_LATENCY_RECORD(vector, tcnt, ocr, top) do { uint16_t _clbTcnt = (tcnt); clb::Latency::record(vector, _clbTcnt, ocr, top); } while (0) //TCNT is read before anything else
+#else
+#define CLB_LATENCY_RECORD(vector, tcnt, ocr, top)
+#endif
+
+namespace clb {
+    //latency statistics for one interrupt vector, all values in timer ticks
+    struct LatencyStats {
+        uint32_t count; //number of recorded entries
+        uint16_t min; //smallest latency seen
+        uint16_t max; //largest latency seen
+        uint16_t mean; //sum / count, rounded down
+        uint16_t histogram[CLB_LATENCY_BUCKETS]; //entry counts per bucket, saturate at 0xFFFF
+    };
+
+    class Latency {
+        public:
+            static void record(TVector vector, uint16_t tcnt, uint16_t ocr, uint16_t top); //called on ISR entry by the timer classes, not meant for user code
+            static bool getStats(TVector vector, LatencyStats& stats); //copies the stats of one vector, returns false if instrumentation is compiled out
+            static void reset(TVector vector); //clears the stats of one vector
+            static void resetAll(); //clears the stats of every vector
+            static bool isEnabled(); //returns true if CLB_ENABLE_ISR_LATENCY was defined when the library was built
+    };
+}
+
+#endif
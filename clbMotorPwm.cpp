@@ -0,0 +1,249 @@
+#include "clbMotorPwm.h"
+#include "clbResource.h"
+#include "clbPreciseDelay.h"
+
+#include <avr/pgmspace.h>
+
+CLB_CLAIM_TIMER(1);
+CLB_CLAIM_TIMER(3);
+CLB_CLAIM_TIMER(4);
+
+static const uint16_t s_motor_prescalers[5] PROGMEM = {1, 8, 64, 256, 1024}; //CSn2:0 = index + 1
+
+//registers of one phase, the bit positions are the same on timers 1, 3 and 4
+static const struct MotorPhaseRegisters {
+    volatile uint8_t* tccra;
+    volatile uint8_t* tccrb;
+    volatile uint8_t* tccrc;
+    volatile uint16_t* tcnt;
+    volatile uint16_t* icr;
+    volatile uint16_t* ocra;
+    volatile uint16_t* ocrb;
+    volatile uint8_t* timsk;
+    volatile uint8_t* tifr;
+    volatile uint8_t* port;
+    volatile uint8_t* ddr;
+    uint8_t pinBitA; //OCnB is the next bit of the same port
+} s_motor_phases[3] = {
+    { &TCCR1A, &TCCR1B, &TCCR1C, &TCNT1, &ICR1, &OCR1A, &OCR1B, &TIMSK1, &TIFR1, &PORTB, &DDRB, PB5 },
+    { &TCCR3A, &TCCR3B, &TCCR3C, &TCNT3, &ICR3, &OCR3A, &OCR3B, &TIMSK3, &TIFR3, &PORTE, &DDRE, PE3 },
+    { &TCCR4A, &TCCR4B, &TCCR4C, &TCNT4, &ICR4, &OCR4A, &OCR4B, &TIMSK4, &TIFR4, &PORTH, &DDRH, PH3 },
+};
+
+static struct MotorPwmState {
+    uint8_t clock = 0; //CSn2:0 bits while running
+    uint16_t top = 0;
+    bool complementary = false;
+    uint16_t pendingOcr[3] = {0, 0, 0}; //compare values waiting for the overflow ISR of their phase
+    volatile uint8_t pending = 0; //BIT0 << phase for every value waiting
+    uint16_t overwrites = 0;
+} s_motor_pwm;
+
+//writes the pending compare value of a phase right after BOTTOM, the timer latches it at the next one
+static inline __attribute__((always_inline)) void commitPhase(uint8_t phase, volatile uint16_t& ocra, volatile uint16_t& ocrb,
+                                                              volatile uint8_t& timsk) {
+    uint16_t _value = s_motor_pwm.pendingOcr[phase];
+    ocra = _value;
+    ocrb = _value;
+    timsk &= ~(BIT0 << TOIE1); //TOIEn is bit 0 on all 16 bit timers
+    s_motor_pwm.pending &= ~(BIT0 << phase);
+}
+
+//only enabled while a duty update is pending
+ISR(TIMER1_OVF_vect) {
+    commitPhase(0, OCR1A, OCR1B, TIMSK1);
+}
+
+ISR(TIMER3_OVF_vect) {
+    commitPhase(1, OCR3A, OCR3B, TIMSK3);
+}
+
+ISR(TIMER4_OVF_vect) {
+    commitPhase(2, OCR4A, OCR4B, TIMSK4);
+}
+
+//smallest prescaler that fits TOP = F_CPU / (2 * N * f) in 16 bits
+static bool planMotorPwm(uint32_t frequency, uint8_t& clock, uint16_t& top) {
+    if (frequency == 0) {
+        return false;
+    }
+    for (uint8_t i = 0; i < 5; i++) {
+        uint64_t _divider = 2ULL * pgm_read_word(&s_motor_prescalers[i]) * frequency;
+        uint64_t _top = (((uint64_t)F_CPU << 16) + _divider / 2) / _divider;
+        if (_top <= 0xFFFFUL) {
+            if (_top < 255) {
+                return false;
+            }
+            clock = i + 1;
+            top = (uint16_t)_top;
+            return true;
+        }
+    }
+    return false;
+}
+
+//OCRnx = TOP is a steady high and 0 a steady low in this mode, so the duty maps straight onto 0..TOP
+static uint16_t motorCompareValue(uint32_t duty, uint16_t top) {
+    if (duty >= 0x10000UL) {
+        return top;
+    }
+    return (uint16_t)((duty * top + 0x8000UL) >> 16);
+}
+
+//hands a compare value to the overflow ISR of the phase, interrupts must be off
+static void queuePhase(uint8_t phase, uint16_t value) {
+    const MotorPhaseRegisters& _registers = s_motor_phases[phase];
+    uint8_t _bit = BIT0 << phase;
+    if (s_motor_pwm.pending & _bit) {
+        if (s_motor_pwm.overwrites != 0xFFFF) {
+            s_motor_pwm.overwrites++;
+        }
+    }
+    else {
+        *_registers.tifr = (BIT0 << TOV1); //a stale flag would run the ISR at once, in the middle of a period
+        *_registers.timsk |= (BIT0 << TOIE1);
+    }
+    s_motor_pwm.pendingOcr[phase] = value;
+    s_motor_pwm.pending |= _bit;
+}
+
+bool clb::MotorPwm::begin(uint32_t frequency, uint32_t phaseV, uint32_t phaseW, bool complementary) {
+    uint8_t _clock;
+    uint16_t _top;
+    if (!planMotorPwm(frequency, _clock, _top)) {
+        CRITICAL("MotorPwm::begin() frequency out of range, TOP would be below 255 or above 65535 with DIV_1024");
+        return false;
+    }
+    if (phaseV > 0x10000UL || phaseW > 0x10000UL) {
+        CRITICAL("MotorPwm::begin() phases are fractions of a period, 0 to 0x10000");
+        return false;
+    }
+    uint32_t _period = 2UL * _top;
+    uint32_t _lags[3] = {0, (uint32_t)(((uint64_t)phaseV * _period) >> 16), (uint32_t)(((uint64_t)phaseW * _period) >> 16)};
+
+    CLB_CRITICAL_SECTION();
+
+    PRR0 &= ~(BIT0 << PRTIM1);
+    PRR1 &= ~((BIT0 << PRTIM3) | (BIT0 << PRTIM4));
+
+    for (uint8_t i = 0; i < 3; i++) {
+        const MotorPhaseRegisters& _registers = s_motor_phases[i];
+        *_registers.tccrb = 0;
+        *_registers.timsk = 0;
+
+        //output latches for duty 0: OCnA low, OCnB high. FOCnx only works in a non PWM mode, so they are forced first
+        *_registers.tccra = (BIT0 << COM1A1) | (BIT0 << COM1B1) | (BIT0 << COM1B0);
+        *_registers.tccrc = (BIT0 << FOC1A) | (BIT0 << FOC1B);
+        *_registers.tccra = 0; //WGMn1:0 = 0 for TOP in ICRn, outputs disconnected while the direction is set
+        *_registers.icr = _top;
+        *_registers.ocra = 0;
+        *_registers.ocrb = 0;
+
+        //a phase lagging U by lag ticks is where U was lag ticks before BOTTOM: counting down at lag while lag < TOP,
+        //counting up at 2 * TOP - lag after that
+        uint32_t _lag = _lags[i];
+        if (_clock == 1) {
+            _lag += _period - 2 * i; //started 2 * i cycles after U
+        }
+        _lag %= _period;
+        bool _down = (_lag != 0 && _lag < _top);
+        uint16_t _count = (_lag == 0) ? 0 : _down ? (uint16_t)_lag : (uint16_t)(_period - _lag);
+
+        //turns the counter the right way with a few ticks at DIV_1, far from both ends of the slope
+        *_registers.tcnt = _down ? _top - 4 : 4;
+        *_registers.tccrb = (BIT0 << WGM13) | (BIT0 << CS10);
+        CLB_DELAY_CYCLES(8);
+        *_registers.tccrb = (BIT0 << WGM13);
+        *_registers.tcnt = _count;
+        *_registers.tifr = 0xFF; //writing a 1 clears a flag, the unused bits ignore it
+
+        uint8_t _pinMask = BIT0 << _registers.pinBitA;
+        uint8_t _tccra = (BIT0 << COM1A1); //cleared on the match counting up, set on the match counting down
+        if (complementary) {
+            _pinMask |= BIT0 << (_registers.pinBitA + 1);
+            _tccra |= (BIT0 << COM1B1) | (BIT0 << COM1B0); //the inverse
+        }
+        *_registers.port &= ~_pinMask;
+        *_registers.tccra = _tccra;
+        *_registers.ddr |= _pinMask;
+    }
+
+    s_motor_pwm.clock = _clock;
+    s_motor_pwm.top = _top;
+    s_motor_pwm.complementary = complementary;
+    s_motor_pwm.pending = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        s_motor_pwm.pendingOcr[i] = 0;
+    }
+
+    //the same value into the three TCCRnB 2 cycles apart, made up for above when DIV_1 runs past TSM
+    uint8_t _tccrb = (BIT0 << WGM13) | _clock;
+    uint8_t _gtccr = GTCCR; //a hold the caller already has on the prescalers stays in place
+    GTCCR = _gtccr | (BIT0 << TSM) | (BIT0 << PSRSYNC);
+    asm volatile(
+        "sts %[tccr1b], %[value]    \n\t"
+        "sts %[tccr3b], %[value]    \n\t"
+        "sts %[tccr4b], %[value]    \n\t"
+        :
+        : [tccr1b] "n" (_SFR_MEM_ADDR(TCCR1B)), [tccr3b] "n" (_SFR_MEM_ADDR(TCCR3B)), [tccr4b] "n" (_SFR_MEM_ADDR(TCCR4B)),
+          [value] "r" (_tccrb)
+    );
+    GTCCR = _gtccr;
+    return true;
+}
+
+void clb::MotorPwm::end() {
+    CLB_CRITICAL_SECTION();
+
+    for (uint8_t i = 0; i < 3; i++) {
+        const MotorPhaseRegisters& _registers = s_motor_phases[i];
+        *_registers.timsk = 0;
+        *_registers.tccrb = 0;
+        *_registers.tccra = 0;
+        *_registers.port &= ~(0b11 << _registers.pinBitA);
+    }
+    s_motor_pwm.clock = 0;
+    s_motor_pwm.pending = 0;
+}
+
+void clb::MotorPwm::setDuty(clb::TPhase phase, uint32_t duty) {
+    uint16_t _value = motorCompareValue(duty, s_motor_pwm.top);
+
+    CLB_CRITICAL_SECTION();
+    queuePhase(static_cast<uint8_t>(phase), _value);
+}
+
+void clb::MotorPwm::setDuties(uint32_t dutyU, uint32_t dutyV, uint32_t dutyW) {
+    uint16_t _top = s_motor_pwm.top;
+    uint16_t _valueU = motorCompareValue(dutyU, _top);
+    uint16_t _valueV = motorCompareValue(dutyV, _top);
+    uint16_t _valueW = motorCompareValue(dutyW, _top);
+
+    CLB_CRITICAL_SECTION();
+    queuePhase(0, _valueU);
+    queuePhase(1, _valueV);
+    queuePhase(2, _valueW);
+}
+
+uint32_t clb::MotorPwm::frequency() {
+    if (s_motor_pwm.clock == 0) {
+        return 0;
+    }
+    uint64_t _divider = 2ULL * pgm_read_word(&s_motor_prescalers[s_motor_pwm.clock - 1]) * s_motor_pwm.top;
+    return (uint32_t)((((uint64_t)F_CPU << 16) + _divider / 2) / _divider);
+}
+
+uint16_t clb::MotorPwm::top() { return s_motor_pwm.top; }
+
+uint32_t clb::MotorPwm::maxUpdateRate() { return frequency() >> 16; }
+
+uint16_t clb::MotorPwm::overwrites() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _overwrites = s_motor_pwm.overwrites;
+    return _overwrites;
+}
+
+void clb::MotorPwm::resetOverwrites() {
+    CLB_CRITICAL_SECTION();
+    s_motor_pwm.overwrites = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef CLBMOTORPWM_H
+#define CLBMOTORPWM_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+#include "clbCriticalSection.h"
+
+/* THREE PHASE MOTOR PWM
+ *
+ * Runs Timer1, Timer3 and Timer4 as the three phases U, V and W of an inverter or BLDC stage, in phase and frequency correct
+ * PWM with TOP in ICRn (TMode16::PWM_PHASE_FREQUENCY_CORRECT_ICR). The pulses are centered on BOTTOM, the period is 2 * TOP
+ * ticks, and every phase runs with a fixed lag behind U:
+ *
+ *     clb::MotorPwm::begin(CLB_Q16(20000), CLB_Q16(1.0 / 3), CLB_Q16(2.0 / 3), true); //20 kHz, 120 and 240 degrees, six outputs
+ *     clb::MotorPwm::setDuties(_dutyU, _dutyV, _dutyW); //16.16 fractions from the control loop
+ *
+ *   phase U  Timer1  OC1A pin 11 (high side), OC1B pin 12 (low side)
+ *   phase V  Timer3  OC3A pin 5,              OC3B pin 2
+ *   phase W  Timer4  OC4A pin 6,              OC4B pin 7
+ *
+ * With complementary set OCnB drives the inverse of OCnA for the low side switch, without dead time (see clbComplementaryPwm.h
+ * for bridges that need it). Otherwise only the three OCnA pins are used.
+ *
+ * Phase lags: begin() preloads every TCNTn with the count and the count direction the phase has at its lag, with the three
+ * timers held by GTCCR TSM, and starts them together. The direction of a dual slope counter cant be written, so each timer
+ * is run for a few cycles at DIV_1 first, from just below TOP to count down or just above BOTTOM to count up, with the outputs
+ * disconnected. DIV_1 bypasses the prescaler so TSM doesnt hold it, the three starts are then 2 cycles apart and the
+ * preloads of V and W make up for it. Either way the lags are exact to the tick. While TSM is set Timer0 stops for a few
+ * cycles too.
+ *
+ * Duty updates are committed at BOTTOM: setDuty() and setDuties() queue the compare value and enable the overflow ISR of
+ * the phase, which writes OCRnA and OCRnB right after the next BOTTOM. The timer latches both at the BOTTOM after that, so
+ * the high and low side of a phase always switch to a new duty on the same period. A phase takes at most one update per
+ * PWM period, maxUpdateRate() returns that rate in Hz. Updates faster than that replace the one still pending and are
+ * counted by overwrites(), a field oriented control loop should run at or below maxUpdateRate(). Each commit is one short
+ * ISR (roughly 40 cycles with the register saves), at 20 kHz with an update every period the three phases take about 15%
+ * of the cpu at 16 MHz.
+ *
+ * The module takes over Timer1, Timer3 and Timer4 (claimed with CLB_CLAIM_TIMER, see clbResource.h), so it cant be used
+ * together with any other module or timer class on them.
+ */
+
+namespace clb {
+    //phase of the motor PWM, the timer driving it in brackets
+    enum class TPhase : uint8_t {
+        U = 0, //Timer1
+        V = 1, //Timer3
+        W = 2 //Timer4
+    };
+
+    class MotorPwm {
+        public:
+            //powers up and starts the three timers at frequency (16.16 Hz) with all duties 0, V and W lag U by phaseV and phaseW
+            //(16.16 fractions of a period). Returns false if the frequency or a phase is out of range
+            static bool begin(uint32_t frequency, uint32_t phaseV, uint32_t phaseW, bool complementary);
+            static void end(); //stops the timers and drives all outputs low, both switches of every phase off
+
+            static void setDuty(TPhase phase, uint32_t duty); //duty as 16.16 fraction, 0 to 0x10000, committed at the next BOTTOM of the phase
+            static void setDuties(uint32_t dutyU, uint32_t dutyV, uint32_t dutyW); //all three in one interrupt lock
+
+            static uint32_t frequency(); //frequency the timers actually run at, 16.16 Hz
+            static uint16_t top(); //current TOP, the duty resolution is TOP steps
+            static uint32_t maxUpdateRate(); //duty updates per second every phase can commit, the PWM frequency
+            static uint16_t overwrites(); //updates that replaced one still pending, saturates at 0xFFFF
+            static void resetOverwrites();
+    };
+}
+
+#endif
@@ -0,0 +1,163 @@
+#include "clbOneShot.h"
+
+#include <avr/pgmspace.h>
+
+static const uint16_t s_one_shot_prescalers[5] PROGMEM = {1, 8, 64, 256, 1024}; //CSn2:0 = index + 1
+static const uint16_t s_one_shot_check_cycles = 48; //upper bound from the first TCNTn read in onCapture() to the one in advanceCounter()
+
+//ns in ticks of the prescaler, rounded to the nearest
+static uint32_t oneShotTicks(uint32_t ns, uint16_t prescaler) {
+    uint64_t _tick = 1000000000ULL * prescaler; //one tick in ns, times F_CPU
+    return (uint32_t)(((uint64_t)ns * F_CPU + _tick / 2) / _tick);
+}
+
+clb::OneShot::OneShot(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint8_t* tccrc, volatile uint16_t* tcnt,
+                      volatile uint16_t* icr, volatile uint16_t* ocra, volatile uint16_t* ocrb, volatile uint8_t* timsk,
+                      volatile uint8_t* tifr, volatile uint8_t* prr, uint8_t prrBit, volatile uint8_t* port, volatile uint8_t* ddr,
+                      uint8_t pinBit, volatile uint8_t* icpPort, volatile uint8_t* icpDdr, uint8_t icpBit)
+    : _tccra(tccra), _tccrb(tccrb), _tccrc(tccrc), _tcnt(tcnt), _icr(icr), _ocra(ocra), _ocrbRegister(ocrb), _timsk(timsk),
+      _tifr(tifr), _prr(prr), _prrBit(prrBit), _port(port), _ddr(ddr), _pinMask(BIT0 << pinBit), _icpPort(icpPort),
+      _icpDdr(icpDdr), _icpMask(BIT0 << icpBit) { }
+
+bool clb::OneShot::plan(uint32_t widthNs, uint32_t delayNs, bool capture) {
+    //smallest prescaler the pulse fits with, for the finest edges
+    for (uint8_t i = 0; i < 5; i++) {
+        uint16_t _prescaler = pgm_read_word(&s_one_shot_prescalers[i]);
+        uint32_t _width = oneShotTicks(widthNs, _prescaler);
+        if (_width == 0) {
+            return false;
+        }
+        if (!capture) {
+            //fire() writes OCRnB - CLB_ONE_SHOT_FIRE_DELAY, which has to stay above BOTTOM to tell a running pulse apart
+            if (_width > 0x10000UL - CLB_ONE_SHOT_FIRE_DELAY - 1) {
+                continue;
+            }
+            _clock = i + 1;
+            _ocrb = (uint16_t)(0x10000UL - _width);
+            _idleTop = 0;
+            return true;
+        }
+        uint32_t _newDelay = oneShotTicks(delayNs, _prescaler);
+        uint16_t _newAdjust = (CLB_ONE_SHOT_ADJUST_CYCLES + _prescaler - 1) / _prescaler;
+        uint16_t _newLate = _newAdjust + (s_one_shot_check_cycles + _prescaler - 1) / _prescaler + CLB_ONE_SHOT_FIRE_DELAY;
+        if (_newDelay <= _newLate) {
+            return false; //a coarser tick only makes it worse
+        }
+        //the idle count runs 0..OCRnB - delay - 1, at least as long as the delay so an ISR within the delay sees no second wrap
+        if (_width + 2 * _newDelay + 1 > 0x10000UL) {
+            continue;
+        }
+        _clock = i + 1;
+        _ocrb = (uint16_t)(0x10000UL - _width);
+        _delay = (uint16_t)_newDelay;
+        _idleTop = _ocrb - _delay - 1;
+        _adjust = _newAdjust;
+        _late = _newLate;
+        return true;
+    }
+    return false;
+}
+
+void clb::OneShot::start(uint8_t tccrb) {
+    *_prr &= ~(BIT0 << _prrBit);
+
+    *_tccrb = 0;
+    *_timsk = 0;
+    //normal mode first: the compare registers take their values at once and FOCnB can force the latch low
+    *_tccra = (BIT0 << COM1B1);
+    *_tccrc = (BIT0 << FOC1B);
+    *_tcnt = 0;
+    *_ocra = _idleTop;
+    *_ocrbRegister = _ocrb;
+
+    *_port &= ~_pinMask;
+    //fast PWM with TOP in OCRnA, OCnB set on the match and cleared at BOTTOM. The bit positions are the same on all 16 bit timers
+    *_tccra = (BIT0 << COM1B1) | (BIT0 << COM1B0) | (BIT0 << WGM11) | (BIT0 << WGM10);
+    *_ddr |= _pinMask;
+
+    *_tccrb = (BIT0 << WGM13) | (BIT0 << WGM12) | tccrb | _clock;
+    *_tifr = 0xFF; //writing a 1 clears a flag, the unused bits ignore it. Also drops a capture from switching ICESn
+}
+
+bool clb::OneShot::begin(uint32_t widthNs) {
+    end(); //no capture ISR while the plan changes
+    if (!plan(widthNs, 0, false)) {
+        CRITICAL("OneShot::begin() width out of range, 1 tick at DIV_1 to 65533 ticks at DIV_1024");
+        return false;
+    }
+
+    CLB_CRITICAL_SECTION();
+    _triggers = 0;
+    _missed = 0;
+    start(0);
+    return true;
+}
+
+bool clb::OneShot::beginCapture(uint32_t widthNs, uint32_t delayNs, bool risingEdge, bool repeat) {
+    end();
+    if (!plan(widthNs, delayNs, true)) {
+        CRITICAL("OneShot::beginCapture() width or delay out of range, the delay has to cover the capture ISR");
+        return false;
+    }
+
+    CLB_CRITICAL_SECTION();
+    _repeat = repeat;
+    _triggers = 0;
+    _missed = 0;
+
+    *_icpDdr &= ~_icpMask;
+    *_icpPort &= ~_icpMask;
+    start(risingEdge ? (BIT0 << ICES1) : 0);
+    *_timsk = (BIT0 << ICIE1);
+    return true;
+}
+
+void clb::OneShot::end() {
+    CLB_CRITICAL_SECTION();
+
+    *_timsk = 0;
+    *_tccrb = 0;
+    *_tccra = 0;
+    *_port &= ~_pinMask;
+    _clock = 0;
+}
+
+bool clb::OneShot::fire() {
+    if (_clock == 0 || _idleTop != 0) {
+        CRITICAL("OneShot::fire() called before begin() or while waiting for captures");
+        return false;
+    }
+    CLB_CRITICAL_SECTION();
+    //the counter sits at BOTTOM between pulses, anything else is a pulse still running
+    if (*_tcnt != 0) {
+        return false;
+    }
+    *_tcnt = _ocrb - CLB_ONE_SHOT_FIRE_DELAY;
+    return true;
+}
+
+bool clb::OneShot::isBusy() {
+    CLB_CRITICAL_SECTION();
+    return *_tcnt > _idleTop;
+}
+
+uint32_t clb::OneShot::width() {
+    if (_clock == 0) {
+        return 0;
+    }
+    return (uint32_t)((0x10000ULL - _ocrb) * pgm_read_word(&s_one_shot_prescalers[_clock - 1]) * 1000000000ULL / F_CPU);
+}
+
+uint16_t clb::OneShot::widthTicks() { return (uint16_t)(0x10000UL - _ocrb); }
+
+uint16_t clb::OneShot::triggers() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _count = _triggers;
+    return _count;
+}
+
+uint16_t clb::OneShot::missed() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _count = _missed;
+    return _count;
+}
@@ -0,0 +1,155 @@
+#ifndef CLBONESHOT_H
+#define CLBONESHOT_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+#include "clbCriticalSection.h"
+
+/* HARDWARE ONE SHOT PULSES
+ *
+ * Makes single pulses of 1 tick up to 65535 ticks (62.5 ns to 268 ms at 16 MHz, depending on the prescaler) on OCnB of a
+ * 16 bit timer, with both edges made by the timer itself. The timer runs in fast PWM with TOP in OCRnA
+ * (TMode16::FAST_PWM_OCR_A) and OCnB in TCMOM::SET, set on the match with OCRnB and cleared at BOTTOM:
+ *
+ *   idle   OCRnA (TOP) = 0, the counter is stuck at BOTTOM and the pin low
+ *   fire   TCNTn is written above TOP, so the counter runs up to MAX and wraps to BOTTOM, where it is stuck again. On the
+ *          way it passes OCRnB = 0x10000 - width, which sets the pin, and BOTTOM clears it: exactly width ticks high
+ *
+ * After the TCNTn write nothing runs on the cpu, there is no ISR and no jitter on either edge.
+ *
+ *     clb::OneShot& _shot = clb::OneShot::timer4();
+ *     _shot.begin(2500); //2.5 us pulses on OC4B, pin 7
+ *     _shot.fire(); //the pulse starts CLB_ONE_SHOT_FIRE_DELAY ticks after the write
+ *
+ * Input capture trigger: beginCapture() starts a pulse delayNs after an edge on ICPn. The counter then runs 0..TOP with TOP
+ * just below OCRnB, so it never reaches the pulse on its own and ICRn timestamps the edge. The capture ISR moves TCNTn
+ * forward in one read-add-write of constant length (CLB_ONE_SHOT_ADJUST_CYCLES), which puts OCRnB exactly delayNs after
+ * the captured edge, independent of when the ISR ran. The edges are exact to the cpu cycle at DIV_1 and to one tick with
+ * a prescaler. The ISR has to start before the delay is over, captures it reaches too late are skipped and counted by
+ * missed(). Edges during a pulse are ignored. With repeat every later edge fires again, otherwise only the first one.
+ *
+ *   Timer1  OC1B pin 12, ICP1 PD4 (not on a header)    Timer4  OC4B pin 7,  ICP4 PL0 pin 49
+ *   Timer3  OC3B pin 2,  ICP3 PE7 (not on a header)    Timer5  OC5B pin 45, ICP5 PL1 pin 48
+ *
+ * Each one shot takes over its whole timer (claimed with CLB_CLAIM_TIMER, see clbResource.h).
+ */
+
+#define CLB_ONE_SHOT_FIRE_DELAY 2 //ticks from the TCNTn write in fire() to the rising edge, a TCNTn write blocks the match on the next tick
+#define CLB_ONE_SHOT_ADJUST_CYCLES 17 //cpu cycles from reading TCNTn to writing it back in the capture ISR, counted from the instruction timings
+
+namespace clb {
+    class OneShot {
+        public:
+            static OneShot& timer1(); //OC1B pin 12, ICP1 PD4
+            static OneShot& timer3(); //OC3B pin 2, ICP3 PE7
+            static OneShot& timer4(); //OC4B pin 7, ICP4 PL0 (pin 49 on the Mega)
+            static OneShot& timer5(); //OC5B pin 45, ICP5 PL1 (pin 48 on the Mega)
+
+            bool begin(uint32_t widthNs); //pulses of widthNs started by fire(), false if the width is out of range
+            //pulses of widthNs starting delayNs after an edge on ICPn, false if out of range. repeat keeps firing on every edge
+            bool beginCapture(uint32_t widthNs, uint32_t delayNs, bool risingEdge, bool repeat);
+            void end(); //stops the timer, the pin stays a low output
+
+            bool fire(); //starts a pulse, false if one is still running or the one shot waits for captures
+            bool isBusy(); //true while a pulse runs
+            uint32_t width(); //pulse width the timer actually makes, in ns
+            uint16_t widthTicks();
+            uint16_t triggers(); //pulses fired by captures, saturates at 0xFFFF
+            uint16_t missed(); //captures the ISR reached too late for the delay, saturates at 0xFFFF
+
+            //called from the input capture ISR, dont call it yourself
+            inline __attribute__((always_inline)) void onCapture() {
+                uint16_t _captured = *_icr;
+                uint16_t _now = *_tcnt;
+                if (_now > _idleTop) {
+                    return; //a pulse is running
+                }
+                uint16_t _elapsed = (_now >= _captured) ? _now - _captured : _now + (_idleTop + 1) - _captured;
+                if (_elapsed + _late >= _delay) {
+                    if (_missed != 0xFFFF) {
+                        _missed++;
+                    }
+                    return;
+                }
+                //TCNTn = read + (OCRnB - delay + adjust - captured), plus one idle period if the count wrapped since the capture
+                advanceCounter(_tcnt, _captured, _idleTop + 1, _ocrb - _delay + _adjust - _captured);
+                if (_triggers != 0xFFFF) {
+                    _triggers++;
+                }
+                if (!_repeat) {
+                    *_timsk &= ~(BIT0 << ICIE1); //ICIEn is bit 5 on all 16 bit timers
+                }
+            }
+        private:
+            OneShot(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint8_t* tccrc, volatile uint16_t* tcnt,
+                    volatile uint16_t* icr, volatile uint16_t* ocra, volatile uint16_t* ocrb, volatile uint8_t* timsk, volatile uint8_t* tifr,
+                    volatile uint8_t* prr, uint8_t prrBit, volatile uint8_t* port, volatile uint8_t* ddr, uint8_t pinBit,
+                    volatile uint8_t* icpPort, volatile uint8_t* icpDdr, uint8_t icpBit);
+            OneShot(const OneShot&) = delete;
+            OneShot& operator=(const OneShot&) = delete;
+
+            //adds offset to TCNTn, plus period if the count is below captured, in CLB_ONE_SHOT_ADJUST_CYCLES from read to write
+            static inline __attribute__((always_inline)) void advanceCounter(volatile uint16_t* tcnt, uint16_t captured,
+                                                                             uint16_t period, uint16_t offset) {
+                uint16_t _count;
+                uint8_t _mask;
+                uint16_t _wrap;
+                asm volatile(
+                    "ld   %A0, Z          \n\t" //2, reading the low byte latches the count
+                    "ldd  %B0, Z+1        \n\t" //2
+                    "cp   %A0, %A4        \n\t" //1
+                    "cpc  %B0, %B4        \n\t" //1
+                    "sbc  %1, %1          \n\t" //1, 0xFF if the count wrapped since the capture
+                    "movw %A2, %A5        \n\t" //1
+                    "and  %A2, %1         \n\t" //1
+                    "and  %B2, %1         \n\t" //1
+                    "add  %A0, %A2        \n\t" //1
+                    "adc  %B0, %B2        \n\t" //1
+                    "add  %A0, %A6        \n\t" //1
+                    "adc  %B0, %B6        \n\t" //1
+                    "std  Z+1, %B0        \n\t" //2, high byte into TEMP
+                    "st   Z, %A0          \n\t" //writing the low byte loads the count, 17 cycles after the read
+                    : "=&r" (_count), "=&r" (_mask), "=&r" (_wrap)
+                    : "z" (tcnt), "r" (captured), "r" (period), "r" (offset)
+                    : "memory"
+                );
+            }
+
+            bool plan(uint32_t widthNs, uint32_t delayNs, bool capture); //prescaler and compare values, false if out of range
+            void start(uint8_t tccrb); //powers up the timer with the planned values, interrupts must be off
+
+            volatile uint8_t* const _tccra;
+            volatile uint8_t* const _tccrb;
+            volatile uint8_t* const _tccrc;
+            volatile uint16_t* const _tcnt;
+            volatile uint16_t* const _icr;
+            volatile uint16_t* const _ocra;
+            volatile uint16_t* const _ocrbRegister;
+            volatile uint8_t* const _timsk;
+            volatile uint8_t* const _tifr;
+            volatile uint8_t* const _prr;
+            const uint8_t _prrBit;
+            volatile uint8_t* const _port;
+            volatile uint8_t* const _ddr;
+            const uint8_t _pinMask;
+            volatile uint8_t* const _icpPort;
+            volatile uint8_t* const _icpDdr;
+            const uint8_t _icpMask;
+
+            uint8_t _clock = 0; //CSn2:0 bits while running
+            uint16_t _ocrb = 0; //0x10000 - width in ticks
+            uint16_t _idleTop = 0; //TOP while waiting for a capture, 0 for fire()
+            uint16_t _delay = 0; //ticks from the captured edge to the pulse
+            uint16_t _adjust = 0; //CLB_ONE_SHOT_ADJUST_CYCLES in ticks
+            uint16_t _late = 0; //_adjust plus the cycles from the first TCNTn read in the ISR to the one in advanceCounter()
+            bool _repeat = false;
+            volatile uint16_t _triggers = 0;
+            volatile uint16_t _missed = 0;
+    };
+}
+
+#endif
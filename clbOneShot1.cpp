@@ -0,0 +1,18 @@
+#include "clbOneShot.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(1);
+
+static clb::OneShot* s_one_shot1 = nullptr;
+
+//only enabled by beginCapture(), so the pointer is always set here
+ISR(TIMER1_CAPT_vect) {
+    s_one_shot1->onCapture();
+}
+
+clb::OneShot& clb::OneShot::timer1() {
+    static clb::OneShot s_one_shot(&TCCR1A, &TCCR1B, &TCCR1C, &TCNT1, &ICR1, &OCR1A, &OCR1B, &TIMSK1, &TIFR1, &PRR0,
+                                   PRTIM1, &PORTB, &DDRB, PB6, &PORTD, &DDRD, PD4);
+    s_one_shot1 = &s_one_shot;
+    return s_one_shot;
+}
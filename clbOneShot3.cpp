@@ -0,0 +1,18 @@
+#include "clbOneShot.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(3);
+
+static clb::OneShot* s_one_shot3 = nullptr;
+
+//only enabled by beginCapture(), so the pointer is always set here
+ISR(TIMER3_CAPT_vect) {
+    s_one_shot3->onCapture();
+}
+
+clb::OneShot& clb::OneShot::timer3() {
+    static clb::OneShot s_one_shot(&TCCR3A, &TCCR3B, &TCCR3C, &TCNT3, &ICR3, &OCR3A, &OCR3B, &TIMSK3, &TIFR3, &PRR1,
+                                   PRTIM3, &PORTE, &DDRE, PE4, &PORTE, &DDRE, PE7);
+    s_one_shot3 = &s_one_shot;
+    return s_one_shot;
+}
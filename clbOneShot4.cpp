@@ -0,0 +1,18 @@
+#include "clbOneShot.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(4);
+
+static clb::OneShot* s_one_shot4 = nullptr;
+
+//only enabled by beginCapture(), so the pointer is always set here
+ISR(TIMER4_CAPT_vect) {
+    s_one_shot4->onCapture();
+}
+
+clb::OneShot& clb::OneShot::timer4() {
+    static clb::OneShot s_one_shot(&TCCR4A, &TCCR4B, &TCCR4C, &TCNT4, &ICR4, &OCR4A, &OCR4B, &TIMSK4, &TIFR4, &PRR1,
+                                   PRTIM4, &PORTH, &DDRH, PH4, &PORTL, &DDRL, PL0);
+    s_one_shot4 = &s_one_shot;
+    return s_one_shot;
+}
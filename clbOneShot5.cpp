@@ -0,0 +1,18 @@
+#include "clbOneShot.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(5);
+
+static clb::OneShot* s_one_shot5 = nullptr;
+
+//only enabled by beginCapture(), so the pointer is always set here
+ISR(TIMER5_CAPT_vect) {
+    s_one_shot5->onCapture();
+}
+
+clb::OneShot& clb::OneShot::timer5() {
+    static clb::OneShot s_one_shot(&TCCR5A, &TCCR5B, &TCCR5C, &TCNT5, &ICR5, &OCR5A, &OCR5B, &TIMSK5, &TIFR5, &PRR1,
+                                   PRTIM5, &PORTL, &DDRL, PL4, &PORTL, &DDRL, PL1);
+    s_one_shot5 = &s_one_shot;
+    return s_one_shot;
+}
@@ -0,0 +1,82 @@
+#ifndef CLBPRECISEDELAY_H
+#define CLBPRECISEDELAY_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+
+/* PRECISE SHORT DELAYS
+ *
+ * clb::PreciseDelay::cycles(n) burns exactly n cpu cycles with a counted loop, for any n from CLB_PRECISE_DELAY_MIN_CYCLES
+ * (14, under 1us at 16MHz) up to 65535. The count is in a register so n can be computed at runtime, it is exact from the
+ * first to the last instruction of the loop, loading n into the register pair before it is extra (usually 0-2 cycles).
+ * For compile time constants CLB_DELAY_CYCLES(n) uses the compiler builtin, which is exact for any n.
+ *
+ * Interrupts stretch the wait like any busy loop, wrap it in CLB_CRITICAL_SECTION() if every cycle matters.
+ *
+ * The timer classes use it for syncDelay(..., MICROSECONDS) below CLB_SYNC_DELAY_LOOP_CYCLES, where setting up the timer
+ * would take longer than the wait. Above it they subtract the measured fixed cost of the call from the ticks, see
+ * calibrateSyncDelay() in clbTimer.h.
+ */
+
+#define CLB_PRECISE_DELAY_MIN_CYCLES 14
+#define CLB_PRECISE_DELAY_OVERHEAD 10 //cycles of the loop that dont depend on n
+#define CLB_DELAY_CYCLES(n) __builtin_avr_delay_cycles(n)
+
+#ifndef CLB_SYNC_DELAY_LOOP_CYCLES
+#define CLB_SYNC_DELAY_LOOP_CYCLES 512 //microsecond syncDelays shorter than this many cpu cycles use the counted loop, at most 65535
+#endif
+
+#if F_CPU % 1000000UL == 0
+#define CLB_CYCLES_PER_US (F_CPU / 1000000UL) //the precise microsecond paths need a whole number of MHz
+#define CLB_PRECISE_DELAY_MAX_US (65535UL / CLB_CYCLES_PER_US) //longest microseconds() wait, 4095 at 16MHz
+#endif
+
+namespace clb {
+    class PreciseDelay {
+        public:
+            //waits exactly count cycles, shorter counts than CLB_PRECISE_DELAY_MIN_CYCLES wait the minimum
+            static inline __attribute__((always_inline)) void cycles(uint16_t count) {
+                if (count < CLB_PRECISE_DELAY_MIN_CYCLES) {
+                    count = CLB_PRECISE_DELAY_MIN_CYCLES;
+                }
+                //10 fixed cycles + (count - 10): the two low bits add 1 and 2 cycles, the rest runs a 4 cycle loop
+                asm volatile(
+                    "sbiw %A0, %1      \n\t" //2
+                    "sbrc %A0, 0       \n\t" //2 if bit 0 is clear, 1 + 2 if set
+                    "rjmp .+0          \n\t"
+                    "sbrs %A0, 1       \n\t" //1 + 2 if bit 1 is clear, 2 + 2 + 1 if set
+                    "rjmp 1f           \n\t"
+                    "rjmp .+0          \n\t"
+                    "nop               \n\t"
+                    "1:                \n\t"
+                    "lsr %B0           \n\t" //4
+                    "ror %A0           \n\t"
+                    "lsr %B0           \n\t"
+                    "ror %A0           \n\t"
+                    "2: sbiw %A0, 1    \n\t" //4 per pass, 1 less on the last
+                    "brne 2b           \n\t"
+                    : "+w" (count)
+                    : "I" (CLB_PRECISE_DELAY_OVERHEAD)
+                );
+            }
+#ifdef CLB_CYCLES_PER_US
+            //waits us microseconds with cycle resolution, up to CLB_PRECISE_DELAY_MAX_US. A constant above it doesnt compile,
+            //a runtime value above it waits the maximum instead of wrapping around to a short wait
+            static inline __attribute__((always_inline)) void microseconds(uint16_t us) {
+                if (__builtin_constant_p(us) && us > CLB_PRECISE_DELAY_MAX_US) {
+                    microsecondsTooLong();
+                }
+                if (us > CLB_PRECISE_DELAY_MAX_US) {
+                    us = CLB_PRECISE_DELAY_MAX_US;
+                }
+                cycles(us * CLB_CYCLES_PER_US);
+            }
+        private:
+            static void microsecondsTooLong() __attribute__((error("PreciseDelay::microseconds() waits at most CLB_PRECISE_DELAY_MAX_US, use delayMicroseconds() or a timer")));
+#endif
+    };
+}
+
+#endif
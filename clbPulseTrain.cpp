@@ -0,0 +1,122 @@
+#include "clbPulseTrain.h"
+
+#if (CLB_PULSE_TRAIN_BUFFER_SIZE & (CLB_PULSE_TRAIN_BUFFER_SIZE - 1)) != 0 || CLB_PULSE_TRAIN_BUFFER_SIZE > 128
+#error "CLB_PULSE_TRAIN_BUFFER_SIZE must be a power of 2 and at most 128"
+#endif
+
+clb::PulseTrain::PulseTrain(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint8_t* tccrc, volatile uint16_t* tcnt,
+                            volatile uint16_t* ocr, volatile uint8_t* timsk, volatile uint8_t* tifr, volatile uint8_t* prr,
+                            uint8_t prrBit, volatile uint8_t* port, volatile uint8_t* ddr, volatile uint8_t* pin, uint8_t pinBit)
+    : _tccra(tccra), _tccrb(tccrb), _tccrc(tccrc), _tcnt(tcnt), _ocr(ocr), _timsk(timsk), _tifr(tifr), _prr(prr),
+      _prrBit(prrBit), _port(port), _ddr(ddr), _pin(pin), _pinMask(BIT0 << pinBit) { }
+
+void clb::PulseTrain::begin(clb::TSyncClock clock) {
+    if (clock == clb::TSyncClock::STOPPED || clock == clb::TSyncClock::EXT_CLK_FE || clock == clb::TSyncClock::EXT_CLK_RE) {
+        CRITICAL("PulseTrain needs an internal clock, use one of the DIV_ values");
+        return;
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    *_prr &= ~(BIT0 << _prrBit);
+
+    *_tccrb = 0;
+    *_tccra = 0; //normal mode, TOP = 0xFFFF, output disconnected
+    *_timsk = 0;
+    *_tifr = (BIT0 << OCF1A); //OCFnA is bit 1 on timers 1 and 3
+
+    *_port &= ~_pinMask;
+    *_ddr |= _pinMask;
+
+    _head = 0;
+    _tail = 0;
+    _running = false;
+    _finishing = false;
+
+    *_tccrb = static_cast<uint8_t>(clock);
+}
+
+void clb::PulseTrain::end() {
+    CLB_CRITICAL_SECTION();
+
+    *_timsk = 0;
+    *_tccrb = 0;
+    *_tccra = 0;
+    *_port &= ~_pinMask;
+    _running = false;
+}
+
+bool clb::PulseTrain::write(uint16_t interval) {
+    uint8_t _next = (_head + 1) & (CLB_PULSE_TRAIN_BUFFER_SIZE - 1);
+    if (_next == _tail) {
+        return false;
+    }
+    _buffer[_head] = interval;
+    asm volatile("" ::: "memory"); //_buffer isnt volatile, the store must not move below the publish
+    _head = _next; //publish after the value is stored, the ISR only reads up to _head
+    return true;
+}
+
+uint8_t clb::PulseTrain::write(const uint16_t* intervals, uint8_t count) {
+    uint8_t _written = 0;
+    while (_written < count && write(intervals[_written])) {
+        _written++;
+    }
+    return _written;
+}
+
+uint8_t clb::PulseTrain::availableForWrite() {
+    return (_tail - _head - 1) & (CLB_PULSE_TRAIN_BUFFER_SIZE - 1);
+}
+
+void clb::PulseTrain::clear() {
+    if (_running) {
+        CRITICAL("PulseTrain::clear() called while running, call stop() first");
+        return;
+    }
+    _tail = _head;
+}
+
+void clb::PulseTrain::start() {
+    if (_running || _tail == _head) {
+        return;
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    //force the pin low through the compare unit, then let it toggle on every match
+    *_tccra = (*_tccra & ~((BIT0 << COM1A1) | (BIT0 << COM1A0))) | (BIT0 << COM1A1);
+    *_tccrc = (BIT0 << FOC1A);
+    *_tccra = (*_tccra & ~((BIT0 << COM1A1) | (BIT0 << COM1A0))) | (BIT0 << COM1A0);
+
+    uint8_t _index = _tail;
+    *_ocr = *_tcnt + _buffer[_index];
+    _tail = (_index + 1) & (CLB_PULSE_TRAIN_BUFFER_SIZE - 1);
+
+    _finishing = false;
+    _running = true;
+    *_tifr = (BIT0 << OCF1A);
+    *_timsk |= (BIT0 << OCIE1A);
+}
+
+void clb::PulseTrain::stop() {
+    CLB_CRITICAL_SECTION();
+    if (_running) {
+        halt(false);
+    }
+}
+
+void clb::PulseTrain::finish() { _finishing = true; }
+
+bool clb::PulseTrain::isRunning() { return _running; }
+
+uint16_t clb::PulseTrain::underruns() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _count = _underruns;
+    return _count;
+}
+
+void clb::PulseTrain::resetUnderruns() {
+    CLB_CRITICAL_SECTION();
+    _underruns = 0;
+}
@@ -0,0 +1,113 @@
+#ifndef CLBPULSETRAIN_H
+#define CLBPULSETRAIN_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+#include "clbCriticalSection.h"
+
+/* BUFFERED PULSE TRAIN
+ *
+ * Plays a queue of intervals on OC1A (pin 11) or OC3A (pin 5). The timer runs free in normal mode with the pin in
+ * TCMOM::TOGGLE, and every compare match ISR adds the next interval to OCRnA. The hardware toggles the pin on the match
+ * itself, so edges land on the exact timer tick no matter how late the ISR runs, as long as it runs before the next match.
+ *
+ * Every interval is the number of timer ticks to the next edge, so a step pulse is two entries. start() drives the pin low,
+ * the first interval is the time to the first rising edge, the second one the high time and so on.
+ * Intervals must be longer than the ISR (about 80 cycles with the clock at DIV_1). At 16 MHz and DIV_1 a 40 kHz step
+ * rate is 200 ticks per edge and takes roughly a third of the cpu.
+ *
+ * write() queues from the main context, the ISR consumes. If the queue runs dry while running, the output stops at its
+ * current level, the timer keeps running and underruns() counts it. Call finish() after the last write() of a finite
+ * train so running out at the end is not counted as an underrun.
+ *
+ * Each train takes over its whole timer (claimed with CLB_CLAIM_TIMER, see clbResource.h), so it cant be used together
+ * with clb::Timer1 or the Timer3 class on the same timer.
+ */
+
+#ifndef CLB_PULSE_TRAIN_BUFFER_SIZE
+#define CLB_PULSE_TRAIN_BUFFER_SIZE 32 //intervals queued per train, must be a power of 2 and at most 128, 2 bytes of RAM each
+#endif
+
+namespace clb {
+    class PulseTrain {
+        public:
+            static PulseTrain& timer1(); //train on OC1A, pin 11 on the Mega
+            static PulseTrain& timer3(); //train on OC3A, pin 5 on the Mega
+
+            void begin(TSyncClock clock); //powers up the timer, sets normal mode and the clock, makes the pin an output driven low
+            void end(); //stops the train and the timer, the pin goes back to a plain low output
+
+            bool write(uint16_t interval); //queues one interval in timer ticks, returns false if the queue is full
+            uint8_t write(const uint16_t* intervals, uint8_t count); //queues as many intervals as fit, returns how many
+            uint8_t availableForWrite(); //free places in the queue
+            void clear(); //drops everything queued, only while stopped
+
+            void start(); //drives the pin low and schedules the first queued interval, does nothing if the queue is empty
+            void stop(); //stops after the current edge, the pin keeps its level
+            void finish(); //marks the end of a finite train, the train stops by itself without an underrun once the queue is empty
+            bool isRunning(); //true while edges are being generated
+            uint16_t underruns(); //number of times the queue ran dry while running, saturates at 0xFFFF
+            void resetUnderruns();
+
+            //called from the compare match ISR, dont call it yourself
+            inline __attribute__((always_inline)) void onCompareMatch(volatile uint16_t& ocr) {
+                uint8_t _index = _tail;
+                if (_index != _head) {
+                    ocr += _buffer[_index];
+                    _tail = (_index + 1) & (CLB_PULSE_TRAIN_BUFFER_SIZE - 1);
+                }
+                else {
+                    halt(!_finishing);
+                }
+            }
+        private:
+            PulseTrain(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint8_t* tccrc, volatile uint16_t* tcnt,
+                       volatile uint16_t* ocr, volatile uint8_t* timsk, volatile uint8_t* tifr, volatile uint8_t* prr,
+                       uint8_t prrBit, volatile uint8_t* port, volatile uint8_t* ddr, volatile uint8_t* pin, uint8_t pinBit);
+            PulseTrain(const PulseTrain&) = delete;
+            PulseTrain& operator=(const PulseTrain&) = delete;
+
+            //disconnects the pin at its current level and stops the interrupt, interrupts must be off
+            inline __attribute__((always_inline)) void halt(bool underrun) {
+                if (*_pin & _pinMask) {
+                    *_port |= _pinMask;
+                }
+                else {
+                    *_port &= ~_pinMask;
+                }
+                *_tccra &= ~((BIT0 << COM1A1) | (BIT0 << COM1A0)); //COMnA bits are in the same place on timers 1 and 3
+                *_timsk &= ~(BIT0 << OCIE1A);
+                if (underrun && _underruns != 0xFFFF) {
+                    _underruns++;
+                }
+                _running = false;
+            }
+
+            volatile uint8_t* const _tccra;
+            volatile uint8_t* const _tccrb;
+            volatile uint8_t* const _tccrc;
+            volatile uint16_t* const _tcnt;
+            volatile uint16_t* const _ocr;
+            volatile uint8_t* const _timsk;
+            volatile uint8_t* const _tifr;
+            volatile uint8_t* const _prr;
+            const uint8_t _prrBit;
+            volatile uint8_t* const _port;
+            volatile uint8_t* const _ddr;
+            volatile uint8_t* const _pin;
+            const uint8_t _pinMask;
+
+            uint16_t _buffer[CLB_PULSE_TRAIN_BUFFER_SIZE];
+            volatile uint8_t _head = 0; //next place to write, only written by the main context
+            volatile uint8_t _tail = 0; //next interval to play, only written by the ISR while running
+            volatile bool _running = false;
+            volatile bool _finishing = false;
+            volatile uint16_t _underruns = 0;
+    };
+}
+
+#endif
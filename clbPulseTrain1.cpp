@@ -0,0 +1,17 @@
+#include "clbPulseTrain.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(1);
+
+static clb::PulseTrain* s_pulse_train1 = nullptr;
+
+//only enabled by start(), so the pointer is always set here
+ISR(TIMER1_COMPA_vect) {
+    s_pulse_train1->onCompareMatch(OCR1A);
+}
+
+clb::PulseTrain& clb::PulseTrain::timer1() {
+    static clb::PulseTrain s_train(&TCCR1A, &TCCR1B, &TCCR1C, &TCNT1, &OCR1A, &TIMSK1, &TIFR1, &PRR0, PRTIM1, &PORTB, &DDRB, &PINB, PB5);
+    s_pulse_train1 = &s_train;
+    return s_train;
+}
@@ -0,0 +1,17 @@
+#include "clbPulseTrain.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(3);
+
+static clb::PulseTrain* s_pulse_train3 = nullptr;
+
+//only enabled by start(), so the pointer is always set here
+ISR(TIMER3_COMPA_vect) {
+    s_pulse_train3->onCompareMatch(OCR3A);
+}
+
+clb::PulseTrain& clb::PulseTrain::timer3() {
+    static clb::PulseTrain s_train(&TCCR3A, &TCCR3B, &TCCR3C, &TCNT3, &OCR3A, &TIMSK3, &TIFR3, &PRR1, PRTIM3, &PORTE, &DDRE, &PINE, PE3);
+    s_pulse_train3 = &s_train;
+    return s_train;
+}
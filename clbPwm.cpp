@@ -0,0 +1,195 @@
+#include "clbPwm.h"
+
+#include <avr/pgmspace.h>
+
+static const uint16_t s_pwm_prescalers[5] PROGMEM = {1, 8, 64, 256, 1024}; //CSn2:0 = index + 1
+
+clb::Pwm::Pwm(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint16_t* tcnt, volatile uint16_t* icr,
+              volatile uint16_t* ocr, volatile uint8_t* timsk, volatile uint8_t* tifr, volatile uint8_t* prr, uint8_t prrBit,
+              volatile uint8_t* port, volatile uint8_t* ddr, uint8_t pinBitA)
+    : _tccra(tccra), _tccrb(tccrb), _tcnt(tcnt), _icr(icr), _ocr(ocr), _timsk(timsk), _tifr(tifr), _prr(prr),
+      _prrBit(prrBit), _port(port), _ddr(ddr), _pinBitA(pinBitA) { }
+
+//the smallest prescaler whose period fits in 16 bits gives the largest TOP
+bool clb::Pwm::plan(uint32_t frequency, uint8_t& clock, uint16_t& top) {
+    if (frequency == 0) {
+        return false;
+    }
+    for (uint8_t i = 0; i < 5; i++) {
+        uint64_t _divider = (uint64_t)pgm_read_word(&s_pwm_prescalers[i]) * frequency;
+        uint64_t _counts = (((uint64_t)F_CPU << 16) + _divider / 2) / _divider; //TOP + 1, rounded
+        if (_counts <= 0x10000UL) {
+            if (_counts < CLB_PWM_MIN_TOP + 1UL) {
+                return false;
+            }
+            clock = i + 1;
+            top = (uint16_t)(_counts - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+//high for OCRnx + 1 ticks, so duty * (TOP + 1) rounded is the tick count. Below 0x10000 the product fits 32 bits
+uint16_t clb::Pwm::compareValue(uint32_t duty, uint16_t top) {
+    if (duty >= 0x10000UL) {
+        return top;
+    }
+    uint32_t _ticks = (duty * ((uint32_t)top + 1) + 0x8000UL) >> 16;
+    return (_ticks == 0) ? 0 : (uint16_t)(_ticks - 1);
+}
+
+//a stale TOVn flag would run the ISR at once, somewhere in the middle of a period, so it is cleared first
+void clb::Pwm::queue(uint8_t commit) {
+    if (_commit == 0) {
+        *_tifr = (BIT0 << TOV1); //TOVn and TOIEn are bit 0 on all 16 bit timers
+        *_timsk |= (BIT0 << TOIE1);
+    }
+    _commit |= commit;
+}
+
+bool clb::Pwm::begin(uint32_t frequency) {
+    uint8_t _newClock;
+    uint16_t _newTop;
+    if (!plan(frequency, _newClock, _newTop)) {
+        CRITICAL("Pwm::begin() frequency out of range, TOP would be below CLB_PWM_MIN_TOP or above 65535 with DIV_1024");
+        return false;
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    *_prr &= ~(BIT0 << _prrBit);
+
+    *_tccrb = 0;
+    *_timsk = 0;
+    *_tccra = (BIT0 << WGM11); //fast PWM with TOP in ICRn together with WGMn3:2, outputs disconnected
+    *_tcnt = 0;
+    *_icr = _newTop;
+    for (uint8_t i = 0; i < 3; i++) {
+        _ocr[i] = 0;
+        _duty[i] = 0;
+        _pendingOcr[i] = 0;
+    }
+    *_tifr = (BIT0 << TOV1);
+
+    _clock = _newClock;
+    _top = _newTop;
+    _commit = 0;
+
+    *_tccrb = (BIT0 << WGM13) | (BIT0 << WGM12) | _clock;
+    return true;
+}
+
+void clb::Pwm::end() {
+    CLB_CRITICAL_SECTION();
+
+    *_timsk = 0;
+    *_tccrb = 0;
+    *_tccra = 0;
+    *_port &= ~(0b111 << _pinBitA);
+    _clock = 0;
+    _commit = 0;
+}
+
+void clb::Pwm::connect(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    uint8_t _pinMask = BIT0 << (_pinBitA + _index);
+
+    CLB_CRITICAL_SECTION();
+
+    *_port &= ~_pinMask;
+    *_ddr |= _pinMask;
+    *_tccra |= (BIT0 << (COM1A1 - 2 * _index)); //COMnA, COMnB and COMnC follow the channel order downwards, set at BOTTOM and cleared on match
+}
+
+void clb::Pwm::disconnect(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+
+    CLB_CRITICAL_SECTION();
+
+    *_tccra &= ~((BIT1 | BIT0) << (COM1A0 - 2 * _index));
+    *_port &= ~(BIT0 << (_pinBitA + _index));
+}
+
+bool clb::Pwm::setFrequency(uint32_t frequency) {
+    if (_clock == 0) {
+        CRITICAL("Pwm::setFrequency() called before begin()");
+        return false;
+    }
+    uint8_t _newClock;
+    uint16_t _newTop;
+    if (!plan(frequency, _newClock, _newTop)) {
+        CRITICAL("Pwm::setFrequency() frequency out of range, TOP would be below CLB_PWM_MIN_TOP or above 65535 with DIV_1024");
+        return false;
+    }
+    //_duty only changes in the main context, so the scaling can run with interrupts on
+    uint16_t _newOcr[3];
+    for (uint8_t i = 0; i < 3; i++) {
+        _newOcr[i] = compareValue(_duty[i], _newTop);
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    for (uint8_t i = 0; i < 3; i++) {
+        _pendingOcr[i] = _newOcr[i];
+    }
+    _pendingTop = _newTop;
+    _pendingTccrb = (BIT0 << WGM13) | (BIT0 << WGM12) | _newClock;
+    _clock = _newClock;
+    _top = _newTop;
+    queue(COMMIT_OCR | COMMIT_TOP);
+    return true;
+}
+
+void clb::Pwm::setDuty(clb::TOutputChannel channel, uint32_t duty) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (duty > 0x10000UL) {
+        duty = 0x10000UL;
+    }
+    uint16_t _value = compareValue(duty, _top);
+
+    CLB_CRITICAL_SECTION();
+
+    _duty[_index] = duty;
+    _pendingOcr[_index] = _value;
+    queue(COMMIT_OCR);
+}
+
+void clb::Pwm::setDuties(uint32_t dutyA, uint32_t dutyB, uint32_t dutyC) {
+    uint32_t _duties[3] = {dutyA, dutyB, dutyC};
+    uint16_t _values[3];
+    for (uint8_t i = 0; i < 3; i++) {
+        if (_duties[i] > 0x10000UL) {
+            _duties[i] = 0x10000UL;
+        }
+        _values[i] = compareValue(_duties[i], _top);
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    for (uint8_t i = 0; i < 3; i++) {
+        _duty[i] = _duties[i];
+        _pendingOcr[i] = _values[i];
+    }
+    queue(COMMIT_OCR);
+}
+
+uint32_t clb::Pwm::frequency() {
+    if (_clock == 0) {
+        return 0;
+    }
+    uint64_t _divider = (uint64_t)pgm_read_word(&s_pwm_prescalers[_clock - 1]) * ((uint32_t)_top + 1);
+    return (uint32_t)((((uint64_t)F_CPU << 16) + _divider / 2) / _divider);
+}
+
+uint16_t clb::Pwm::top() { return _top; }
+
+uint8_t clb::Pwm::resolution() {
+    uint8_t _bits = 0;
+    for (uint32_t _steps = (uint32_t)_top + 1; _steps > 1; _steps >>= 1) {
+        _bits++;
+    }
+    return _bits;
+}
+
+bool clb::Pwm::isPending() { return _commit != 0; }
@@ -0,0 +1,142 @@
+#ifndef CLBPWM_H
+#define CLBPWM_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+#include "clbCriticalSection.h"
+
+/* HIGH RESOLUTION PWM
+ *
+ * Runs a 16 bit timer in fast PWM with TOP in ICRn (TMode16::FAST_PWM_ICR) and gives all three channels a duty cycle as a
+ * fraction. Frequency and duty are 16.16 fixed point: frequency in Hz, duty from 0 to CLB_Q16(1.0) = 0x10000.
+ *
+ *     clb::Pwm& _pwm = clb::Pwm::timer4();
+ *     _pwm.begin(CLB_Q16(1000)); //1 kHz, TOP = 15999, almost 14 bits
+ *     _pwm.connect(clb::TOutputChannel::A); //OC4A, pin 6
+ *     _pwm.setDuty(clb::TOutputChannel::A, CLB_Q16(0.25));
+ *
+ * begin() and setFrequency() take the smallest prescaler that fits the period in 16 bits, so TOP and with it the resolution
+ * is as large as the frequency allows: log2(F_CPU / f) bits, 16 bits up to 244 Hz and 14 bits at 1 kHz at 16 MHz. TOP has
+ * to be at least 255, so the highest frequency is F_CPU / 256 (62.5 kHz at 16 MHz).
+ *
+ * The pin is set at BOTTOM and cleared at the compare match, so a channel is high for OCRnx + 1 of the TOP + 1 ticks. Duty 0
+ * leaves a one tick pulse per period, disconnect() the channel for a steady low. CLB_Q16(1.0) is a steady high.
+ *
+ * Updates go through the overflow ISR so all channels change on the same period:
+ *   - setDuty() and setDuties() queue the new OCRnx values, the ISR writes them at the start of a period and the timer
+ *     latches them together at the next BOTTOM (OCRnx are double buffered in this mode). TOVn is set at TOP, one timer
+ *     tick before BOTTOM, so the ISR first waits until the counter has left TOP. That is up to one prescaler tick of busy
+ *     wait in the ISR, 64 to 1024 cycles at the prescalers plan() picks below about 30 Hz at 16 MHz
+ *   - setFrequency() queues the OCRnx values for the new TOP the same way. ICRn isnt double buffered, so the ISR writes it
+ *     one period later, right after BOTTOM latched the matching OCRnx and long before the counter can reach it. A new
+ *     prescaler is set in the same ISR, the few ticks counted before it make that one period slightly off
+ * No period ever runs a duty cycle computed for another TOP. The ISR only runs while an update is pending and is over
+ * within 1-2 periods, isPending() tells when.
+ *
+ *   Timer1  OC1A pin 11, OC1B pin 12, OC1C pin 13    Timer4  OC4A pin 6,  OC4B pin 7,  OC4C pin 8
+ *   Timer3  OC3A pin 5,  OC3B pin 2,  OC3C pin 3     Timer5  OC5A pin 46, OC5B pin 45, OC5C pin 44
+ *
+ * Each PWM takes over its whole timer (claimed with CLB_CLAIM_TIMER, see clbResource.h), so it cant be used together with
+ * clb::Timer1, Servo or the other modules on the same timer.
+ */
+
+#define CLB_PWM_MIN_TOP 255 //smallest TOP begin() and setFrequency() accept, the ISR has to write ICRn before the counter gets there
+
+namespace clb {
+    class Pwm {
+        public:
+            static Pwm& timer1(); //OC1A-C, pins 11, 12, 13 on the Mega
+            static Pwm& timer3(); //OC3A-C, pins 5, 2, 3 on the Mega
+            static Pwm& timer4(); //OC4A-C, pins 6, 7, 8 on the Mega
+            static Pwm& timer5(); //OC5A-C, pins 46, 45, 44 on the Mega
+
+            bool begin(uint32_t frequency); //powers up the timer and starts it at frequency (16.16 Hz) with all duties 0, false if out of range
+            void end(); //stops the timer, disconnects the channels and drives their pins low
+
+            void connect(TOutputChannel channel); //puts the channel on its pin and makes the pin an output
+            void disconnect(TOutputChannel channel); //takes the channel off its pin and drives the pin low
+
+            bool setFrequency(uint32_t frequency); //new frequency (16.16 Hz) with the same duty fractions, false if out of range
+            void setDuty(TOutputChannel channel, uint32_t duty); //duty as 16.16 fraction, 0 to 0x10000
+            void setDuties(uint32_t dutyA, uint32_t dutyB, uint32_t dutyC); //all three channels on the same period
+
+            uint32_t frequency(); //frequency the timer actually runs at, 16.16 Hz
+            uint16_t top(); //current TOP, the duty resolution is TOP + 1 steps
+            uint8_t resolution(); //whole bits of duty resolution
+            bool isPending(); //true until the last update is in the registers
+
+            //called from the overflow ISR, dont call it yourself
+            inline __attribute__((always_inline)) void onOverflow() {
+                //TOVn is set at TOP and the OCRnx latch one timer tick later at BOTTOM. With a prescaler of 64 and up the
+                //ISR can run before that tick, so it waits for BOTTOM first, at most one tick (1024 cycles at DIV_1024)
+                uint16_t _current = *_icr;
+                while (*_tcnt == _current) {
+                }
+                uint8_t _state = _commit;
+                if (_state & COMMIT_TOP_NEXT) {
+                    *_icr = _nextTop; //the OCRnx for this TOP were latched at the BOTTOM that just passed
+                    *_tccrb = _nextTccrb;
+                    _state &= ~COMMIT_TOP_NEXT;
+                }
+                if (_state & COMMIT_OCR) {
+                    _ocr[0] = _pendingOcr[0];
+                    _ocr[1] = _pendingOcr[1];
+                    _ocr[2] = _pendingOcr[2];
+                    if (_state & COMMIT_TOP) {
+                        _nextTop = _pendingTop;
+                        _nextTccrb = _pendingTccrb;
+                        _state |= COMMIT_TOP_NEXT;
+                    }
+                    _state &= ~(COMMIT_OCR | COMMIT_TOP);
+                }
+                _commit = _state;
+                if (_state == 0) {
+                    *_timsk &= ~(BIT0 << TOIE1); //TOIEn is bit 0 on all 16 bit timers
+                }
+            }
+        private:
+            Pwm(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint16_t* tcnt, volatile uint16_t* icr,
+                volatile uint16_t* ocr, volatile uint8_t* timsk, volatile uint8_t* tifr, volatile uint8_t* prr, uint8_t prrBit,
+                volatile uint8_t* port, volatile uint8_t* ddr, uint8_t pinBitA);
+            Pwm(const Pwm&) = delete;
+            Pwm& operator=(const Pwm&) = delete;
+
+            //states of the commit done by the overflow ISR
+            static const uint8_t COMMIT_OCR = BIT0; //_pendingOcr waits to be written
+            static const uint8_t COMMIT_TOP = BIT1; //_pendingTop goes into ICRn one period after _pendingOcr
+            static const uint8_t COMMIT_TOP_NEXT = BIT2; //_pendingOcr is written, _nextTop goes into ICRn on the next overflow
+
+            bool plan(uint32_t frequency, uint8_t& clock, uint16_t& top); //prescaler and TOP for the frequency
+            uint16_t compareValue(uint32_t duty, uint16_t top); //OCRnx for the duty fraction
+            void queue(uint8_t commit); //hands _pendingOcr to the ISR, interrupts must be off
+
+            volatile uint8_t* const _tccra;
+            volatile uint8_t* const _tccrb;
+            volatile uint16_t* const _tcnt;
+            volatile uint16_t* const _icr;
+            volatile uint16_t* const _ocr; //OCRnA, OCRnB and OCRnC follow it in the channel order
+            volatile uint8_t* const _timsk;
+            volatile uint8_t* const _tifr;
+            volatile uint8_t* const _prr;
+            const uint8_t _prrBit;
+            volatile uint8_t* const _port;
+            volatile uint8_t* const _ddr;
+            const uint8_t _pinBitA; //OCnA pin, OCnB and OCnC are the next two bits of the same port on all 16 bit timers
+
+            uint8_t _clock = 0; //CSn2:0 bits while running
+            uint16_t _top = 0; //TOP of the last setFrequency(), the duties are computed for it
+            uint32_t _duty[3] = {0, 0, 0}; //16.16 fractions, kept so setFrequency() can scale them to the new TOP
+            uint16_t _pendingOcr[3] = {0, 0, 0};
+            uint16_t _pendingTop = 0; //TOP that belongs to _pendingOcr
+            uint8_t _pendingTccrb = 0; //mode and prescaler that belong to _pendingTop
+            uint16_t _nextTop = 0; //TOP the ISR writes on the next overflow
+            uint8_t _nextTccrb = 0;
+            volatile uint8_t _commit = 0; //COMMIT_ bits, cleared by the ISR
+    };
+}
+
+#endif
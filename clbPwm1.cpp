@@ -0,0 +1,17 @@
+#include "clbPwm.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(1);
+
+static clb::Pwm* s_pwm1 = nullptr;
+
+//only enabled while an update is pending, so the pointer is always set here
+ISR(TIMER1_OVF_vect) {
+    s_pwm1->onOverflow();
+}
+
+clb::Pwm& clb::Pwm::timer1() {
+    static clb::Pwm s_pwm(&TCCR1A, &TCCR1B, &TCNT1, &ICR1, &OCR1A, &TIMSK1, &TIFR1, &PRR0, PRTIM1, &PORTB, &DDRB, PB5);
+    s_pwm1 = &s_pwm;
+    return s_pwm;
+}
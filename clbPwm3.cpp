@@ -0,0 +1,17 @@
+#include "clbPwm.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(3);
+
+static clb::Pwm* s_pwm3 = nullptr;
+
+//only enabled while an update is pending, so the pointer is always set here
+ISR(TIMER3_OVF_vect) {
+    s_pwm3->onOverflow();
+}
+
+clb::Pwm& clb::Pwm::timer3() {
+    static clb::Pwm s_pwm(&TCCR3A, &TCCR3B, &TCNT3, &ICR3, &OCR3A, &TIMSK3, &TIFR3, &PRR1, PRTIM3, &PORTE, &DDRE, PE3);
+    s_pwm3 = &s_pwm;
+    return s_pwm;
+}
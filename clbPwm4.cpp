@@ -0,0 +1,17 @@
+#include "clbPwm.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(4);
+
+static clb::Pwm* s_pwm4 = nullptr;
+
+//only enabled while an update is pending, so the pointer is always set here
+ISR(TIMER4_OVF_vect) {
+    s_pwm4->onOverflow();
+}
+
+clb::Pwm& clb::Pwm::timer4() {
+    static clb::Pwm s_pwm(&TCCR4A, &TCCR4B, &TCNT4, &ICR4, &OCR4A, &TIMSK4, &TIFR4, &PRR1, PRTIM4, &PORTH, &DDRH, PH3);
+    s_pwm4 = &s_pwm;
+    return s_pwm;
+}
@@ -0,0 +1,17 @@
+#include "clbPwm.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(5);
+
+static clb::Pwm* s_pwm5 = nullptr;
+
+//only enabled while an update is pending, so the pointer is always set here
+ISR(TIMER5_OVF_vect) {
+    s_pwm5->onOverflow();
+}
+
+clb::Pwm& clb::Pwm::timer5() {
+    static clb::Pwm s_pwm(&TCCR5A, &TCCR5B, &TCNT5, &ICR5, &OCR5A, &TIMSK5, &TIFR5, &PRR1, PRTIM5, &PORTL, &DDRL, PL3);
+    s_pwm5 = &s_pwm;
+    return s_pwm;
+}
@@ -0,0 +1,35 @@
+#ifndef CLBRESOURCE_H
+#define CLBRESOURCE_H
+
+#include <stdint.h>
+
+/* TIMER RESOURCE REGISTRY
+ *
+ * Every hardware timer can only have one owner. The clb timer classes are singletons (clb::Timer1::instance() etc.) so a
+ * timer cant be constructed twice, and every module that takes over a timer claims it with CLB_CLAIM_TIMER(n) at file scope.
+ * A claim defines the symbol clb_timerN_claimed, so two modules claiming the same timer fail to link with
+ *
+ *     multiple definition of `clb_timer1_claimed'
+ *
+ * and the linker names both object files. The library is built with dot_a_linkage (see library.properties), so a timer file
+ * and its ISRs only end up in the program when that timer is actually used, an unused claim costs nothing.
+ *
+ * Claim a timer the same way from your own code if it writes the timer registers directly or defines one of its ISRs.
+ *
+ * The Arduino core and common libraries dont claim anything, their conflicts show up as duplicate ISR vectors instead:
+ *
+ *     multiple definition of `__vector_13'
+ *
+ *   Timer0  __vector_21 COMPA, 22 COMPB, 23 OVF    millis(), micros() and delay() always use OVF, so clb::Timer0 is
+ *                                                  only available with CLB_ALLOW_TIMER0 (see clbConfig.h)
+ *   Timer1  __vector_16 CAPT, 17 COMPA, 18 COMPB, 19 COMPC, 20 OVF    Servo
+ *   Timer2  __vector_13 COMPA, 14 COMPB, 15 OVF    tone() and noTone()
+ *   Timer3  __vector_31 CAPT, 32 COMPA, 33 COMPB, 34 COMPC, 35 OVF    Servo
+ *   Timer4  __vector_41 CAPT, 42 COMPA, 43 COMPB, 44 COMPC, 45 OVF    Servo
+ *   Timer5  __vector_46 CAPT, 47 COMPA, 48 COMPB, 49 COMPC, 50 OVF    Servo, the cycle clock by default
+ */
+
+#define CLB_CLAIM_TIMER(n) CLB_CLAIM_TIMER_SYMBOL(n) //expands n first so CLB_CLAIM_TIMER(CLB_CYCLE_CLOCK_TIMER) works
+#define CLB_CLAIM_TIMER_SYMBOL(n) extern "C" __attribute__((used)) const uint8_t clb_timer##n##_claimed = n
+
+#endif
@@ -0,0 +1,98 @@
+#include "clbStats.h"
+
+#ifdef CLB_ENABLE_STATS
+
+static volatile uint32_t s_stats_entries[static_cast<uint8_t>(clb::TVector::COUNT)];
+static volatile uint32_t s_stats_cycles[static_cast<uint8_t>(clb::TVector::COUNT)];
+static uint32_t s_stats_interval_start = 0;
+
+//timer that owns each vector, same order as TVector
+static const uint8_t s_stats_vector_timer[static_cast<uint8_t>(clb::TVector::COUNT)] = {
+    0, 0, 0,
+    1, 1, 1, 1,
+    2, 2, 2
+};
+
+//runs inside the ISR with interrupts already off
+void clb::Stats::account(clb::TVector vector, uint16_t cycles) {
+    uint8_t _index = static_cast<uint8_t>(vector);
+    s_stats_entries[_index]++;
+    s_stats_cycles[_index] += cycles + CLB_STATS_ISR_OVERHEAD;
+}
+
+void clb::Stats::begin() {
+    clb::CycleClock::begin();
+    reset();
+}
+
+void clb::Stats::reset() {
+    uint8_t _sreg = SREG;
+    cli();
+
+    for (uint8_t i = 0; i < static_cast<uint8_t>(clb::TVector::COUNT); i++) {
+        s_stats_entries[i] = 0;
+        s_stats_cycles[i] = 0;
+    }
+    s_stats_interval_start = clb::CycleClock::now32();
+
+    SREG = _sreg;
+}
+
+clb::StatsSnapshot clb::Stats::snapshot() {
+    clb::StatsSnapshot _snapshot;
+
+    uint8_t _sreg = SREG;
+    cli();
+
+    uint32_t _now = clb::CycleClock::now32();
+    _snapshot.elapsedCycles = _now - s_stats_interval_start;
+    s_stats_interval_start = _now;
+
+    for (uint8_t i = 0; i < static_cast<uint8_t>(clb::TVector::COUNT); i++) {
+        _snapshot.interrupts[i] = s_stats_entries[i];
+        _snapshot.isrCycles[i] = s_stats_cycles[i];
+        s_stats_entries[i] = 0;
+        s_stats_cycles[i] = 0;
+    }
+
+    SREG = _sreg;
+
+    uint32_t _timerCycles[static_cast<uint8_t>(clb::TStatsTimer::COUNT)] = { 0, 0, 0 };
+
+    for (uint8_t i = 0; i < static_cast<uint8_t>(clb::TVector::COUNT); i++) {
+        if (_snapshot.elapsedCycles == 0) {
+            _snapshot.interruptsPerSecond[i] = 0;
+        }
+        else {
+            _snapshot.interruptsPerSecond[i] = ((uint64_t)_snapshot.interrupts[i] * F_CPU) / _snapshot.elapsedCycles;
+        }
+        _timerCycles[s_stats_vector_timer[i]] += _snapshot.isrCycles[i];
+    }
+
+    for (uint8_t i = 0; i < static_cast<uint8_t>(clb::TStatsTimer::COUNT); i++) {
+        if (_snapshot.elapsedCycles == 0) {
+            _snapshot.cpuPercent[i] = 0.0f;
+        }
+        else {
+            _snapshot.cpuPercent[i] = (100.0f * _timerCycles[i]) / _snapshot.elapsedCycles;
+        }
+    }
+
+    return _snapshot;
+}
+
+bool clb::Stats::isEnabled() { return true; }
+
+#else
+
+void clb::Stats::account(clb::TVector vector, uint16_t cycles) { }
+void clb::Stats::begin() { }
+void clb::Stats::reset() { }
+clb::StatsSnapshot clb::Stats::snapshot() {
+    clb::StatsSnapshot _snapshot;
+    memset(&_snapshot, 0, sizeof(_snapshot));
+    return _snapshot;
+}
+bool clb::Stats::isEnabled() { return false; }
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef CLBSTATS_H
+#define CLBSTATS_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+#include "clbCycleClock.h"
+
+/* ISR LOAD ACCOUNTING
+ *
+ * When CLB_ENABLE_STATS is defined (see clbConfig.h) every Timer0/1/2 compare match and overflow ISR counts its entries
+ * and the cpu cycles spent in its body, measured on the free running cycle clock (see clbCycleClock.h).
+ * clb::Stats::snapshot() turns the counts since the previous snapshot into interrupts per second and percent cpu per timer.
+ *
+ * The cycles dont include the register push/pop the compiler wraps around each ISR (roughly 20-40 cycles on avr-gcc,
+ * depending on how many registers the ISR needs), set CLB_STATS_ISR_OVERHEAD to add a fixed amount per entry.
+ * Take a snapshot at least every ~268 seconds, the 32 bit cycle clock wraps after that.
+ *
+ * When the define is off CLB_STATS_SCOPE expands to nothing and snapshot() returns zeros.
+ */
+
+#ifndef CLB_STATS_ISR_OVERHEAD
+#define CLB_STATS_ISR_OVERHEAD 0 //cycles added per ISR entry for the compiler generated prologue and epilogue
+#endif
+
+#ifdef CLB_ENABLE_STATS
+#define CLB_STATS_SCOPE(vector) clb::StatsScope _clbStatsScope(vector) //counts until the end of the enclosing block
+#else
+#define CLB_STATS_SCOPE(vector)
+#endif
+
+namespace clb {
+    //timers covered by the cpu load figures
+    enum class TStatsTimer : uint8_t {
+        TIMER0 = 0,
+        TIMER1 = 1,
+        TIMER2 = 2,
+        COUNT = 3 //number of timers, not a timer
+    };
+
+    struct StatsSnapshot {
+        uint32_t elapsedCycles; //cpu cycles since the previous snapshot (or begin())
+        uint32_t interrupts[static_cast<uint8_t>(TVector::COUNT)]; //ISR entries per vector in that time
+        uint32_t interruptsPerSecond[static_cast<uint8_t>(TVector::COUNT)]; //ISR entries per vector scaled to one second
+        uint32_t isrCycles[static_cast<uint8_t>(TVector::COUNT)]; //cpu cycles spent in each vector in that time
+        float cpuPercent[static_cast<uint8_t>(TStatsTimer::COUNT)]; //percent of the cpu spent in all ISRs of each timer
+    };
+
+    class Stats {
+        public:
+            static void begin(); //starts the cycle clock and clears the counters, call before the first snapshot
+            static StatsSnapshot snapshot(); //returns the counts since the previous snapshot and starts a new interval
+            static void reset(); //clears the counters and starts a new interval without reporting
+            static bool isEnabled(); //returns true if CLB_ENABLE_STATS was defined when the library was built
+            static void account(TVector vector, uint16_t cycles); //called on ISR exit by StatsScope, not meant for user code
+    };
+
+    //measures the enclosing ISR body, use through CLB_STATS_SCOPE
+    class StatsScope {
+        public:
+            inline StatsScope(TVector vector) : _vector(vector), _start(CycleClock::now16()) { }
+            inline ~StatsScope() { Stats::account(_vector, CycleClock::now16() - _start); }
+        private:
+            TVector _vector;
+            uint16_t _start;
+    };
+}
+
+#endif
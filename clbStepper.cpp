@@ -0,0 +1,265 @@
+#include "clbStepper.h"
+
+#include <math.h>
+
+static const float s_rate_scale = 281474976710656.0f; //2^48
+
+static uint16_t getPrescaler(clb::TSyncClock clock) {
+    switch (clock) {
+        case clb::TSyncClock::DIV_1: return 1;
+        case clb::TSyncClock::DIV_8: return 8;
+        case clb::TSyncClock::DIV_64: return 64;
+        case clb::TSyncClock::DIV_256: return 256;
+        case clb::TSyncClock::DIV_1024: return 1024;
+        default: return 0;
+    }
+}
+
+clb::Stepper::Stepper(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint8_t* tccrc, volatile uint16_t* tcnt,
+                      volatile uint16_t* ocra, volatile uint16_t* ocrb, volatile uint8_t* timsk, volatile uint8_t* tifr,
+                      volatile uint8_t* prr, uint8_t prrBit, volatile uint8_t* ddr, uint8_t pinBit)
+    : _tccra(tccra), _tccrb(tccrb), _tccrc(tccrc), _tcnt(tcnt), _ocra(ocra), _ocrb(ocrb), _timsk(timsk), _tifr(tifr),
+      _prr(prr), _prrBit(prrBit), _ddr(ddr), _pinMask(BIT0 << pinBit) { }
+
+void clb::Stepper::begin(clb::TSyncClock clock, uint8_t directionPin) {
+    uint16_t _prescaler = getPrescaler(clock);
+    if (_prescaler == 0) {
+        CRITICAL("Stepper needs an internal clock, use one of the DIV_ values");
+        return;
+    }
+#ifdef CLB_ENABLE_STEPPER_PROFILE
+    clb::CycleClock::begin();
+#endif
+
+    _directionPin = directionPin;
+    pinMode(_directionPin, OUTPUT);
+    digitalWrite(_directionPin, LOW);
+
+    CLB_CRITICAL_SECTION();
+
+    *_prr &= ~(BIT0 << _prrBit);
+
+    *_tccrb = 0;
+    *_timsk = 0;
+    *_tccra = (BIT0 << COM1B1); //CTC needs WGMn1:0 = 0, OCnB clears on match
+    *_tccrc = (BIT0 << FOC1B); //and forced low now
+    *_tcnt = 0;
+    *_tifr = (BIT0 << OCF1A) | (BIT0 << OCF1B); //flag bits are in the same place on all 16 bit timers
+    *_ddr |= _pinMask;
+
+    _clockBits = static_cast<uint8_t>(clock);
+    _tickRate = (float)F_CPU / _prescaler;
+    _running = false;
+    _stepsLeft = 0;
+}
+
+void clb::Stepper::end() {
+    CLB_CRITICAL_SECTION();
+
+    stopTimer();
+    _stepsLeft = 0;
+    *_tccra = 0;
+    *_tccrb = 0;
+    *_ddr &= ~_pinMask;
+}
+
+void clb::Stepper::setMaxSpeed(float stepsPerSecond) { _maxSpeed = stepsPerSecond; }
+
+void clb::Stepper::setAcceleration(float stepsPerSecond2) { _acceleration = stepsPerSecond2; }
+
+void clb::Stepper::setJerkSteps(uint16_t steps) { _jerkSetting = steps; }
+
+void clb::Stepper::setPulseWidth(uint16_t ticks) { _pulseWidth = ticks; }
+
+//works out the first period and the ramp constants of a move, only touches the ramp state so the axis must be stopped
+bool clb::Stepper::planMove(int32_t steps, float stepsPerSecond, float stepsPerSecond2, uint16_t jerkSteps) {
+    if (_tickRate == 0) {
+        CRITICAL("Stepper::begin() must be called before a move");
+        return false;
+    }
+    if (stepsPerSecond <= 0 || stepsPerSecond2 <= 0) {
+        CRITICAL("Stepper speed and acceleration must be above 0");
+        return false;
+    }
+
+    float _cruise = _tickRate / stepsPerSecond;
+    if (_cruise <= _pulseWidth + 1) {
+        CRITICAL("Stepper speed too high for the clock and pulse width, the period must be longer than the pulse");
+        return false;
+    }
+    if (_cruise > 65535.0f) {
+        _cruise = 65535.0f; //slowest speed the 16 bit period allows
+    }
+
+    //Eiderman's first period from standstill, p1 = F / sqrt(2a), at which R * p^2 = 1/2
+    float _first = _tickRate / sqrtf(2.0f * stepsPerSecond2);
+    if (_first > 65535.0f) {
+        _first = 65535.0f;
+    }
+    if (_first < _cruise) {
+        _first = _cruise;
+    }
+
+    float _scaled = stepsPerSecond2 / (_tickRate * _tickRate) * s_rate_scale; //R * 2^48
+    if (_scaled > 4294967295.0f) {
+        CRITICAL("Stepper acceleration too high for the clock, use a slower clock");
+        return false;
+    }
+    if (_scaled < 1.0f) {
+        _scaled = 1.0f;
+    }
+
+    _direction = (steps < 0) ? -1 : 1;
+    _stepsLeft = (steps < 0) ? -(uint32_t)steps : (uint32_t)steps;
+    _rampSteps = 0;
+    _stepPeriod = (uint16_t)_first;
+    _minPeriod = (uint16_t)_cruise;
+    _phase = (_stepPeriod <= _minPeriod) ? TPhase::CRUISE : TPhase::ACCEL;
+    _jerkSteps = jerkSteps;
+    if (jerkSteps == 0) {
+        _rate = (uint32_t)_scaled;
+        _rateStep = 0;
+    }
+    else {
+        _rateStep = (uint32_t)(_scaled / jerkSteps);
+        _rate = 0; //the ISR adds _rateStep before every ramp step, so the first one already accelerates
+    }
+    return true;
+}
+
+void clb::Stepper::startMove() {
+    *_tccrb &= ~((BIT0 << CS12) | (BIT0 << CS11) | (BIT0 << CS10));
+    *_tccra = (BIT0 << COM1B1);
+    *_tccrc = (BIT0 << FOC1B);
+    *_tcnt = 0;
+    *_ocra = _stepPeriod - 1;
+    *_ocrb = _pulseWidth;
+    *_tifr = (BIT0 << OCF1A);
+    *_timsk |= (BIT0 << OCIE1A);
+    _running = true;
+}
+
+bool clb::Stepper::move(int32_t steps) {
+    if (_running) {
+        WARNING("Stepper::move() called while a move is running");
+        return false;
+    }
+    if (steps == 0) {
+        return true;
+    }
+    if (!planMove(steps, _maxSpeed, _acceleration, _jerkSetting)) {
+        return false;
+    }
+    digitalWrite(_directionPin, (steps < 0) ? HIGH : LOW);
+
+    CLB_CRITICAL_SECTION();
+    startMove();
+    *_tccrb = (BIT0 << WGM12) | _clockBits;
+    return true;
+}
+
+bool clb::Stepper::moveTo(int32_t position) { return move(position - this->position()); }
+
+void clb::Stepper::stop() {
+    CLB_CRITICAL_SECTION();
+    if (_running && _stepsLeft > _rampSteps) {
+        _stepsLeft = _rampSteps; //the ISR starts decelerating on the next step
+    }
+}
+
+void clb::Stepper::halt() {
+    CLB_CRITICAL_SECTION();
+    stopTimer();
+    _stepsLeft = 0;
+}
+
+bool clb::Stepper::isRunning() { return _running; }
+
+int32_t clb::Stepper::position() {
+    CLB_CRITICAL_SECTION();
+    int32_t _current = _position;
+    return _current;
+}
+
+void clb::Stepper::setPosition(int32_t position) {
+    if (_running) {
+        CRITICAL("Stepper::setPosition() called while running");
+        return;
+    }
+    CLB_CRITICAL_SECTION();
+    _position = position;
+}
+
+uint16_t clb::Stepper::maxIsrCycles() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _cycles = _maxIsrCycles;
+    return _cycles;
+}
+
+void clb::Stepper::resetMaxIsrCycles() {
+    CLB_CRITICAL_SECTION();
+    _maxIsrCycles = 0;
+}
+
+bool clb::Stepper::moveLinear(clb::Stepper* const* axes, const int32_t* steps, uint8_t count, float stepsPerSecond,
+                              float stepsPerSecond2) {
+    if (count == 0 || count > 4) {
+        CRITICAL("Stepper::moveLinear() takes 1 to 4 axes");
+        return false;
+    }
+
+    uint32_t _longest = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (axes[i]->_running) {
+            WARNING("Stepper::moveLinear() called while an axis is running");
+            return false;
+        }
+        if (axes[i]->_clockBits != axes[0]->_clockBits) {
+            CRITICAL("Stepper::moveLinear() needs all axes on the same clock");
+            return false;
+        }
+        uint32_t _distance = (steps[i] < 0) ? -(uint32_t)steps[i] : (uint32_t)steps[i];
+        if (_distance > _longest) {
+            _longest = _distance;
+        }
+    }
+    if (_longest == 0) {
+        return true;
+    }
+
+    //same profile shape on every axis, scaled by its share of the longest move
+    for (uint8_t i = 0; i < count; i++) {
+        if (steps[i] == 0) {
+            continue;
+        }
+        uint32_t _distance = (steps[i] < 0) ? -(uint32_t)steps[i] : (uint32_t)steps[i];
+        float _share = (float)_distance / _longest;
+        uint16_t _jerk = (uint16_t)(axes[i]->_jerkSetting * _share);
+        if (axes[i]->_jerkSetting != 0 && _jerk == 0) {
+            _jerk = 1;
+        }
+        if (!axes[i]->planMove(steps[i], stepsPerSecond * _share, stepsPerSecond2 * _share, _jerk)) {
+            return false;
+        }
+        digitalWrite(axes[i]->_directionPin, (steps[i] < 0) ? HIGH : LOW);
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    for (uint8_t i = 0; i < count; i++) {
+        if (steps[i] != 0) {
+            axes[i]->startMove();
+        }
+    }
+    //hold the prescaler so the prescaled timers start counting on the same clock edge. DIV_1 bypasses the prescaler, those
+    //axes start as their TCCRnB is written, a few cycles apart
+    uint8_t _gtccr = GTCCR; //a hold the caller already has on the prescalers stays in place
+    GTCCR = _gtccr | (BIT0 << TSM) | (BIT0 << PSRSYNC);
+    for (uint8_t i = 0; i < count; i++) {
+        if (steps[i] != 0) {
+            *axes[i]->_tccrb = (BIT0 << WGM12) | axes[i]->_clockBits;
+        }
+    }
+    GTCCR = _gtccr;
+    return true;
+}
@@ -0,0 +1,224 @@
+#ifndef CLBSTEPPER_H
+#define CLBSTEPPER_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+#include "clbCriticalSection.h"
+#ifdef CLB_ENABLE_STEPPER_PROFILE
+#include "clbCycleClock.h"
+#endif
+
+/* STEPPER MOTION ENGINE
+ *
+ * Runs one step/dir driver per 16 bit timer, axis1() on Timer1 up to axis5() on Timer5. The timer runs in CTC mode with
+ * TOP = OCRnA = the current step period, every compare match A ISR starts one step pulse on OCnB by forcing the pin high and
+ * the hardware clears it again at OCRnB (the pulse width). The step pins are OC1B (pin 12), OC3B (pin 2), OC4B (pin 7) and
+ * OC5B (pin 45), the direction pin is any digital pin.
+ *
+ * The ramp uses the multiply only recurrence from Eiderman's "Real time stepper motor linear ramping just by addition and
+ * multiplication": with p the period in timer ticks, F the timer clock and a the acceleration in steps/s^2
+ *
+ *     accelerating   p' = p * (1 - R * p^2)        R = a / F^2
+ *     decelerating   p' = p * (1 + R * p^2)
+ *
+ * R is kept as R * 2^48 in 32 bits, so a step costs four 16x16 bit multiplications and no division or float. Moves are
+ * planned in the main context (that part uses float), the ISR only runs the recurrence. It counts the steps spent
+ * accelerating and starts decelerating once the steps left reach that count, so short moves turn into a triangle.
+ *
+ * With setJerkSteps() the acceleration is ramped in linearly over the first steps from standstill and out again over the
+ * last ones, which rounds off the start and the end of the move (S-curve ends). The corners into and out of cruise stay
+ * sharp.
+ *
+ * ISR cost: the ISR has no loops, its longest path is one ramp step on an accelerating or decelerating axis. Define
+ * CLB_ENABLE_STEPPER_PROFILE to measure it, maxIsrCycles() then returns the longest ISR seen, timed with the cycle clock.
+ * The step period has to stay above that time plus whatever else runs in interrupts, and the pulse width has to be longer
+ * than the ISR entry latency (the ISR checks and ends a pulse that missed its clear itself).
+ *
+ * moveLinear() coordinates up to four axes: every axis gets the speed and acceleration scaled by its share of the longest
+ * distance so all of them ramp and arrive together. The timers are started with GTCCR TSM holding the prescaler, so axes
+ * on a prescaled clock start on the same clock edge. DIV_1 bypasses the prescaler and TSM doesnt hold it, axes at DIV_1 start
+ * in turn as their TCCRnB is written, about 10 cycles apart, which is below 1 us at 16 MHz and not made up for. While TSM is
+ * set Timer0 stops for a few cycles too.
+ *
+ * Every axis takes over its whole timer (claimed with CLB_CLAIM_TIMER, see clbResource.h). With CLB_ENABLE_STEPPER_PROFILE
+ * the cycle clock needs one of the timers as well (Timer5 by default), so that axis isnt available then.
+ */
+
+namespace clb {
+    class Stepper {
+        public:
+            static Stepper& axis1(); //step on OC1B, pin 12 on the Mega
+            static Stepper& axis3(); //step on OC3B, pin 2 on the Mega
+            static Stepper& axis4(); //step on OC4B, pin 7 on the Mega
+            static Stepper& axis5(); //step on OC5B, pin 45 on the Mega
+
+            void begin(TSyncClock clock, uint8_t directionPin); //powers up the timer, sets CTC mode and makes both pins outputs
+            void end(); //stops any move and the timer
+
+            void setMaxSpeed(float stepsPerSecond); //cruise speed, limited to what a 16 bit period allows with the clock
+            void setAcceleration(float stepsPerSecond2);
+            void setJerkSteps(uint16_t steps); //steps over which the acceleration ramps in and out, 0 for a plain trapezoid
+            void setPulseWidth(uint16_t ticks); //step pulse high time in timer ticks, must be longer than the ISR entry latency
+
+            bool move(int32_t steps); //relative move, returns false if a move is running or the settings are out of range
+            bool moveTo(int32_t position); //absolute move
+            void stop(); //decelerates to a stop
+            void halt(); //stops immediately, no deceleration
+
+            bool isRunning();
+            int32_t position(); //steps done since begin() or setPosition(), counted in the ISR
+            void setPosition(int32_t position); //only while stopped
+
+            uint16_t maxIsrCycles(); //longest ISR seen, needs CLB_ENABLE_STEPPER_PROFILE, returns 0 otherwise
+            void resetMaxIsrCycles();
+
+            //moves up to four axes in a straight line so they all arrive at the same time, speed and acceleration are for the
+            //axis with the longest move. Returns false if any axis is running or a setting is out of range.
+            static bool moveLinear(Stepper* const* axes, const int32_t* steps, uint8_t count, float stepsPerSecond,
+                                   float stepsPerSecond2);
+
+            //called from the compare match ISR, dont call it yourself
+            inline __attribute__((always_inline)) void onCompareMatch(volatile uint8_t& tccra, volatile uint8_t& tccrc,
+                                                                      volatile uint16_t& tcnt, volatile uint16_t& ocra,
+                                                                      volatile uint16_t& ocrb) {
+#ifdef CLB_ENABLE_STEPPER_PROFILE
+                uint16_t _start = clb::CycleClock::now16();
+#endif
+                if (_stepsLeft == 0) {
+                    stopTimer();
+                    return;
+                }
+
+                //pulse first so it starts with the least jitter, COMnB bits are in the same place on all 16 bit timers
+                tccra = (BIT0 << COM1B1) | (BIT0 << COM1B0);
+                tccrc = (BIT0 << FOC1B);
+                tccra = (BIT0 << COM1B1);
+                if (tcnt >= ocrb) {
+                    tccrc = (BIT0 << FOC1B); //the ISR ran late and missed the clear at OCRnB, end the pulse here
+                }
+
+                _position += _direction;
+                uint32_t _left = _stepsLeft - 1;
+                _stepsLeft = _left;
+
+                uint16_t _period = _stepPeriod;
+                switch (_phase) {
+                    case TPhase::ACCEL:
+                        if (_left <= _rampSteps) {
+                            _phase = TPhase::DECEL;
+                            break;
+                        }
+                        _rampSteps++;
+                        if (_rampSteps <= _jerkSteps) {
+                            _rate += _rateStep;
+                        }
+                        _period -= rampDelta(_period, _rate);
+                        if (_period <= _minPeriod) {
+                            _period = _minPeriod;
+                            _phase = TPhase::CRUISE;
+                        }
+                        break;
+                    case TPhase::CRUISE:
+                        if (_left <= _rampSteps) {
+                            _phase = TPhase::DECEL;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+                if (_phase == TPhase::DECEL && _rampSteps != 0) {
+                    uint16_t _delta = rampDelta(_period, _rate);
+                    _period = (_period > 0xFFFF - _delta) ? 0xFFFF : _period + _delta;
+                    if (_rampSteps <= _jerkSteps) {
+                        _rate -= _rateStep;
+                    }
+                    _rampSteps--;
+                }
+                _stepPeriod = _period;
+                ocra = _period - 1;
+
+#ifdef CLB_ENABLE_STEPPER_PROFILE
+                uint16_t _cycles = clb::CycleClock::now16() - _start;
+                if (_cycles > _maxIsrCycles) {
+                    _maxIsrCycles = _cycles;
+                }
+#endif
+            }
+        private:
+            enum class TPhase : uint8_t {
+                ACCEL = 0,
+                CRUISE = 1,
+                DECEL = 2
+            };
+
+            Stepper(volatile uint8_t* tccra, volatile uint8_t* tccrb, volatile uint8_t* tccrc, volatile uint16_t* tcnt,
+                    volatile uint16_t* ocra, volatile uint16_t* ocrb, volatile uint8_t* timsk, volatile uint8_t* tifr,
+                    volatile uint8_t* prr, uint8_t prrBit, volatile uint8_t* ddr, uint8_t pinBit);
+            Stepper(const Stepper&) = delete;
+            Stepper& operator=(const Stepper&) = delete;
+
+            //R * p^2 * p in timer ticks, rate is R * 2^48. Four 16x16 bit multiplications, the lowest partial product of the
+            //32x32 one is dropped, it only moves the result by less than one tick
+            static inline __attribute__((always_inline)) uint16_t rampDelta(uint16_t period, uint32_t rate) {
+                uint32_t _square = (uint32_t)period * period;
+                uint16_t _sh = _square >> 16, _sl = _square & 0xFFFF;
+                uint16_t _rh = rate >> 16, _rl = rate & 0xFFFF;
+                uint32_t _q = (uint32_t)_sh * _rh + (((uint32_t)_sh * _rl) >> 16) + (((uint32_t)_sl * _rh) >> 16); //R * p^2 * 2^16
+                if (_q > 0xFFFF) {
+                    _q = 0xFFFF; //R * p^2 has to stay below 1, only possible with a far too slow first step
+                }
+                return ((uint32_t)period * (uint16_t)_q) >> 16;
+            }
+
+            //stops the clock and the interrupt with the step pin low, interrupts must be off
+            inline __attribute__((always_inline)) void stopTimer() {
+                *_tccrb &= ~((BIT0 << CS12) | (BIT0 << CS11) | (BIT0 << CS10));
+                *_timsk &= ~(BIT0 << OCIE1A);
+                _running = false;
+            }
+
+            bool planMove(int32_t steps, float stepsPerSecond, float stepsPerSecond2, uint16_t jerkSteps);
+            void startMove(); //loads the planned move into the timer, interrupts must be off
+
+            volatile uint8_t* const _tccra;
+            volatile uint8_t* const _tccrb;
+            volatile uint8_t* const _tccrc;
+            volatile uint16_t* const _tcnt;
+            volatile uint16_t* const _ocra;
+            volatile uint16_t* const _ocrb;
+            volatile uint8_t* const _timsk;
+            volatile uint8_t* const _tifr;
+            volatile uint8_t* const _prr;
+            const uint8_t _prrBit;
+            volatile uint8_t* const _ddr;
+            const uint8_t _pinMask;
+
+            uint8_t _directionPin = 0xFF;
+            uint8_t _clockBits = 0;
+            float _tickRate = 0; //timer clock in Hz
+            float _maxSpeed = 1000;
+            float _acceleration = 1000;
+            uint16_t _jerkSetting = 0;
+            uint16_t _pulseWidth = 20;
+
+            //ramp state, written by the ISR while running
+            volatile bool _running = false;
+            volatile int32_t _position = 0;
+            int8_t _direction = 1;
+            TPhase _phase = TPhase::ACCEL;
+            uint32_t _stepsLeft = 0;
+            uint32_t _rampSteps = 0; //steps spent accelerating so far, counted down again while decelerating
+            uint16_t _stepPeriod = 0; //current step period in ticks
+            uint16_t _minPeriod = 0;
+            uint16_t _jerkSteps = 0;
+            uint32_t _rate = 0; //R * 2^48
+            uint32_t _rateStep = 0; //added to _rate per step while the acceleration ramps in
+            volatile uint16_t _maxIsrCycles = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,17 @@
+#include "clbStepper.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(1);
+
+static clb::Stepper* s_stepper1 = nullptr;
+
+//only enabled by a move, so the pointer is always set here
+ISR(TIMER1_COMPA_vect) {
+    s_stepper1->onCompareMatch(TCCR1A, TCCR1C, TCNT1, OCR1A, OCR1B);
+}
+
+clb::Stepper& clb::Stepper::axis1() {
+    static clb::Stepper s_axis(&TCCR1A, &TCCR1B, &TCCR1C, &TCNT1, &OCR1A, &OCR1B, &TIMSK1, &TIFR1, &PRR0, PRTIM1, &DDRB, PB6);
+    s_stepper1 = &s_axis;
+    return s_axis;
+}
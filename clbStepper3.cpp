@@ -0,0 +1,17 @@
+#include "clbStepper.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(3);
+
+static clb::Stepper* s_stepper3 = nullptr;
+
+//only enabled by a move, so the pointer is always set here
+ISR(TIMER3_COMPA_vect) {
+    s_stepper3->onCompareMatch(TCCR3A, TCCR3C, TCNT3, OCR3A, OCR3B);
+}
+
+clb::Stepper& clb::Stepper::axis3() {
+    static clb::Stepper s_axis(&TCCR3A, &TCCR3B, &TCCR3C, &TCNT3, &OCR3A, &OCR3B, &TIMSK3, &TIFR3, &PRR1, PRTIM3, &DDRE, PE4);
+    s_stepper3 = &s_axis;
+    return s_axis;
+}
@@ -0,0 +1,17 @@
+#include "clbStepper.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(4);
+
+static clb::Stepper* s_stepper4 = nullptr;
+
+//only enabled by a move, so the pointer is always set here
+ISR(TIMER4_COMPA_vect) {
+    s_stepper4->onCompareMatch(TCCR4A, TCCR4C, TCNT4, OCR4A, OCR4B);
+}
+
+clb::Stepper& clb::Stepper::axis4() {
+    static clb::Stepper s_axis(&TCCR4A, &TCCR4B, &TCCR4C, &TCNT4, &OCR4A, &OCR4B, &TIMSK4, &TIFR4, &PRR1, PRTIM4, &DDRH, PH4);
+    s_stepper4 = &s_axis;
+    return s_axis;
+}
@@ -0,0 +1,17 @@
+#include "clbStepper.h"
+#include "clbResource.h"
+
+CLB_CLAIM_TIMER(5);
+
+static clb::Stepper* s_stepper5 = nullptr;
+
+//only enabled by a move, so the pointer is always set here
+ISR(TIMER5_COMPA_vect) {
+    s_stepper5->onCompareMatch(TCCR5A, TCCR5C, TCNT5, OCR5A, OCR5B);
+}
+
+clb::Stepper& clb::Stepper::axis5() {
+    static clb::Stepper s_axis(&TCCR5A, &TCCR5B, &TCCR5C, &TCNT5, &OCR5A, &OCR5B, &TIMSK5, &TIFR5, &PRR1, PRTIM5, &DDRL, PL4);
+    s_stepper5 = &s_axis;
+    return s_axis;
+}
@@ -0,0 +1,264 @@
+#include "clbTelemetry.h"
+#include "clbTrace.h"
+
+#if (CLB_TELEMETRY_BUFFER_SIZE & (CLB_TELEMETRY_BUFFER_SIZE - 1)) != 0 || CLB_TELEMETRY_BUFFER_SIZE < 256
+#error "CLB_TELEMETRY_BUFFER_SIZE must be a power of 2 and at least 256"
+#endif
+
+//the bit positions in UCSRnA/B/C are the same on all four USARTs
+#if CLB_TELEMETRY_USART == 1
+#define CLB_TELEMETRY_UCSRA UCSR1A
+#define CLB_TELEMETRY_UCSRB UCSR1B
+#define CLB_TELEMETRY_UCSRC UCSR1C
+#define CLB_TELEMETRY_UBRR UBRR1
+#define CLB_TELEMETRY_UDR UDR1
+#define CLB_TELEMETRY_PRR PRR1
+#define CLB_TELEMETRY_PRUSART PRUSART1
+#define CLB_TELEMETRY_UDRE_VECT USART1_UDRE_vect
+#elif CLB_TELEMETRY_USART == 2
+#define CLB_TELEMETRY_UCSRA UCSR2A
+#define CLB_TELEMETRY_UCSRB UCSR2B
+#define CLB_TELEMETRY_UCSRC UCSR2C
+#define CLB_TELEMETRY_UBRR UBRR2
+#define CLB_TELEMETRY_UDR UDR2
+#define CLB_TELEMETRY_PRR PRR1
+#define CLB_TELEMETRY_PRUSART PRUSART2
+#define CLB_TELEMETRY_UDRE_VECT USART2_UDRE_vect
+#elif CLB_TELEMETRY_USART == 3
+#define CLB_TELEMETRY_UCSRA UCSR3A
+#define CLB_TELEMETRY_UCSRB UCSR3B
+#define CLB_TELEMETRY_UCSRC UCSR3C
+#define CLB_TELEMETRY_UBRR UBRR3
+#define CLB_TELEMETRY_UDR UDR3
+#define CLB_TELEMETRY_PRR PRR1
+#define CLB_TELEMETRY_PRUSART PRUSART3
+#define CLB_TELEMETRY_UDRE_VECT USART3_UDRE_vect
+#else
+#error "CLB_TELEMETRY_USART must be 1, 2 or 3, Serial owns USART0"
+#endif
+
+#if CLB_TELEMETRY_CAPTURE_BATCH * 2 > CLB_TELEMETRY_MAX_PAYLOAD || CLB_TELEMETRY_CAPTURE_BATCH == 0
+#error "CLB_TELEMETRY_CAPTURE_BATCH must be 1 to 125"
+#endif
+
+#define CLB_TELEMETRY_MASK (CLB_TELEMETRY_BUFFER_SIZE - 1)
+
+static uint8_t s_telemetry_ring[CLB_TELEMETRY_BUFFER_SIZE];
+
+static struct TelemetryState {
+    volatile uint16_t head = 0; //end of the bytes released to the ISR
+    uint16_t reserved = 0; //end of the bytes reserved by send()
+    volatile uint16_t tail = 0; //next byte for UDRn
+    uint8_t writers = 0; //send() calls encoding right now, nested ones from ISRs included
+    uint8_t sequence[static_cast<uint8_t>(clb::TTelemetryStream::COUNT)] = {0, 0, 0, 0};
+    uint16_t dropped = 0;
+    uint16_t captures[CLB_TELEMETRY_CAPTURE_BATCH];
+    uint8_t captureCount = 0;
+} s_telemetry;
+
+//COBS encoder writing straight into the ring, code is the slot of the pending code byte and run the count it will get
+struct TelemetryEncoder {
+    uint16_t code;
+    uint16_t position;
+    uint8_t run;
+    uint16_t crc;
+};
+
+static inline __attribute__((always_inline)) void encodeByte(TelemetryEncoder& encoder, uint8_t value) {
+    if (value == 0) {
+        s_telemetry_ring[encoder.code] = encoder.run;
+        encoder.code = encoder.position;
+        encoder.run = 1;
+    }
+    else {
+        s_telemetry_ring[encoder.position] = value;
+        encoder.run++;
+    }
+    encoder.position = (encoder.position + 1) & CLB_TELEMETRY_MASK;
+}
+
+//CRC-16/CCITT-FALSE one byte at a time without a table
+static inline __attribute__((always_inline)) void encodeChecked(TelemetryEncoder& encoder, uint8_t value) {
+    uint8_t _x = (encoder.crc >> 8) ^ value;
+    _x ^= _x >> 4;
+    encoder.crc = (encoder.crc << 8) ^ ((uint16_t)_x << 12) ^ ((uint16_t)_x << 5) ^ _x;
+    encodeByte(encoder, value);
+}
+
+//only enabled while released bytes are waiting
+ISR(CLB_TELEMETRY_UDRE_VECT) {
+    uint16_t _tail = s_telemetry.tail;
+    CLB_TELEMETRY_UDR = s_telemetry_ring[_tail];
+    _tail = (_tail + 1) & CLB_TELEMETRY_MASK;
+    s_telemetry.tail = _tail;
+    if (_tail == s_telemetry.head) {
+        CLB_TELEMETRY_UCSRB &= ~(BIT0 << UDRIE0);
+    }
+}
+
+bool clb::Telemetry::begin(uint32_t baud) {
+    if (baud == 0) {
+        CRITICAL("Telemetry::begin() baud rate out of range");
+        return false;
+    }
+    //U2Xn: baud = F_CPU / (8 * (UBRRn + 1))
+    uint32_t _divider = (F_CPU + 4 * baud) / (8 * baud);
+    if (_divider == 0 || _divider > 4096) {
+        CRITICAL("Telemetry::begin() baud rate out of range");
+        return false;
+    }
+    uint32_t _actual = F_CPU / (8 * _divider);
+    uint32_t _error = (_actual > baud) ? _actual - baud : baud - _actual;
+    if (_error * 50 > baud) {
+        CRITICAL("Telemetry::begin() baud rate more than 2% off at this F_CPU");
+        return false;
+    }
+
+    CLB_CRITICAL_SECTION();
+
+    CLB_TELEMETRY_PRR &= ~(BIT0 << CLB_TELEMETRY_PRUSART);
+    CLB_TELEMETRY_UCSRB = 0;
+    s_telemetry.head = 0;
+    s_telemetry.reserved = 0;
+    s_telemetry.tail = 0;
+    s_telemetry.writers = 0;
+    s_telemetry.dropped = 0;
+    s_telemetry.captureCount = 0;
+    for (uint8_t i = 0; i < static_cast<uint8_t>(clb::TTelemetryStream::COUNT); i++) {
+        s_telemetry.sequence[i] = 0;
+    }
+
+    CLB_TELEMETRY_UBRR = (uint16_t)(_divider - 1);
+    CLB_TELEMETRY_UCSRA = (BIT0 << U2X0);
+    CLB_TELEMETRY_UCSRC = (BIT0 << UCSZ01) | (BIT0 << UCSZ00); //8N1
+    CLB_TELEMETRY_UCSRB = (BIT0 << TXEN0);
+    return true;
+}
+
+void clb::Telemetry::end() {
+    flush();
+    //the last byte leaves UDRn for the shift register and then takes 10 bit times, TXCn cant tell as nothing clears it per frame
+    while (!(CLB_TELEMETRY_UCSRA & (BIT0 << UDRE0))) { }
+    delayMicroseconds((80UL * (CLB_TELEMETRY_UBRR + 1)) / (F_CPU / 1000000UL) + 1);
+    CLB_CRITICAL_SECTION();
+    CLB_TELEMETRY_UCSRB = 0;
+}
+
+bool clb::Telemetry::send(clb::TTelemetryStream stream, const void* payload, uint8_t length) {
+    uint8_t _stream = static_cast<uint8_t>(stream);
+    if (_stream >= static_cast<uint8_t>(clb::TTelemetryStream::COUNT) || length > CLB_TELEMETRY_MAX_PAYLOAD) {
+        return false; //no CRITICAL, send() is called from ISRs
+    }
+    uint16_t _size = length + CLB_TELEMETRY_OVERHEAD;
+    uint16_t _start;
+    uint8_t _sequence;
+    {
+        CLB_CRITICAL_SECTION();
+        _sequence = s_telemetry.sequence[_stream]++;
+        uint16_t _used = (s_telemetry.reserved - s_telemetry.tail) & CLB_TELEMETRY_MASK;
+        if (_used + _size > CLB_TELEMETRY_BUFFER_SIZE - 1) {
+            if (s_telemetry.dropped != 0xFFFF) {
+                s_telemetry.dropped++;
+            }
+            return false;
+        }
+        _start = s_telemetry.reserved;
+        s_telemetry.reserved = (_start + _size) & CLB_TELEMETRY_MASK;
+        s_telemetry.writers++;
+    }
+
+    //the frame has at most 254 bytes, so it is one COBS block: the code bytes replace the zeros and one leads
+    TelemetryEncoder _encoder = { _start, (uint16_t)((_start + 1) & CLB_TELEMETRY_MASK), 1, 0xFFFF };
+    encodeChecked(_encoder, _stream);
+    encodeChecked(_encoder, _sequence);
+    const uint8_t* _bytes = static_cast<const uint8_t*>(payload);
+    for (uint8_t i = 0; i < length; i++) {
+        encodeChecked(_encoder, _bytes[i]);
+    }
+    uint16_t _crc = _encoder.crc;
+    encodeByte(_encoder, _crc & 0xFF);
+    encodeByte(_encoder, _crc >> 8);
+    s_telemetry_ring[_encoder.code] = _encoder.run;
+    s_telemetry_ring[_encoder.position] = 0;
+
+    CLB_CRITICAL_SECTION();
+    //frames reserved by ISRs inside this one are done by now, they are released together
+    if (--s_telemetry.writers == 0) {
+        s_telemetry.head = s_telemetry.reserved;
+        if (s_telemetry.head != s_telemetry.tail) {
+            CLB_TELEMETRY_UCSRB |= (BIT0 << UDRIE0);
+        }
+    }
+    return true;
+}
+
+void clb::Telemetry::sendAdcBlock(const uint16_t* samples, uint16_t length) {
+    const uint16_t _perFrame = (CLB_TELEMETRY_MAX_PAYLOAD / 2) & ~3; //124, a multiple of the common scan lengths 1, 2 and 4
+    while (length != 0) {
+        uint16_t _count = (length > _perFrame) ? _perFrame : length;
+        send(clb::TTelemetryStream::ANALOG, samples, _count * 2); //little endian in memory already
+        samples += _count;
+        length -= _count;
+    }
+}
+
+void clb::Telemetry::recordCapture(uint16_t value) {
+    uint16_t _batch[CLB_TELEMETRY_CAPTURE_BATCH];
+    {
+        CLB_CRITICAL_SECTION();
+        s_telemetry.captures[s_telemetry.captureCount++] = value;
+        if (s_telemetry.captureCount < CLB_TELEMETRY_CAPTURE_BATCH) {
+            return;
+        }
+        for (uint8_t i = 0; i < CLB_TELEMETRY_CAPTURE_BATCH; i++) {
+            _batch[i] = s_telemetry.captures[i];
+        }
+        s_telemetry.captureCount = 0;
+    }
+    send(clb::TTelemetryStream::CAPTURE, _batch, sizeof(_batch));
+}
+
+uint8_t clb::Telemetry::sendTrace(uint8_t maxRecords) {
+    const uint8_t _perFrame = CLB_TELEMETRY_MAX_PAYLOAD / 8;
+    uint8_t _payload[_perFrame * 8];
+    uint8_t _frame[CLB_TRACE_FRAME_SIZE];
+    clb::TraceRecord _record;
+    uint8_t _sent = 0;
+    while (_sent < maxRecords) {
+        uint8_t _count = 0;
+        while (_count < _perFrame && _sent + _count < maxRecords && clb::Trace::read(_record)) {
+            clb::Trace::encodeFrame(_record, _frame);
+            for (uint8_t i = 0; i < 8; i++) {
+                _payload[_count * 8 + i] = _frame[1 + i]; //without the sync byte and the crc8
+            }
+            _count++;
+        }
+        if (_count == 0) {
+            break;
+        }
+        send(clb::TTelemetryStream::TRACE, _payload, _count * 8);
+        _sent += _count;
+    }
+    return _sent;
+}
+
+uint16_t clb::Telemetry::pending() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _pending = (s_telemetry.head - s_telemetry.tail) & CLB_TELEMETRY_MASK;
+    return _pending;
+}
+
+uint16_t clb::Telemetry::dropped() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _dropped = s_telemetry.dropped;
+    return _dropped;
+}
+
+void clb::Telemetry::resetDropped() {
+    CLB_CRITICAL_SECTION();
+    s_telemetry.dropped = 0;
+}
+
+void clb::Telemetry::flush() {
+    while (pending() != 0) { }
+}
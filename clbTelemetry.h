@@ -0,0 +1,86 @@
+#ifndef CLBTELEMETRY_H
+#define CLBTELEMETRY_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbCriticalSection.h"
+
+/* BINARY TELEMETRY STREAM
+ *
+ * Sends ADC blocks, input capture values, trace records and user data over a USART as binary frames, at 1 or 2 Mbaud,
+ * from a ring buffer drained by the data register empty ISR. Nothing waits for the UART: send() encodes the frame into the
+ * ring and returns, the ISR writes one byte into UDRn per interrupt.
+ *
+ *     clb::Telemetry::begin(2000000);
+ *     clb::Adc::begin(clb::TAdcTrigger::TIMER1_CAPTURE, 40000, s_scan, 4, s_samples, 256, clb::Telemetry::sendAdcBlock,
+ *                     clb::TAdcReference::AVCC);
+ *
+ * Frame layout, before encoding (little endian):
+ *   stream | sequence | payload (0 to CLB_TELEMETRY_MAX_PAYLOAD bytes) | crc16 of everything before it
+ * crc16 is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF). The frame is COBS encoded, so it has no 0x00 inside, and ends
+ * with a 0x00 delimiter: a receiver resyncs at the next 0x00 after any error. The encoded frame is the raw frame plus 2 bytes.
+ * sequence counts every frame send() was asked for, per stream. A frame that doesnt fit into the ring is dropped and
+ * counted by dropped(), the receiver sees the gap in the sequence.
+ *
+ * Payloads per stream:
+ *   ANALOG   ADC samples as uint16_t, a block from clb::Adc is split into frames of up to 124 samples
+ *   CAPTURE  uint16_t values batched by recordCapture(), CLB_TELEMETRY_CAPTURE_BATCH per frame
+ *   TRACE    trace records of 8 bytes, the frame layout of clbTrace.h without sync and crc, up to 31 per frame
+ *   USER     anything
+ *
+ * send() is safe from ISRs and from the ADC callback: the space is reserved with interrupts off and the frame encoded with
+ * them on, so a long frame doesnt block other interrupts. A frame sent from an ISR that interrupts another send() is only
+ * released to the UART together with the one it interrupted.
+ *
+ * At 2 Mbaud (UBRRn = 0 with U2Xn at 16 MHz) the UART moves 200 kB/s. The ISR takes about 40 cycles per byte, so a
+ * saturated link costs about half the cpu, and encoding about 30 cycles per byte more. The module owns the USART and its
+ * ISR, so SerialN of CLB_TELEMETRY_USART cant be used at the same time. USART0 is out: CRITICAL and WARNING print through
+ * Serial, which links in the Arduino USART0 ISRs. Use a USB serial adapter that does 2 Mbaud (FTDI, CP2102N, CH340) on TXn.
+ * extras/clbTelemetryReceiver checks the frames on the host and measures the throughput.
+ */
+
+#ifndef CLB_TELEMETRY_USART
+#define CLB_TELEMETRY_USART 1 //USART 1..3 the stream goes out on, TX1 is pin 18 on the Mega
+#endif
+
+#ifndef CLB_TELEMETRY_BUFFER_SIZE
+#define CLB_TELEMETRY_BUFFER_SIZE 512 //bytes in the transmit ring, must be a power of 2 and at least 256
+#endif
+
+#ifndef CLB_TELEMETRY_CAPTURE_BATCH
+#define CLB_TELEMETRY_CAPTURE_BATCH 16 //capture values per frame
+#endif
+
+#define CLB_TELEMETRY_MAX_PAYLOAD 250 //largest payload, keeps every frame within one COBS block
+#define CLB_TELEMETRY_OVERHEAD 6 //bytes a frame adds on the wire: stream, sequence, crc16, COBS code and delimiter
+
+namespace clb {
+    //stream of a frame, the first byte before encoding
+    enum class TTelemetryStream : uint8_t {
+        ANALOG = 0, //ADC samples, ADC itself is the avr-libc register name
+        CAPTURE = 1,
+        TRACE = 2,
+        USER = 3,
+        COUNT = 4 //number of streams, not a stream
+    };
+
+    class Telemetry {
+        public:
+            static bool begin(uint32_t baud); //8N1 with U2Xn, false if the baud rate is more than 2% off
+            static void end(); //waits until the ring is sent and turns the transmitter off
+
+            static bool send(TTelemetryStream stream, const void* payload, uint8_t length); //queues one frame, false if it was dropped
+            static void sendAdcBlock(const uint16_t* samples, uint16_t length); //same signature as the clb::Adc callback
+            static void recordCapture(uint16_t value); //adds a value to the capture batch, sends it once it is full, safe from ISRs
+            static uint8_t sendTrace(uint8_t maxRecords = 255); //moves waiting clb::Trace records into frames, returns how many
+
+            static uint16_t pending(); //encoded bytes waiting for the UART
+            static uint16_t dropped(); //frames dropped because the ring was full, saturates at 0xFFFF
+            static void resetDropped();
+            static void flush(); //waits until the ring is empty, dont call it with interrupts off
+    };
+}
+
+#endif
@@ -1,4 +1,9 @@
 #include "clbTimer.h"
+#include "clbCriticalSection.h"
+#include "clbPreciseDelay.h"
+#ifdef CLB_ENABLE_CYCLE_CLOCK
+#include "clbCycleClock.h"
+#endif
 
 
 
@@ -13,67 +18,62 @@ void clb::Timer::deactivate() { CRITICAL("Timer superclass called deactivate():
 
 
 void clb::Timer::resetSynchronousPrescalers() { //reset the prescalers for timers 0, 1, 3, 4 and 5
-    cli();
     WARNING("Resetting synchronous prescalers will break delay(), millis() and micros() functions from Timer0");
-    
+
+    CLB_CRITICAL_SECTION();
+
     uint8_t _GTCCR = GTCCR; 
 
     _GTCCR &= ~(BIT0 << TSM);       
     _GTCCR |= (BIT0 << PSRSYNC); 
 
     GTCCR = _GTCCR;   
-    
-    sei();       
 }
 void clb::Timer::resetAsynchronousPrescalers() { //reset the prescaler for timer 2
-    cli();
     WARNING("Resetting asynchronous prescalers will break tone() and noTone() functions from Timer2");
-    
+
+    CLB_CRITICAL_SECTION();
+
     uint8_t _GTCCR = GTCCR; 
 
     _GTCCR &= ~(BIT0 << TSM);       
     _GTCCR |= (BIT0 << PSRASY);  
 
     GTCCR = _GTCCR;   
-    
-    sei();
 }
 void clb::Timer::resetAllPrescalers() { //reset all prescalers
-    cli();
     WARNING("Resetting all prescalers will break delay(), millis() and micros() functions from Timer0 and tone() and noTone() from Timer2");
-    
+
+    CLB_CRITICAL_SECTION();
+
     uint8_t _GTCCR = GTCCR;
 
     _GTCCR &= ~(BIT0 << TSM);      
     _GTCCR |= (BIT0 << PSRASY) | (BIT0 << PSRSYNC); 
 
     GTCCR = _GTCCR;
-    
-    sei();
 }
 void clb::Timer::startTimerSynchronization() { //start all timers in sync
-    cli();
     WARNING("Starting all timers in sync will break delay(), millis() and micros() functions from Timer0 and tone() and noTone() from Timer2");
-    
+
+    CLB_CRITICAL_SECTION();
+
     uint8_t _GTCCR = GTCCR; 
 
     _GTCCR |= (BIT0 << TSM | BIT0 << PSRASY | BIT0 << PSRSYNC);
     
     GTCCR = _GTCCR; 
-
-    sei();
 }
 void clb::Timer::stopTimerSynchronization() { //stop all timers in sync
-    cli();
     WARNING("Stopping all timers in sync will break delay(), millis() and micros() functions from Timer0 and tone() and noTone() from Timer2");
-    
+
+    CLB_CRITICAL_SECTION();
+
     uint8_t _GTCCR = GTCCR;
 
     _GTCCR &= ~(BIT0 << TSM);
     
     GTCCR = _GTCCR; 
-
-    sei();
 }
 
 //setup methods
@@ -109,6 +109,7 @@ void clb::Timer::startTimer() { CRITICAL("Timer superclass called startTimer():
 void clb::Timer::stopTimer() { CRITICAL("Timer superclass called stopTimer(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 uint8_t clb::Timer::getTimerValue8() { CRITICAL("Timer superclass called getTimerValue(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 uint16_t clb::Timer::getTimerValue16() { CRITICAL("Timer superclass called getTimerValue(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
+clb::TimerSnapshot clb::Timer::snapshot() { CRITICAL("Timer superclass called snapshot(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); return clb::TimerSnapshot(); }
 void clb::Timer::setTimerValue(uint8_t value) { CRITICAL("Timer superclass called setTimerValue(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::setTimerValue(uint16_t value) { CRITICAL("Timer superclass called setTimerValue(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::forceOutputCompareA() { CRITICAL("Timer superclass called forceOutputCompareA(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
@@ -119,11 +120,13 @@ void clb::Timer::forceOutputCompareC() { CRITICAL("Timer superclass called force
 
 
 void clb::Timer::setInterruptCallback(clb::TInterrupt8 type, void (*callback)()) { CRITICAL("Timer superclass called setInterruptCallback(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
+void clb::Timer::setInterruptActions(clb::TInterrupt8 type, const clb::Action* actions) { CRITICAL("Timer superclass called setInterruptActions(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::enableInterrupt(clb::TInterrupt8 type) { CRITICAL("Timer superclass called enableInterrupt(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::disableInterrupt(clb::TInterrupt8 type) { CRITICAL("Timer superclass called disableInterrupt(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 bool clb::Timer::getInterruptFlag(clb::TInterrupt8 type) { CRITICAL("Timer superclass called getInterruptFlag(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::clearInterruptFlag(clb::TInterrupt8 type) { CRITICAL("Timer superclass called clearInterruptFlag(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::setInterruptCallback(clb::TInterrupt16 type, void (*callback)()) { CRITICAL("Timer superclass called setInterruptCallback(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
+void clb::Timer::setInterruptActions(clb::TInterrupt16 type, const clb::Action* actions) { CRITICAL("Timer superclass called setInterruptActions(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::enableInterrupt(clb::TInterrupt16 type) { CRITICAL("Timer superclass called enableInterrupt(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::disableInterrupt(clb::TInterrupt16 type) { CRITICAL("Timer superclass called disableInterrupt(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 bool clb::Timer::getInterruptFlag(clb::TInterrupt16 type) { CRITICAL("Timer superclass called getInterruptFlag(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
@@ -140,17 +143,72 @@ void clb::Timer::inputCaptureEdgeSelect(bool rising) { CRITICAL("Timer superclas
 void clb::Timer::syncDelay(uint32_t time) { CRITICAL("Timer superclass called syncDelay(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::syncDelay(uint32_t time, clb::TTimeUnit timeUnit) { CRITICAL("Timer superclass called syncDelay(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::syncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutputChannel channel) { CRITICAL("Timer superclass called syncDelay(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
+void clb::Timer::setSyncDelayOverhead(uint16_t timerCycles, uint16_t loopCycles) { CRITICAL("Timer superclass called setSyncDelayOverhead(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
+
+#if defined(CLB_ENABLE_CYCLE_CLOCK) && defined(CLB_CYCLES_PER_US)
+//shortest of a few microsecond syncDelays in cpu cycles over what was asked for, the cost of reading the clock taken off
+static uint16_t measureSyncDelay(clb::Timer& timer, uint32_t us) {
+    uint32_t _read = 0xFFFFFFFFUL;
+    uint32_t _best = 0xFFFFFFFFUL;
+    for (uint8_t i = 0; i < 8; i++) {
+        uint32_t _start = clb::CycleClock::now32();
+        uint32_t _elapsed = clb::CycleClock::now32() - _start;
+        if (_elapsed < _read) {
+            _read = _elapsed;
+        }
+        _start = clb::CycleClock::now32();
+        timer.syncDelay(us, clb::TTimeUnit::MICROSECONDS, clb::TOutputChannel::A);
+        _elapsed = clb::CycleClock::now32() - _start;
+        if (_elapsed < _best) {
+            _best = _elapsed; //the shortest run is the one no interrupt got into
+        }
+    }
+    uint32_t _asked = us * CLB_CYCLES_PER_US + _read;
+    if (_best <= _asked) {
+        return 0;
+    }
+    return (_best - _asked > 0xFFFF) ? 0xFFFF : _best - _asked;
+}
+#endif
+
+uint16_t clb::Timer::calibrateSyncDelay() {
+#if defined(CLB_ENABLE_CYCLE_CLOCK) && defined(CLB_CYCLES_PER_US)
+    clb::CycleClock::begin();
+    setSyncDelayOverhead(0, 0);
+
+    //the timer path wait is a multiple of 1024 cycles so it is a whole number of ticks with any prescaler
+    uint32_t _timerUs = 1024UL * (CLB_SYNC_DELAY_LOOP_CYCLES / (1024UL * CLB_CYCLES_PER_US) + 1);
+    uint32_t _loopUs = CLB_SYNC_DELAY_LOOP_CYCLES / CLB_CYCLES_PER_US / 2;
+
+    uint16_t _timerCycles = measureSyncDelay(*this, _timerUs);
+    uint16_t _loopCycles = (_loopUs != 0) ? measureSyncDelay(*this, _loopUs) : 0;
+    setSyncDelayOverhead(_timerCycles, _loopCycles);
+    return _timerCycles;
+#else
+    CRITICAL("calibrateSyncDelay() needs the cycle clock (define CLB_ENABLE_STATS, CLB_ENABLE_TRACE or a profile option) and a whole MHz F_CPU");
+    return 0;
+#endif
+}
 
 
 //direct non blocking delay methods
 void clb::Timer::asyncDelay(uint32_t time) { CRITICAL("Timer superclass called asyncDelay(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit) { CRITICAL("Timer superclass called asyncDelay(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 void clb::Timer::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutputChannel channel) { CRITICAL("Timer superclass called asyncDelay(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
+void clb::Timer::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutputChannel channel, bool periodic) { CRITICAL("Timer superclass called asyncDelay(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
+uint32_t clb::Timer::remaining() { CRITICAL("Timer superclass called remaining(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); return 0; }
+uint32_t clb::Timer::remaining(clb::TOutputChannel channel) { CRITICAL("Timer superclass called remaining(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); return 0; }
 
 //async delay control methods
 bool clb::Timer::isAsyncDelayFinished() { CRITICAL("Timer superclass called isAsyncDelayFinished(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); } //returns true if the asynchronous delay is finished
 void clb::Timer::stopAsyncDelay() { CRITICAL("Timer superclass called stopAsyncDelay(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); } //stops the asynchronous delay
+bool clb::Timer::isAsyncDelayFinished(clb::TOutputChannel channel) { CRITICAL("Timer superclass called isAsyncDelayFinished(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); return true; }
+void clb::Timer::stopAsyncDelay(clb::TOutputChannel channel) { CRITICAL("Timer superclass called stopAsyncDelay(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
+
+//frequency synthesis methods
+clb::FrequencyPlan clb::Timer::setFrequency(float hz, clb::TOutputChannel channel) { CRITICAL("Timer superclass called setFrequency(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); return clb::frequency::none(0xFF); }
+void clb::Timer::setFrequency(const clb::FrequencyPlan& plan, clb::TOutputChannel channel) { CRITICAL("Timer superclass called setFrequency(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
 
 //delay logic methods
 void clb::Timer::syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) { CRITICAL("Timer superclass called syncDelayLogic(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
-void clb::Timer::asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) { CRITICAL("Timer superclass called asyncDelayLogic(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
\ No newline at end of file
+void clb::Timer::asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) { CRITICAL("Timer superclass called asyncDelayLogic(): Use clb::Timer::createTimer() to create a timer corresponding to one of the hardware timers 0-5"); }
\ No newline at end of file
@@ -41,6 +41,9 @@
 
 #include "clbBits.h"
 #include "clbException.h"
+#include "clbConfig.h"
+#include "clbAction.h"
+#include "clbFrequency.h"
 
 
 //short for ControlLib
@@ -152,13 +155,32 @@ namespace clb {
         B = 0b001, //OCRB
         C = 0b010  //OCRC if timer has it
     };
+    //interrupt vectors handled by the clb timer classes, used to index instrumentation data
+    enum class TVector : uint8_t {
+        TIMER0_COMPA = 0,
+        TIMER0_COMPB = 1,
+        TIMER0_OVF = 2,
+        TIMER1_COMPA = 3,
+        TIMER1_COMPB = 4,
+        TIMER1_COMPC = 5,
+        TIMER1_OVF = 6,
+        TIMER2_COMPA = 7,
+        TIMER2_COMPB = 8,
+        TIMER2_OVF = 9,
+        COUNT = 10 //number of vectors, not a vector
+    };
+    //consistent view of a timer taken by snapshot()
+    struct TimerSnapshot {
+        uint16_t counter; //TCNTn
+        uint8_t flags; //TIFRn
+        uint32_t overflows; //overflow interrupts so far, plus the one still pending when the counter was read
+        uint32_t ticks; //overflows * (TOP + 1) + counter, wraps at 2^32, only meaningful in normal and fast PWM modes
+    };
 
     //superclass implementation of a timer with direct register control
     class Timer { 
         protected:
             uint8_t _clockSource = 0;
-            volatile uint32_t _overflowCount = 0;
-            volatile uint32_t _overflowTarget = 0;
         public:
             Timer();
             virtual void deactivate() = 0; //deactivates the timer and resets the registers
@@ -195,6 +217,7 @@ namespace clb {
             virtual void stopTimer() = 0; //stops the timer
             virtual uint8_t getTimerValue8(); //returns the current value of the timer (8 bit)
             virtual uint16_t getTimerValue16(); //returns the current value of the timer (16 bit)
+            virtual TimerSnapshot snapshot(); //counter, flags and overflow count read together in one short interrupt lock
             virtual void setTimerValue(uint8_t value); //sets the timer value (8 bit), not a good idea to use since can cause a race condition if compare match was about to occur
             virtual void setTimerValue(uint16_t value); //sets the timer value (16 bit), not a good idea to use since can cause a race condition if compare match was about to occur
             virtual void forceOutputCompareA() = 0; //forces a compare match on OC0A
@@ -203,11 +226,13 @@ namespace clb {
 
             //interrupt control methods
             virtual void setInterruptCallback(TInterrupt8 type, void (*callback)()); //sets the callback for the interrupt (8 bit)
+            virtual void setInterruptActions(TInterrupt8 type, const Action* actions); //sets the PROGMEM action table run by the compare match interrupt (8 bit)
             virtual void enableInterrupt(TInterrupt8 type); //enables the interrupt for the timer (8 bit)
             virtual void disableInterrupt(TInterrupt8 type); //disables the interrupt for the timer (8 bit)
             virtual bool getInterruptFlag(TInterrupt8 type); //returns the interrupt flag for the timer (8 bit)
             virtual void clearInterruptFlag(TInterrupt8 type); //clears the interrupt flag for the timer (8 bit)
             virtual void setInterruptCallback(TInterrupt16 type, void (*callback)()); //sets the callback for the interrupt (16 bit)
+            virtual void setInterruptActions(TInterrupt16 type, const Action* actions); //sets the PROGMEM action table run by the compare match interrupt (16 bit)
             virtual void enableInterrupt(TInterrupt16 type); //enables the interrupt for the timer (16 bit)
             virtual void disableInterrupt(TInterrupt16 type); //disables the interrupt for the timer (16 bit)
             virtual bool getInterruptFlag(TInterrupt16 type); //returns the interrupt flag for the timer (16 bit)
@@ -221,25 +246,40 @@ namespace clb {
             virtual void syncDelay(uint32_t time) = 0; //delays for a specified time in milliseconds
             virtual void syncDelay(uint32_t time, TTimeUnit timeUnit) = 0; //delays for a specified time in seconds, milliseconds or microseconds
             virtual void syncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel) = 0; //delays for a specified time in seconds, milliseconds or microseconds on one of the compare registers (A, B or C)
+            virtual void setSyncDelayOverhead(uint16_t timerCycles, uint16_t loopCycles); //fixed cost in cpu cycles of a microsecond syncDelay on the timer and the counted loop path, taken off every wait
+            uint16_t calibrateSyncDelay(); //measures and sets the fixed costs with the cycle clock for the current clock, returns the timer path cost
         
             //direct non blocking delay methods
             virtual void asyncDelay(uint32_t time) = 0; //delays for a specified time in milliseconds, non-blocking
             virtual void asyncDelay(uint32_t time, TTimeUnit timeUnit) = 0; //delays for a specified time in seconds, milliseconds or microseconds, non-blocking
             virtual void asyncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel) = 0; //delays for a specified time in seconds, milliseconds or microseconds on one of the compare registers (A, B or C), non-blocking
+            virtual void asyncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel, bool periodic); //same, periodic delays re-arm themselves in the ISR until stopAsyncDelay() without saving or restoring registers
+            virtual uint32_t remaining(); //microseconds left on the asynchronous delay on channel A, 0 if none is running
+            virtual uint32_t remaining(TOutputChannel channel); //microseconds left on the asynchronous delay on one channel, 0 if none is running
         
             //asynchronous control methods
-            virtual bool isAsyncDelayFinished() = 0; //returns true if the asynchronous delay is finished
-            virtual void stopAsyncDelay() = 0; //stops the asynchronous delay
+            virtual bool isAsyncDelayFinished() = 0; //returns true if the asynchronous delays on all channels are finished
+            virtual bool isAsyncDelayFinished(TOutputChannel channel); //returns true if the asynchronous delay on one channel is finished
+            virtual void stopAsyncDelay() = 0; //stops the asynchronous delays on all channels
+            virtual void stopAsyncDelay(TOutputChannel channel); //stops the asynchronous delay on one channel
+
+            //frequency synthesis methods
+            virtual FrequencyPlan setFrequency(float hz, TOutputChannel channel); //square wave closest to hz on the channel pin, starts the timer and returns what it produces
+            virtual void setFrequency(const FrequencyPlan& plan, TOutputChannel channel); //applies a plan from planFrequency(), computed at compile time for constant frequencies
         private:
             //delay logic methods
             virtual void syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) = 0; //logic for the delay methods
-            virtual void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) = 0; //logic for the non-blocking delay methods
+            virtual void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) = 0; //logic for the non-blocking delay methods
     };
     //subclass timer 0 (8 bits)
     class Timer0 : public Timer {
         public:
             //setup methods
-            Timer0();
+#ifdef CLB_ALLOW_TIMER0
+            static Timer0& instance(); //returns the only Timer0, created on the first call
+#else
+            static Timer0& instance() __attribute__((error("Timer0 runs millis(), micros() and delay(), define CLB_ALLOW_TIMER0 in clbConfig.h to take it over")));
+#endif
             ~Timer0();
             void deactivate() override; //deactivates the timer and resets the registers
 
@@ -261,12 +301,14 @@ namespace clb {
             void startTimer() override; //starts the timer
             void stopTimer() override; //stops the timer
             uint8_t getTimerValue8() override; //returns the current value of the timer
+            TimerSnapshot snapshot() override; //counter, flags and overflow count read together in one short interrupt lock
             void setTimerValue(uint8_t value) override; //sets the timer value, not a good idea to use since can cause a race condition if compare match was about to occur
             void forceOutputCompareA() override; //forces a compare match on OC0A
             void forceOutputCompareB() override; //forces a compare match on OC0B
 
             //interrupt control methods
             void setInterruptCallback(TInterrupt8 type, void (*callback)()) override; //sets the callback for the interrupt (8 bit)
+            void setInterruptActions(TInterrupt8 type, const Action* actions) override; //sets the PROGMEM action table run by the compare match interrupt (8 bit)
             void enableInterrupt(TInterrupt8 type) override; //enables the interrupt for the timer (8 bit)
             void disableInterrupt(TInterrupt8 type) override; //disables the interrupt for the timer (8 bit)
             bool getInterruptFlag(TInterrupt8 type) override; //returns the interrupt flag for the timer (8 bit)
@@ -276,41 +318,40 @@ namespace clb {
             void syncDelay(uint32_t time) override; //delays for a specified time in milliseconds
             void syncDelay(uint32_t time, TTimeUnit timeUnit) override; //delays for a specified time in seconds, milliseconds or microseconds
             void syncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel) override; //delays for a specified time in seconds, milliseconds or microseconds on one of the compare registers (A, B or C)
+            void setSyncDelayOverhead(uint16_t timerCycles, uint16_t loopCycles) override; //fixed cost in cpu cycles of a microsecond syncDelay on the timer and the counted loop path, taken off every wait
         
             //direct non blocking delay methods
             void asyncDelay(uint32_t time) override; //delays for a specified time in milliseconds, non-blocking
             void asyncDelay(uint32_t time, TTimeUnit timeUnit) override; //delays for a specified time in seconds, milliseconds or microseconds, non-blocking
             void asyncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel) override; //delays for a specified time in seconds, milliseconds or microseconds on one of the compare registers (A, B or C), non-blocking
+            void asyncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel, bool periodic) override; //same, periodic delays re-arm themselves in the ISR until stopAsyncDelay() without saving or restoring registers
+            uint32_t remaining() override; //microseconds left on the asynchronous delay on channel A, 0 if none is running
+            uint32_t remaining(TOutputChannel channel) override; //microseconds left on the asynchronous delay on one channel, 0 if none is running
         
             //asynchronous control methods
-            bool isAsyncDelayFinished() override; //returns true if the asynchronous delay is finished
-            void stopAsyncDelay() override; //stops the asynchronous delay
+            bool isAsyncDelayFinished() override; //returns true if the asynchronous delays on all channels are finished
+            bool isAsyncDelayFinished(TOutputChannel channel) override; //returns true if the asynchronous delay on one channel is finished
+            void stopAsyncDelay() override; //stops the asynchronous delays on all channels
+            void stopAsyncDelay(TOutputChannel channel) override; //stops the asynchronous delay on one channel
+
+            //frequency synthesis methods
+            static constexpr FrequencyPlan planFrequency(float hz, TOutputChannel channel) { //prescaler, mode and TOP closest to hz, channel A only toggles in CTC, B also runs fast PWM with TOP in OCR0A
+                return (channel == TOutputChannel::C) ? frequency::none(0) : frequency::plan(0, channel == TOutputChannel::B, true, 256, hz);
+            }
+            FrequencyPlan setFrequency(float hz, TOutputChannel channel) override; //square wave closest to hz on OC0A or OC0B, starts the timer and returns what it produces
+            void setFrequency(const FrequencyPlan& plan, TOutputChannel channel) override; //applies a plan from planFrequency(), computed at compile time for constant frequencies
         private:
+            Timer0(); //use instance()
+            Timer0(const Timer0&) = delete;
+            Timer0& operator=(const Timer0&) = delete;
             void syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the delay methods
-            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the non-blocking delay methods
-        public:
-            volatile uint64_t _asyncTargetTicks; //total delay ticks
-            volatile uint64_t _asyncCurrentTicks; //counter for elapsed ticks
-            volatile uint32_t _asyncOverflowsCount; //number of tick cycles
-            volatile uint16_t _asyncRemainingTicksValue; //last ocr value
-            volatile bool _asyncDelayActive; //async delay flag
-            volatile clb::TOutputChannel _asyncDelayActiveChannel; //channel for async delay
-
-            //register save variables for asynchronous mode
-            volatile uint8_t _asyncSavedTCCR0A;
-            volatile uint8_t _asyncSavedTCCR0B;
-            volatile uint8_t _asyncSavedTCNT0;
-            volatile uint8_t _asyncSavedOCR0A;
-            volatile uint8_t _asyncSavedOCR0B;
-            volatile uint8_t _asyncSavedTIMSK0;
-            volatile uint8_t _asyncSavedTIFR0;
-            volatile uint8_t _asyncSavedSREG;
+            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) override; //logic for the non-blocking delay methods
     }; 
     //subclass timer 2 (8 bits)
     class Timer2 : public Timer {
         public:
             //setup methods
-            Timer2();
+            static Timer2& instance(); //returns the only Timer2, created on the first call
             ~Timer2();
             void deactivate() override; //deactivates the timer and resets the registers
 
@@ -331,12 +372,14 @@ namespace clb {
             void startTimer() override; //starts the timer
             void stopTimer() override; //stops the timer
             uint8_t getTimerValue8() override; //returns the current value of the timer
+            TimerSnapshot snapshot() override; //counter, flags and overflow count read together in one short interrupt lock
             void setTimerValue(uint8_t value) override; //sets the timer value, not a good idea to use since can cause a race condition if compare match was about to occur
             void forceOutputCompareA() override; //forces a compare match on OC0A
             void forceOutputCompareB() override; //forces a compare match on OC0B
 
             //interrupt control methods
             void setInterruptCallback(TInterrupt8 type, void (*callback)()) override; //sets the callback for the interrupt (8 bit)
+            void setInterruptActions(TInterrupt8 type, const Action* actions) override; //sets the PROGMEM action table run by the compare match interrupt (8 bit)
             void enableInterrupt(TInterrupt8 type) override; //enables the interrupt for the timer (8 bit)
             void disableInterrupt(TInterrupt8 type) override; //disables the interrupt for the timer (8 bit)
             bool getInterruptFlag(TInterrupt8 type) override; //returns the interrupt flag for the timer (8 bit)
@@ -350,41 +393,40 @@ namespace clb {
             void syncDelay(uint32_t time) override; //delays for a specified time in milliseconds
             void syncDelay(uint32_t time, TTimeUnit timeUnit) override; //delays for a specified time in seconds, milliseconds or microseconds
             void syncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel) override; //delays for a specified time in seconds, milliseconds or microseconds on one of the compare registers (A, B or C)
+            void setSyncDelayOverhead(uint16_t timerCycles, uint16_t loopCycles) override; //fixed cost in cpu cycles of a microsecond syncDelay on the timer and the counted loop path, taken off every wait
 
             //direct non blocking delay methods
             void asyncDelay(uint32_t time) override; //delays for a specified time in milliseconds, non-blocking
             void asyncDelay(uint32_t time, TTimeUnit timeUnit) override; //delays for a specified time in seconds, milliseconds or microseconds, non-blocking
             void asyncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel) override; //delays for a specified time in seconds, milliseconds or microseconds on one of the compare registers (A, B or C), non-blocking
+            void asyncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel, bool periodic) override; //same, periodic delays re-arm themselves in the ISR until stopAsyncDelay() without saving or restoring registers
+            uint32_t remaining() override; //microseconds left on the asynchronous delay on channel A, 0 if none is running
+            uint32_t remaining(TOutputChannel channel) override; //microseconds left on the asynchronous delay on one channel, 0 if none is running
         
             //asynchronous control methods
-            bool isAsyncDelayFinished() override; //returns true if the asynchronous delay is finished
-            void stopAsyncDelay() override; //stops the asynchronous delay
+            bool isAsyncDelayFinished() override; //returns true if the asynchronous delays on all channels are finished
+            bool isAsyncDelayFinished(TOutputChannel channel) override; //returns true if the asynchronous delay on one channel is finished
+            void stopAsyncDelay() override; //stops the asynchronous delays on all channels
+            void stopAsyncDelay(TOutputChannel channel) override; //stops the asynchronous delay on one channel
+
+            //frequency synthesis methods
+            static constexpr FrequencyPlan planFrequency(float hz, TOutputChannel channel) { //prescaler, mode and TOP closest to hz, channel A only toggles in CTC, B also runs fast PWM with TOP in OCR2A
+                return (channel == TOutputChannel::C) ? frequency::none(2) : frequency::plan(2, channel == TOutputChannel::B, true, 256, hz);
+            }
+            FrequencyPlan setFrequency(float hz, TOutputChannel channel) override; //square wave closest to hz on OC2A or OC2B, starts the timer and returns what it produces
+            void setFrequency(const FrequencyPlan& plan, TOutputChannel channel) override; //applies a plan from planFrequency(), computed at compile time for constant frequencies
         private:
+            Timer2(); //use instance()
+            Timer2(const Timer2&) = delete;
+            Timer2& operator=(const Timer2&) = delete;
             void syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the delay methods
-            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the non-blocking delay methods
-        public:
-            volatile uint64_t _asyncTargetTicks; //total delay ticks
-            volatile uint64_t _asyncCurrentTicks; //counter for elapsed ticks
-            volatile uint32_t _asyncOverflowsCount; //number of tick cycles
-            volatile uint16_t _asyncRemainingTicksValue; //last ocr value
-            volatile bool _asyncDelayActive; //async delay flag
-            volatile clb::TOutputChannel _asyncDelayActiveChannel; //channel for async delay
-
-            //register save variables for asynchronous mode
-            volatile uint8_t _asyncSavedTCCR2A;
-            volatile uint8_t _asyncSavedTCCR2B;
-            volatile uint8_t _asyncSavedTCNT2;
-            volatile uint8_t _asyncSavedOCR2A;
-            volatile uint8_t _asyncSavedOCR2B;
-            volatile uint8_t _asyncSavedTIMSK2;
-            volatile uint8_t _asyncSavedTIFR2;
-            volatile uint8_t _asyncSavedSREG;
+            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) override; //logic for the non-blocking delay methods
     };
     //subclass timer 1 (16 bits)
     class Timer1 : public Timer {
         public:
             //setup methods
-            Timer1();
+            static Timer1& instance(); //returns the only Timer1, created on the first call
             ~Timer1();
             void deactivate() override; //deactivates the timer and resets the registers
 
@@ -408,6 +450,7 @@ namespace clb {
             void startTimer() override; //starts the timer
             void stopTimer() override; //stops the timer
             uint16_t getTimerValue16() override; //returns the current value of the timer
+            TimerSnapshot snapshot() override; //counter, flags and overflow count read together in one short interrupt lock
             void setTimerValue(uint16_t value) override; //sets the timer value, not a good idea to use since can cause a race condition if compare match was about to occur
             void forceOutputCompareA() override; //forces a compare match on OC0A
             void forceOutputCompareB() override; //forces a compare match on OC0B
@@ -415,6 +458,7 @@ namespace clb {
 
             //interrupt control methods
             void setInterruptCallback(TInterrupt16 type, void (*callback)()) override; //sets the callback for the interrupt (16 bit)
+            void setInterruptActions(TInterrupt16 type, const Action* actions) override; //sets the PROGMEM action table run by the compare match interrupt (16 bit)
             void enableInterrupt(TInterrupt16 type) override; //enables the interrupt for the timer (16 bit)
             void disableInterrupt(TInterrupt16 type) override; //disables the interrupt for the timer (16 bit)
             bool getInterruptFlag(TInterrupt16 type) override; //returns the interrupt flag for the timer (16 bit)
@@ -428,42 +472,40 @@ namespace clb {
             void syncDelay(uint32_t time) override; //delays for a specified time in milliseconds
             void syncDelay(uint32_t time, TTimeUnit timeUnit) override; //delays for a specified time in seconds, milliseconds or microseconds
             void syncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel) override; //delays for a specified time in seconds, milliseconds or microseconds on one of the compare registers (A, B or C)
+            void setSyncDelayOverhead(uint16_t timerCycles, uint16_t loopCycles) override; //fixed cost in cpu cycles of a microsecond syncDelay on the timer and the counted loop path, taken off every wait
         
             //direct non blocking delay methods
             void asyncDelay(uint32_t time) override; //delays for a specified time in milliseconds, non-blocking
             void asyncDelay(uint32_t time, TTimeUnit timeUnit) override; //delays for a specified time in seconds, milliseconds or microseconds, non-blocking
             void asyncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel) override; //delays for a specified time in seconds, milliseconds or microseconds on one of the compare registers (A, B or C), non-blocking
+            void asyncDelay(uint32_t time, TTimeUnit timeUnit, TOutputChannel channel, bool periodic) override; //same, periodic delays re-arm themselves in the ISR until stopAsyncDelay() without saving or restoring registers
+            uint32_t remaining() override; //microseconds left on the asynchronous delay on channel A, 0 if none is running
+            uint32_t remaining(TOutputChannel channel) override; //microseconds left on the asynchronous delay on one channel, 0 if none is running
         
             //asynchronous control methods
-            bool isAsyncDelayFinished() override; //returns true if the asynchronous delay is finished
-            void stopAsyncDelay() override; //stops the asynchronous delay
+            bool isAsyncDelayFinished() override; //returns true if the asynchronous delays on all channels are finished
+            bool isAsyncDelayFinished(TOutputChannel channel) override; //returns true if the asynchronous delay on one channel is finished
+            void stopAsyncDelay() override; //stops the asynchronous delays on all channels
+            void stopAsyncDelay(TOutputChannel channel) override; //stops the asynchronous delay on one channel
+
+            //frequency synthesis methods
+            static constexpr FrequencyPlan planFrequency(float hz, TOutputChannel channel) { //prescaler, mode and TOP closest to hz, fast PWM or CTC toggling with TOP in ICR1
+                return frequency::plan(1, true, true, 65536, hz);
+            }
+            FrequencyPlan setFrequency(float hz, TOutputChannel channel) override; //square wave closest to hz on OC1A, OC1B or OC1C, starts the timer and returns what it produces
+            void setFrequency(const FrequencyPlan& plan, TOutputChannel channel) override; //applies a plan from planFrequency(), computed at compile time for constant frequencies
         private:
+            Timer1(); //use instance()
+            Timer1(const Timer1&) = delete;
+            Timer1& operator=(const Timer1&) = delete;
             void syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the delay methods
-            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the non-blocking delay methods
-        public:
-            volatile uint64_t _asyncTargetTicks; //total delay ticks
-            volatile uint64_t _asyncCurrentTicks; //counter for elapsed ticks
-            volatile uint32_t _asyncOverflowsCount; //number of tick cycles
-            volatile uint16_t _asyncRemainingTicksValue; //last ocr value
-            volatile bool _asyncDelayActive; //async delay flag
-            volatile clb::TOutputChannel _asyncDelayActiveChannel; //channel for async delay
-
-            //register save variables for asynchronous mode
-            volatile uint16_t _asyncSavedTCCR1A;
-            volatile uint16_t _asyncSavedTCCR1B;
-            volatile uint16_t _asyncSavedTCNT1;
-            volatile uint16_t _asyncSavedOCR1A;
-            volatile uint16_t _asyncSavedOCR1B;
-            volatile uint16_t _asyncSavedTIMSK1;
-            volatile uint16_t _asyncSavedTIFR1;
-            volatile uint16_t _asyncSavedSREG;
-            
+            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) override; //logic for the non-blocking delay methods
     };
     //subclass timer 3 (16 bits)
     class Timer3 : public Timer {
         public:
             //setup methods
-            Timer3();
+            static Timer3& instance(); //returns the only Timer3, created on the first call
             ~Timer3();
             void deactivate() override; //deactivates the timer and resets the registers
 
@@ -494,6 +536,7 @@ namespace clb {
 
             //interrupt control methods
             void setInterruptCallback(TInterrupt16 type, void (*callback)()) override; //sets the callback for the interrupt (16 bit)
+            void setInterruptActions(TInterrupt16 type, const Action* actions) override; //sets the PROGMEM action table run by the compare match interrupt (16 bit)
             void enableInterrupt(TInterrupt16 type) override; //enables the interrupt for the timer (16 bit)
             void disableInterrupt(TInterrupt16 type) override; //disables the interrupt for the timer (16 bit)
             bool getInterruptFlag(TInterrupt16 type) override; //returns the interrupt flag for the timer (16 bit)
@@ -517,14 +560,17 @@ namespace clb {
             bool isAsyncDelayFinished() override; //returns true if the asynchronous delay is finished
             void stopAsyncDelay() override; //stops the asynchronous delay
         private:
+            Timer3(); //use instance()
+            Timer3(const Timer3&) = delete;
+            Timer3& operator=(const Timer3&) = delete;
             void syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the delay methods
-            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the non-blocking delay methods
+            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) override; //logic for the non-blocking delay methods
     };
     //subclass timer 4 (16 bits)
     class Timer4 : public Timer {
         public:
             //setup methods
-            Timer4();
+            static Timer4& instance(); //returns the only Timer4, created on the first call
             ~Timer4();
             void deactivate() override; //deactivates the timer and resets the registers
 
@@ -555,6 +601,7 @@ namespace clb {
 
             //interrupt control methods
             void setInterruptCallback(TInterrupt16 type, void (*callback)()) override; //sets the callback for the interrupt (16 bit)
+            void setInterruptActions(TInterrupt16 type, const Action* actions) override; //sets the PROGMEM action table run by the compare match interrupt (16 bit)
             void enableInterrupt(TInterrupt16 type) override; //enables the interrupt for the timer (16 bit)
             void disableInterrupt(TInterrupt16 type) override; //disables the interrupt for the timer (16 bit)
             bool getInterruptFlag(TInterrupt16 type) override; //returns the interrupt flag for the timer (16 bit)
@@ -578,14 +625,17 @@ namespace clb {
             bool isAsyncDelayFinished() override; //returns true if the asynchronous delay is finished
             void stopAsyncDelay() override; //stops the asynchronous delay
         private:
+            Timer4(); //use instance()
+            Timer4(const Timer4&) = delete;
+            Timer4& operator=(const Timer4&) = delete;
             void syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the delay methods
-            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the non-blocking delay methods
+            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) override; //logic for the non-blocking delay methods
     };
     //subclass timer 5 (16 bits)
     class Timer5 : public Timer {
         public:
             //setup methods
-            Timer5();
+            static Timer5& instance(); //returns the only Timer5, created on the first call
             ~Timer5();
             void deactivate() override; //deactivates the timer and resets the registers
             
@@ -616,6 +666,7 @@ namespace clb {
 
             //interrupt control methods
             void setInterruptCallback(TInterrupt16 type, void (*callback)()) override; //sets the callback for the interrupt (16 bit)
+            void setInterruptActions(TInterrupt16 type, const Action* actions) override; //sets the PROGMEM action table run by the compare match interrupt (16 bit)
             void enableInterrupt(TInterrupt16 type) override; //enables the interrupt for the timer (16 bit)
             void disableInterrupt(TInterrupt16 type) override; //disables the interrupt for the timer (16 bit)
             bool getInterruptFlag(TInterrupt16 type) override; //returns the interrupt flag for the timer (16 bit)
@@ -639,8 +690,11 @@ namespace clb {
             bool isAsyncDelayFinished() override; //returns true if the asynchronous delay is finished
             void stopAsyncDelay() override; //stops the asynchronous delay
         private:
+            Timer5(); //use instance()
+            Timer5(const Timer5&) = delete;
+            Timer5& operator=(const Timer5&) = delete;
             void syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the delay methods
-            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) override; //logic for the non-blocking delay methods
+            void asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) override; //logic for the non-blocking delay methods
     };
 };
 
@@ -1,92 +1,130 @@
 #include "clbTimer.h"
+#include "clbLatency.h"
+#include "clbStats.h"
+#include "clbTrace.h"
+#include "clbResource.h"
+#include "clbCriticalSection.h"
+#include "clbPreciseDelay.h"
 
-static clb::Timer0* s_active_timer0_instance = nullptr;
+CLB_CLAIM_TIMER(0);
 
 static uint32_t getPrescaler(clb::TSyncClock clock);
 static uint64_t calculateTicks(uint32_t value, clb::TTimeUnit unit, uint32_t prescaler);
-volatile uint8_t* getOcrRegister(clb::TOutputChannel channel);
-uint8_t getOcFlagBit(clb::TOutputChannel channel);
+static volatile uint8_t* getOcrRegister(clb::TOutputChannel channel);
+static uint8_t getOcFlagBit(clb::TOutputChannel channel);
 
 static struct Timer0InterruptHandlers {
     void (*compareMatchACallback)() = nullptr;
+    const clb::Action* compareMatchAActions = nullptr; //PROGMEM action table, see clbAction.h
     void (*compareMatchBCallback)() = nullptr;
+    const clb::Action* compareMatchBActions = nullptr; //PROGMEM action table, see clbAction.h
     void (*overflowCallback)() = nullptr; //should not be used 
 } s_timer0_handlers; 
 
+//async delay slots, one per compare channel, both on the same free running counter. Only one Timer0 can exist so they
+//live here and not in the instance
+static struct Timer0AsyncState {
+    uint32_t chunks[2] = {0, 0}; //compare matches left per channel, every one after the first is a full 256 ticks
+    volatile uint8_t active = 0; //BIT0 << channel for every running slot
+    uint8_t periodic = 0; //BIT0 << channel for every slot that re-arms itself
+    uint32_t reloadChunks[2] = {0, 0}; //chunks of one period for the periodic slots
+    uint8_t reloadLead[2] = {0, 0}; //ticks from the end of one period to the first match of the next
+} s_timer0_async;
+
+//registers saved when an async delay starts and put back when it ends
+static struct Timer0SavedConfig {
+    uint8_t tccra = 0;
+    uint8_t tccrb = 0;
+    uint8_t tcnt = 0;
+    uint8_t ocra = 0;
+    uint8_t ocrb = 0;
+    uint8_t timsk = 0;
+} s_timer0_saved;
+
+//puts the saved registers back, interrupts must be off
+static inline void restoreAsyncConfig() {
+    TCCR0A = s_timer0_saved.tccra;
+    TCCR0B = s_timer0_saved.tccrb;
+    TCNT0 = s_timer0_saved.tcnt;
+    OCR0A = s_timer0_saved.ocra;
+    OCR0B = s_timer0_saved.ocrb;
+    TIMSK0 = s_timer0_saved.timsk;
+}
+
+//counts one compare match of a running async slot and returns true once its delay is over. The registers go back when
+//the last slot ends, interrupts must be off
+static inline bool asyncDelayMatch(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (--s_timer0_async.chunks[_index] != 0) {
+        return false;
+    }
+    if (s_timer0_async.periodic & (BIT0 << _index)) {
+        //next period, OCR moves on from this match so the period doesnt drift with the ISR latency
+        (&OCR0A)[_index] += s_timer0_async.reloadLead[_index]; //the OCRnx registers follow the channel order
+        s_timer0_async.chunks[_index] = s_timer0_async.reloadChunks[_index];
+        return true;
+    }
+    uint8_t _active = s_timer0_async.active & ~(BIT0 << _index);
+    s_timer0_async.active = _active;
+    CLB_TRACE(clb::TTraceEvent::ASYNC_STOP, 0, channel, 1);
+    if (_active == 0) {
+        restoreAsyncConfig();
+    }
+    else {
+        TIMSK0 &= ~(BIT0 << (OCIE0A + _index)); //OCIEnx and OCFnx bits follow the channel order
+    }
+    return true;
+}
+
+//overflow count kept by the Arduino core's Timer0 overflow ISR in wiring.c, read by snapshot()
+extern "C" volatile unsigned long timer0_overflow_count;
+
+//fixed cost in cpu cycles of a microsecond syncDelay, set by calibrateSyncDelay() or setSyncDelayOverhead()
+static uint16_t s_timer0_sync_overhead = 0; //timer path
+static uint16_t s_timer0_loop_overhead = 0; //counted loop path
+
+//TOP of the current waveform mode, OCR0A for CTC and the OCR0A top PWM modes, 0xFF for the rest
+static inline uint8_t currentTop() {
+    if ((TCCR0B & (BIT0 << WGM02)) || ((TCCR0A & (BIT1 | BIT0)) == (BIT0 << WGM01))) {
+        return OCR0A;
+    }
+    return 0xFF;
+}
+
 //global ISRs for Timer0
 ISR(TIMER0_COMPA_vect) {
-    if (s_active_timer0_instance && s_active_timer0_instance->_asyncDelayActive && s_active_timer0_instance->_asyncDelayActiveChannel == clb::TOutputChannel::A) {
-        s_active_timer0_instance->_asyncOverflowsCount--; 
-        if (s_active_timer0_instance->_asyncOverflowsCount == 0) {
-            s_active_timer0_instance->_asyncDelayActive = false; 
-    
-            TIMSK0 &= ~(BIT0 << OCIE0A);
-
-            uint8_t temp_sreg = SREG;
-            cli();
-            TCCR0A = s_active_timer0_instance->_asyncSavedTCCR0A;
-            TCCR0B = s_active_timer0_instance->_asyncSavedTCCR0B;
-            TCNT0 = s_active_timer0_instance->_asyncSavedTCNT0;
-            OCR0A = s_active_timer0_instance->_asyncSavedOCR0A;
-            OCR0B = s_active_timer0_instance->_asyncSavedOCR0B;
-            TIMSK0 = s_active_timer0_instance->_asyncSavedTIMSK0;
-            TIFR0 = s_active_timer0_instance->_asyncSavedTIFR0;
-            SREG = temp_sreg;
-
-            if (s_timer0_handlers.compareMatchACallback) {
-                s_timer0_handlers.compareMatchACallback();
-            }
-        } 
-        else {
-            if (s_active_timer0_instance->_asyncOverflowsCount == 1) {
-                OCR0A = s_active_timer0_instance->_asyncRemainingTicksValue;
-            } 
-            else {
-                OCR0A = 255; 
-            }
-        }
-    } 
-    else {
-        if (s_timer0_handlers.compareMatchACallback) {
-            s_timer0_handlers.compareMatchACallback();
-        }
+    CLB_LATENCY_RECORD(clb::TVector::TIMER0_COMPA, TCNT0, OCR0A, currentTop());
+    CLB_STATS_SCOPE(clb::TVector::TIMER0_COMPA);
+    CLB_TRACE(clb::TTraceEvent::COMPARE_MATCH, 0, clb::TOutputChannel::A, OCR0A);
+
+    if ((s_timer0_async.active & (BIT0 << static_cast<uint8_t>(clb::TOutputChannel::A))) &&
+        !asyncDelayMatch(clb::TOutputChannel::A)) {
+        return;
+    }
+
+    clb::Actions::run(s_timer0_handlers.compareMatchAActions);
+    if (s_timer0_handlers.compareMatchACallback) {
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_ENTER, 0, clb::TOutputChannel::A, 0);
+        s_timer0_handlers.compareMatchACallback();
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_EXIT, 0, clb::TOutputChannel::A, 0);
     }
 }
 
 ISR(TIMER0_COMPB_vect) {
-    if (s_active_timer0_instance && s_active_timer0_instance->_asyncDelayActive && s_active_timer0_instance->_asyncDelayActiveChannel == clb::TOutputChannel::B) {
-        s_active_timer0_instance->_asyncOverflowsCount--;
-        if (s_active_timer0_instance->_asyncOverflowsCount == 0) {
-            s_active_timer0_instance->_asyncDelayActive = false;
-            TIMSK0 &= ~(BIT0 << OCIE0B);
-
-            uint8_t temp_sreg = SREG;
-            cli();
-            TCCR0A = s_active_timer0_instance->_asyncSavedTCCR0A;
-            TCCR0B = s_active_timer0_instance->_asyncSavedTCCR0B;
-            TCNT0 = s_active_timer0_instance->_asyncSavedTCNT0;
-            OCR0A = s_active_timer0_instance->_asyncSavedOCR0A;
-            OCR0B = s_active_timer0_instance->_asyncSavedOCR0B;
-            TIMSK0 = s_active_timer0_instance->_asyncSavedTIMSK0;
-            TIFR0 = s_active_timer0_instance->_asyncSavedTIFR0;
-            SREG = temp_sreg;
-
-            if (s_timer0_handlers.compareMatchBCallback) {
-                s_timer0_handlers.compareMatchBCallback();
-            }
-        } 
-        else {
-            if (s_active_timer0_instance->_asyncOverflowsCount == 1) {
-                OCR0B = s_active_timer0_instance->_asyncRemainingTicksValue;
-            } else {
-                OCR0B = 255; 
-            }
-        }
-    } 
-    else {
-        if (s_timer0_handlers.compareMatchBCallback) {
-            s_timer0_handlers.compareMatchBCallback();
-        }
+    CLB_LATENCY_RECORD(clb::TVector::TIMER0_COMPB, TCNT0, OCR0B, currentTop());
+    CLB_STATS_SCOPE(clb::TVector::TIMER0_COMPB);
+    CLB_TRACE(clb::TTraceEvent::COMPARE_MATCH, 0, clb::TOutputChannel::B, OCR0B);
+
+    if ((s_timer0_async.active & (BIT0 << static_cast<uint8_t>(clb::TOutputChannel::B))) &&
+        !asyncDelayMatch(clb::TOutputChannel::B)) {
+        return;
+    }
+
+    clb::Actions::run(s_timer0_handlers.compareMatchBActions);
+    if (s_timer0_handlers.compareMatchBCallback) {
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_ENTER, 0, clb::TOutputChannel::B, 0);
+        s_timer0_handlers.compareMatchBCallback();
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_EXIT, 0, clb::TOutputChannel::B, 0);
     }
 }
 
@@ -94,46 +132,37 @@ ISR(TIMER0_COMPB_vect) {
  * only uncomment if completely removing those functions and using timer 0 overflow
 
 ISR(TIMER0_OVF_vect) {
+    CLB_LATENCY_RECORD(clb::TVector::TIMER0_OVF, TCNT0, 0, currentTop());
+    CLB_STATS_SCOPE(clb::TVector::TIMER0_OVF);
+    CLB_TRACE(clb::TTraceEvent::OVERFLOW, 0, CLB_TRACE_OVERFLOW, 0);
+
     if (s_timer0_handlers.overflowCallback) { 
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_ENTER, 0, CLB_TRACE_OVERFLOW, 0);
         s_timer0_handlers.overflowCallback();
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_EXIT, 0, CLB_TRACE_OVERFLOW, 0);
     }
 }
 */
 
-clb::Timer0::Timer0() {
-    WARNING("Using Timer0 is not recommended since any change will basically break the delay(), millis(), and micros() functions.");
-    
-    if (s_active_timer0_instance != nullptr) {
-        FATAL("There is already an instance of Timer0. Only one instance is allowed.");
-    }
-    
-    s_active_timer0_instance = this; 
-    _asyncDelayActive = false;
-    _asyncTargetTicks = 0;
-    _asyncOverflowsCount = 0;
-    _asyncRemainingTicksValue = 0;
-    _asyncDelayActiveChannel = clb::TOutputChannel::A; 
-
-    _asyncSavedTCCR0A = 0;
-    _asyncSavedTCCR0B = 0;
-    _asyncSavedTCNT0 = 0;
-    _asyncSavedOCR0A = 0;
-    _asyncSavedOCR0B = 0;
-    _asyncSavedTIMSK0 = 0;
-    _asyncSavedTIFR0 = 0;
-    _asyncSavedSREG = 0;
+#ifdef CLB_ALLOW_TIMER0
+clb::Timer0& clb::Timer0::instance() {
+    static clb::Timer0 s_timer0;
+    return s_timer0;
 }
+#endif
+
+clb::Timer0::Timer0() { }
 
 clb::Timer0::~Timer0() {
     deactivate();
 }
 
 void clb::Timer0::deactivate() {
-    if (_asyncDelayActive) {
+    if (s_timer0_async.active) {
         stopAsyncDelay();
     }
 
-    cli();
+    CLB_CRITICAL_SECTION();
 
     TIMSK0 = 0;
     TIFR0 = (BIT0 << OCF0A) | (BIT0 << OCF0B) | (BIT0 << TOV0);
@@ -143,10 +172,6 @@ void clb::Timer0::deactivate() {
     OCR0A = 0;
     OCR0B = 0;
     TCNT0 = 0;
-
-    sei(); 
-
-    s_active_timer0_instance = nullptr;
 }
 
 //set the mode in TCCR0A and TCCR0B
@@ -170,6 +195,9 @@ void clb::Timer0::setMode(TMode8 mode) {
 
     TCCR0A = _TCCR0A;
     TCCR0B = _TCCR0B;
+
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TCCRA, _TCCR0A);
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TCCRB, _TCCR0B);
 }
 
 //set the clock in TCCR0B
@@ -193,6 +221,7 @@ void clb::Timer0::setCompareMatchOutputModeA(TCMOM mode) {
     _TCCR0A |= (_bit1 | _bit0);
 
     TCCR0A = _TCCR0A;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TCCRA, _TCCR0A);
 }
 
 //set the compare match output mode for OC0B
@@ -210,13 +239,20 @@ void clb::Timer0::setCompareMatchOutputModeB(TCMOM mode) {
     _TCCR0A |= (_bit1 | _bit0);
 
     TCCR0A = _TCCR0A;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TCCRA, _TCCR0A);
 }
 
 //set the compare match value in OCR0A
-void clb::Timer0::setCompareMatchValueA(uint8_t value) { OCR0A = value; }
+void clb::Timer0::setCompareMatchValueA(uint8_t value) {
+    OCR0A = value;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::OCRA, value);
+}
 
 //set the compare match value in OCR0B
-void clb::Timer0::setCompareMatchValueB(uint8_t value) { OCR0B = value; }
+void clb::Timer0::setCompareMatchValueB(uint8_t value) {
+    OCR0B = value;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::OCRB, value);
+}
 
 //set the interrupt callback for the timer 
 void clb::Timer0::setInterruptCallback(TInterrupt8 type, void (*callback)()) {
@@ -237,6 +273,22 @@ void clb::Timer0::setInterruptCallback(TInterrupt8 type, void (*callback)()) {
     }
 }
 
+//set the action table run by the compare match ISR, nullptr removes it
+void clb::Timer0::setInterruptActions(TInterrupt8 type, const clb::Action* actions) {
+    if (type != TInterrupt8::COMPMATCHA && type != TInterrupt8::COMPMATCHB) {
+        CRITICAL("Action tables are only supported for COMPMATCHA and COMPMATCHB");
+        return;
+    }
+
+    CLB_CRITICAL_SECTION();
+    if (type == TInterrupt8::COMPMATCHA) {
+        s_timer0_handlers.compareMatchAActions = actions;
+    }
+    else {
+        s_timer0_handlers.compareMatchBActions = actions;
+    }
+}
+
 void clb::Timer0::enableInterrupt(TInterrupt8 type) {
     switch (type) {
         case TInterrupt8::COMPMATCHA:
@@ -253,6 +305,7 @@ void clb::Timer0::enableInterrupt(TInterrupt8 type) {
             CRITICAL("Invalid interrupt type for enabling interrupt");
             break;
     }
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TIMSK, TIMSK0);
 }
 
 void clb::Timer0::disableInterrupt(TInterrupt8 type) {
@@ -271,6 +324,7 @@ void clb::Timer0::disableInterrupt(TInterrupt8 type) {
             CRITICAL("Invalid interrupt type for disabling interrupt");
             break;
     }
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TIMSK, TIMSK0);
 }
 
 bool clb::Timer0::getInterruptFlag(TInterrupt8 type) {
@@ -317,11 +371,12 @@ void clb::Timer0::startTimer() {
     _TCCR0B |= _clockSource;
 
     TCCR0B = _TCCR0B;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TCCRB, _TCCR0B);
 }
 
 void clb::Timer0::stopTimer() {
     WARNING("stopTimer() modifies the clock source which halts delay(), millis() and micros() functions, so watch out");
-    if (_asyncDelayActive) {
+    if (s_timer0_async.active) {
         stopAsyncDelay();
     }
 
@@ -330,11 +385,43 @@ void clb::Timer0::stopTimer() {
     _TCCR0B &= ~(BIT2 | BIT1 | BIT0);
 
     TCCR0B = _TCCR0B;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TCCRB, _TCCR0B);
 }
 
 uint8_t clb::Timer0::getTimerValue8() { return TCNT0; }
 
-void clb::Timer0::setTimerValue(uint8_t value) { TCNT0 = value; }
+void clb::Timer0::setTimerValue(uint8_t value) {
+    TCNT0 = value;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TCNT, value);
+}
+
+//the lock only covers the reads, 16 cycles (1us at 16MHz) counted from the generated code, the correction runs after it
+clb::TimerSnapshot clb::Timer0::snapshot() {
+    uint8_t _counter;
+    uint8_t _flags;
+    uint32_t _overflows;
+    uint8_t _timsk;
+    {
+        CLB_CRITICAL_SECTION();
+        _counter = TCNT0;
+        _flags = TIFR0;
+        _overflows = timer0_overflow_count;
+        _timsk = TIMSK0;
+    }
+
+    uint8_t _top = currentTop();
+    //TCNT0 was read first, so a pending overflow with a small count happened before the read and the ISR hasnt counted it yet
+    if ((_timsk & (BIT0 << TOIE0)) && (_flags & (BIT0 << TOV0)) && _counter < (_top >> 1)) {
+        _overflows++;
+    }
+
+    clb::TimerSnapshot _snapshot;
+    _snapshot.counter = _counter;
+    _snapshot.flags = _flags;
+    _snapshot.overflows = _overflows;
+    _snapshot.ticks = _overflows * ((uint32_t)_top + 1) + _counter;
+    return _snapshot;
+}
 
 void clb::Timer0::forceOutputCompareA() { TCCR0B |= BIT0 << FOC0A; }
 
@@ -358,11 +445,35 @@ void clb::Timer0::syncDelay(uint32_t time, clb::TTimeUnit unit, clb::TOutputChan
         _prescaler = getPrescaler(_clockSourceEnum);
     }
 
+#ifdef CLB_CYCLES_PER_US
+    //microseconds skip the 64 bit tick math and take the fixed cost of the call off the wait
+    if (unit == clb::TTimeUnit::MICROSECONDS && _prescaler != 0 && time <= 0xFFFFFFFFUL / CLB_CYCLES_PER_US) {
+        uint32_t _cycles = time * CLB_CYCLES_PER_US;
+        if (_cycles < CLB_SYNC_DELAY_LOOP_CYCLES) {
+            //shorter than setting the timer up, count cycles instead
+            clb::PreciseDelay::cycles((_cycles > s_timer0_loop_overhead) ? _cycles - s_timer0_loop_overhead : 0);
+            return;
+        }
+        _cycles = (_cycles > s_timer0_sync_overhead) ? _cycles - s_timer0_sync_overhead : 0;
+        while (_prescaler > 1) { //prescalers are powers of 2
+            _cycles >>= 1;
+            _prescaler >>= 1;
+        }
+        syncDelayLogic(_cycles, channel);
+        return;
+    }
+#endif
+
     uint64_t _ticks = calculateTicks(time, unit, _prescaler);
 
     syncDelayLogic(_ticks, channel);
 }
 
+void clb::Timer0::setSyncDelayOverhead(uint16_t timerCycles, uint16_t loopCycles) {
+    s_timer0_sync_overhead = timerCycles;
+    s_timer0_loop_overhead = loopCycles;
+}
+
 void clb::Timer0::asyncDelay(uint32_t time) {
     asyncDelay(time, clb::TTimeUnit::MILLISECONDS, clb::TOutputChannel::A);
 }
@@ -372,6 +483,10 @@ void clb::Timer0::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit) {
 }
 
 void clb::Timer0::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutputChannel channel) {
+    asyncDelay(time, timeUnit, channel, false);
+}
+
+void clb::Timer0::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutputChannel channel, bool periodic) {
     if (channel != clb::TOutputChannel::A && channel != clb::TOutputChannel::B) {
         CRITICAL("Timer0 only supports TOutputChannel::A and TOutputChannel::B for asyncDelay.");
         return;
@@ -394,181 +509,292 @@ void clb::Timer0::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutpu
 
     uint64_t calculatedTicks = calculateTicks(time, timeUnit, _prescaler);
 
-    asyncDelayLogic(calculatedTicks, channel);
+    asyncDelayLogic(calculatedTicks, channel, periodic);
 }
 
 
 
 //helpers 
+//interrupts stay on while waiting, only the setup and the restore are locked. The Timer0 interrupts are masked for the
+//delay so no ISR clears the flags being polled. Other ISRs can run as long as none of them holds the cpu for a whole
+//timer period (256 ticks), a longer one hides an overflow and stretches the delay by one period
 void clb::Timer0::syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) {
-    uint8_t _sreg = SREG; 
-    cli(); 
-
-    uint8_t _tccr0a = TCCR0A;
-    uint8_t _tccr0b = TCCR0B;
-    uint8_t _tcnt0 = TCNT0;
-    uint8_t _ocr0a = OCR0A;
-    uint8_t _ocr0b = OCR0B;
-    uint8_t _timsk0 = TIMSK0; 
-    uint8_t _tifr0 = TIFR0;
-
     volatile uint8_t* _ocr_reg = getOcrRegister(channel);
     uint8_t _oc_flag_bit = getOcFlagBit(channel);
 
-    TCCR0A = 0;
-    TCCR0B = 0;
-
-    uint32_t _prescaler = getPrescaler(static_cast<clb::TSyncClock>(this->_clockSource));
-    if (_prescaler == 0) {
-        TCCR0B = (BIT0 << CS02);
-    } 
-    else {
-        TCCR0B = this->_clockSource; 
-    }
-
-    TCNT0 = 0;
-    TIFR0 = (BIT0 << _oc_flag_bit) | (BIT0 << TOV0); 
-
     const uint16_t MAX_TIMER0_TICKS = 256;
 
-    uint32_t _overflows =  ticks / MAX_TIMER0_TICKS;
-    uint16_t _remaining_ticks = ticks % MAX_TIMER0_TICKS;
+    uint32_t _overflows = ticks / MAX_TIMER0_TICKS;
+    uint8_t _remaining_ticks = ticks % MAX_TIMER0_TICKS;
+
+    uint8_t _tccr0a, _tccr0b, _timsk0, _tifr0;
+    uint8_t _tcnt0, _ocr0a, _ocr0b;
+    {
+        CLB_CRITICAL_SECTION();
+
+        _tccr0a = TCCR0A;
+        _tccr0b = TCCR0B;
+        _tcnt0 = TCNT0;
+        _ocr0a = OCR0A;
+        _ocr0b = OCR0B;
+        _timsk0 = TIMSK0;
+        _tifr0 = TIFR0;
+
+        TIMSK0 = 0;
+        TCCR0A = 0;
+        TCCR0B = 0;
+        TCNT0 = 0;
+        if (_remaining_ticks > 0) {
+            *_ocr_reg = _remaining_ticks - 1;
+        }
+        TIFR0 = (BIT0 << _oc_flag_bit) | (BIT0 << TOV0);
 
-    for (uint32_t i = 0; i < _overflows; i++) {
-        while (!(TIFR0 & (BIT0 << TOV0))) {
+        uint32_t _prescaler = getPrescaler(static_cast<clb::TSyncClock>(this->_clockSource));
+        if (_prescaler == 0) {
+            TCCR0B = (BIT0 << CS02);
+        }
+        else {
+            TCCR0B = this->_clockSource;
         }
-        TIFR0 |= (BIT0 << TOV0); 
+    }
+
+    for (uint32_t i = 0; i < _overflows; i++) {
+        while (!(TIFR0 & (BIT0 << TOV0))) { }
+        TIFR0 = (BIT0 << TOV0);
     }
     if (_remaining_ticks > 0) {
-        *_ocr_reg = _remaining_ticks - 1; 
-        while (!(TIFR0 & (BIT0 << _oc_flag_bit))) { }
-        TIFR0 |= (BIT0 << _oc_flag_bit);
+        if (_overflows > 0) {
+            TIFR0 = (BIT0 << _oc_flag_bit); //the earlier periods set it too, only the match after the last overflow counts
+        }
+        //TCNT catches a match that an ISR delayed us past before the flag was cleared
+        while (!(TIFR0 & (BIT0 << _oc_flag_bit)) && TCNT0 < _remaining_ticks) { }
     }
 
+    CLB_CRITICAL_SECTION();
+
     TCCR0A = _tccr0a;
     TCCR0B = _tccr0b;
     TCNT0 = _tcnt0;
     OCR0A = _ocr0a;
     OCR0B = _ocr0b;
+    //clear what the delay raised, flags that were pending before stay pending
+    TIFR0 = ((BIT0 << OCF0A) | (BIT0 << OCF0B) | (BIT0 << TOV0)) & ~_tifr0;
     TIMSK0 = _timsk0;
-    TIFR0 = _tifr0; 
-
-    SREG = _sreg;
 }
 
-void clb::Timer0::asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) {
-    if (_asyncDelayActive) {
-        WARNING("An asynchronous delay is already active on Timer0. Cannot start a new one.");
+//every channel is a slot of its own on the shared counter. The first slot saves the registers, puts the timer in normal
+//mode and starts it from 0, the other one sets its OCR relative to the running TCNT
+void clb::Timer0::asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (s_timer0_async.active & (BIT0 << _index)) {
+        WARNING("An asynchronous delay is already active on this Timer0 channel. Cannot start a new one.");
         return;
     }
     if (ticks == 0) {
         WARNING("asyncDelay(0) called. Delay will complete immediately.");
-        _asyncDelayActive = false; 
         return;
     }
 
-    _asyncSavedSREG = SREG;
-    cli(); 
+    const uint16_t MAX_TIMER0_TICKS = 256;
 
-    _asyncSavedTCCR0A = TCCR0A;
-    _asyncSavedTCCR0B = TCCR0B;
-    _asyncSavedTCNT0 = TCNT0;
-    _asyncSavedOCR0A = OCR0A;
-    _asyncSavedOCR0B = OCR0B;
-    _asyncSavedTIMSK0 = TIMSK0;
-    _asyncSavedTIFR0 = TIFR0;
+    //the first match comes after the remainder, the rest a full counter period apart at the same OCR value
+    uint32_t _chunks = ticks / MAX_TIMER0_TICKS;
+    uint8_t _lead = ticks % MAX_TIMER0_TICKS;
+    if (_lead != 0) {
+        _chunks++;
+    }
 
-    TCCR0A = 0;
-    TCCR0B = 0; 
-    TCNT0 = 0; 
+    uint32_t _prescaler = getPrescaler(static_cast<clb::TSyncClock>(this->_clockSource));
+    uint8_t _clockBits = (_prescaler == 0) ? ((BIT0 << CS01) | (BIT0 << CS00)) : this->_clockSource;
+    if (_prescaler == 0) {
+        _prescaler = 64;
+    }
+    //a periodic slot moves OCR on in the ISR, the next match has to be far enough ahead (128 cycles) to still be in front of TCNT then
+    if (periodic && _lead != 0 && _lead < 128 / _prescaler + 2) {
+        CRITICAL("Periodic asyncDelay on Timer0 is too close above a whole number of counter periods, pick another period or a slower clock.");
+        return;
+    }
+    uint32_t _reloadChunks = _chunks;
+    uint8_t _reloadLead = _lead;
+
+    CLB_CRITICAL_SECTION();
+
+    uint8_t _active = s_timer0_async.active;
+    uint8_t _now = 0;
+    if (_active == 0) {
+        s_timer0_saved.tccra = TCCR0A;
+        s_timer0_saved.tccrb = TCCR0B;
+        s_timer0_saved.tcnt = TCNT0;
+        s_timer0_saved.ocra = OCR0A;
+        s_timer0_saved.ocrb = OCR0B;
+        s_timer0_saved.timsk = TIMSK0;
+
+        //normal mode so TOP stays at 255 for both channels
+        TCCR0A = 0;
+        TCCR0B = 0;
+        TCNT0 = 0;
+    }
+    else {
+        //the counter runs for the other slot, the match has to be far enough ahead that TCNT doesnt pass it before the
+        //OCR write below (64 cycles), a shorter first chunk is stretched to that
+        uint8_t _minLead = 64 / _prescaler + 2;
+        if (_lead < _minLead) {
+            if (_lead == 0) {
+                _chunks++;
+            }
+            _lead = _minLead;
+        }
+        _now = TCNT0;
+    }
 
-    const uint16_t MAX_TIMER0_TICKS = 256; 
+    *getOcrRegister(channel) = _now + _lead - 1;
+    TIFR0 = (BIT0 << (OCF0A + _index));
+    TIMSK0 |= (BIT0 << (OCIE0A + _index));
+    s_timer0_async.chunks[_index] = _chunks;
+    s_timer0_async.reloadChunks[_index] = _reloadChunks;
+    s_timer0_async.reloadLead[_index] = _reloadLead;
+    if (periodic) {
+        s_timer0_async.periodic |= (BIT0 << _index);
+    }
+    else {
+        s_timer0_async.periodic &= ~(BIT0 << _index);
+    }
+    s_timer0_async.active = _active | (BIT0 << _index);
 
-    _asyncTargetTicks = ticks; 
+    if (_active == 0) {
+        TCCR0B = _clockBits;
+    }
 
-    uint32_t numFullCycles = ticks / MAX_TIMER0_TICKS;
-    uint8_t remainderTicks = ticks % MAX_TIMER0_TICKS;
+    CLB_TRACE(clb::TTraceEvent::ASYNC_START, 0, channel, (_chunks > 0xFFFF) ? 0xFFFF : _chunks);
+}
 
-    if (remainderTicks == 0) {
-        _asyncOverflowsCount = numFullCycles;
-        _asyncRemainingTicksValue = MAX_TIMER0_TICKS - 1;
-    } 
-    else {
-        _asyncOverflowsCount = numFullCycles + 1;
-        _asyncRemainingTicksValue = remainderTicks - 1; 
-    }
+bool clb::Timer0::isAsyncDelayFinished() {
+    return s_timer0_async.active == 0;
+}
 
-    TCCR0A |= (BIT0 << WGM01);
+bool clb::Timer0::isAsyncDelayFinished(clb::TOutputChannel channel) {
+    return !(s_timer0_async.active & (BIT0 << static_cast<uint8_t>(channel)));
+}
 
-    uint32_t prescaler_val_for_setup = getPrescaler(static_cast<clb::TSyncClock>(this->_clockSource));
-    if (prescaler_val_for_setup == 0) { 
-        TCCR0B |= (BIT0 << CS01) | (BIT0 << CS00); 
-    } 
-    else {
-        TCCR0B |= this->_clockSource; 
+uint32_t clb::Timer0::remaining() {
+    return remaining(clb::TOutputChannel::A);
+}
+
+uint32_t clb::Timer0::remaining(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (_index > static_cast<uint8_t>(clb::TOutputChannel::B)) {
+        CRITICAL("Invalid output channel for Timer0 remaining().");
+        return 0;
     }
 
-    if (channel == clb::TOutputChannel::A) {
-        TIFR0 |= (BIT0 << OCF0A); 
-        if (numFullCycles == 0 && remainderTicks > 0) { 
-            OCR0A = _asyncRemainingTicksValue; 
-        } 
-        else {
-            OCR0A = MAX_TIMER0_TICKS - 1;
+    uint32_t _chunks;
+    uint8_t _distance;
+    bool _pending;
+    {
+        CLB_CRITICAL_SECTION();
+        if (!(s_timer0_async.active & (BIT0 << _index))) {
+            return 0;
         }
-        TIMSK0 |= (BIT0 << OCIE0A); 
-    } 
-    else { 
-        TIFR0 |= (BIT0 << OCF0B); 
-        if (numFullCycles == 0 && remainderTicks > 0) {
-            OCR0B = _asyncRemainingTicksValue;
-        } 
-        else {
-            OCR0B = MAX_TIMER0_TICKS - 1;
+        _chunks = s_timer0_async.chunks[_index];
+        _distance = (&OCR0A)[_index] - TCNT0;
+        _pending = TIFR0 & (BIT0 << (OCF0A + _index));
+    }
+    if (_pending) {
+        //matched but the ISR hasnt counted it yet, the next match is a full period away
+        if (_chunks <= 1) {
+            return 0;
         }
-        TIMSK0 |= (BIT0 << OCIE0B); 
+        _chunks--;
     }
 
-    _asyncDelayActive = true;
-    _asyncDelayActiveChannel = channel;
+    //ticks to the next match, then a full period for every match after it
+    uint64_t _ticks = (uint64_t)_distance + 1 + (uint64_t)(_chunks - 1) * 256;
+    uint32_t _prescaler = getPrescaler(static_cast<clb::TSyncClock>(this->_clockSource));
+    if (_prescaler == 0) {
+        _prescaler = 64;
+    }
+    uint64_t _microseconds = _ticks * _prescaler / (F_CPU / 1000000UL);
+    return (_microseconds > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : _microseconds;
+}
 
-    SREG = _asyncSavedSREG; 
+void clb::Timer0::stopAsyncDelay() {
+    stopAsyncDelay(clb::TOutputChannel::A);
+    stopAsyncDelay(clb::TOutputChannel::B);
 }
 
-bool clb::Timer0::isAsyncDelayFinished() {
-    return !_asyncDelayActive;
+void clb::Timer0::stopAsyncDelay(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (channel == clb::TOutputChannel::C || !(s_timer0_async.active & (BIT0 << _index))) {
+        return;
+    }
+    WARNING("Stopping active asynchronous delay on Timer0.");
+
+    CLB_CRITICAL_SECTION();
+
+    uint8_t _active = s_timer0_async.active;
+    if (!(_active & (BIT0 << _index))) {
+        return; //ended by itself in the meantime
+    }
+    TIMSK0 &= ~(BIT0 << (OCIE0A + _index));
+    TIFR0 = (BIT0 << (OCF0A + _index));
+    s_timer0_async.chunks[_index] = 0;
+    s_timer0_async.periodic &= ~(BIT0 << _index);
+    _active &= ~(BIT0 << _index);
+    s_timer0_async.active = _active;
+    if (_active == 0) {
+        restoreAsyncConfig();
+    }
+
+    CLB_TRACE(clb::TTraceEvent::ASYNC_STOP, 0, channel, 0);
 }
 
-void clb::Timer0::stopAsyncDelay() {
-    if (_asyncDelayActive) {
-        WARNING("Stopping active asynchronous delay on Timer0.");
+clb::FrequencyPlan clb::Timer0::setFrequency(float hz, clb::TOutputChannel channel) {
+    clb::FrequencyPlan _plan = planFrequency(hz, channel);
+    setFrequency(_plan, channel);
+    return _plan;
+}
 
-        uint8_t temp_sreg = SREG;
-        cli();
+//CTC (mode 2) toggles the pin on every match with OCR0A, fast PWM with TOP in OCR0A (mode 7) sets OC0B at BOTTOM and
+//clears it halfway. Only the bits of the channel are changed, the pin still has to be made an output
+void clb::Timer0::setFrequency(const clb::FrequencyPlan& plan, clb::TOutputChannel channel) {
+    if (plan.timer != 0 || plan.clock == 0 || plan.clock > 5 || channel == clb::TOutputChannel::C ||
+        (channel == clb::TOutputChannel::A && !plan.toggle)) {
+        CRITICAL("Timer0::setFrequency() needs a nonzero frequency and a plan from Timer0::planFrequency() for the same channel (A or B)");
+        return;
+    }
+    WARNING("setFrequency() modifies the clock source of Timer0 which affects delay(), millis() and micros() so watch out");
+    if (s_timer0_async.active) {
+        stopAsyncDelay();
+    }
+    uint8_t _index = static_cast<uint8_t>(channel);
+    uint8_t _top = (uint8_t)plan.top;
+    uint8_t _compare = plan.toggle ? _top : (uint8_t)((plan.top + 1) / 2 - 1); //half of the period
 
-        if (_asyncDelayActiveChannel == clb::TOutputChannel::A) {
-            TIMSK0 &= ~(BIT0 << OCIE0A); 
-            TIFR0 |= (BIT0 << OCF0A); 
-        } 
-        else {
-            TIMSK0 &= ~(BIT0 << OCIE0B); 
-            TIFR0 |= (BIT0 << OCF0B); 
-        }
+    CLB_CRITICAL_SECTION();
 
-        TCCR0A = _asyncSavedTCCR0A;
-        TCCR0B = _asyncSavedTCCR0B;
-        TCNT0 = _asyncSavedTCNT0;
-        OCR0A = _asyncSavedOCR0A;
-        OCR0B = _asyncSavedOCR0B;
-        TIMSK0 = _asyncSavedTIMSK0;
-        TIFR0 = _asyncSavedTIFR0;
-        SREG = _asyncSavedSREG; 
+    uint8_t _TCCR0A = TCCR0A & ~((BIT1 | BIT0) | ((BIT1 | BIT0) << (COM0A0 - 2 * _index))); //COM0A and COM0B follow the channel order downwards
+    uint8_t _TCCR0B = plan.clock;
+    if (plan.toggle) {
+        _TCCR0A |= (BIT0 << WGM01) | (BIT0 << (COM0A0 - 2 * _index));
+    }
+    else {
+        _TCCR0A |= (BIT0 << WGM01) | (BIT0 << WGM00) | (BIT0 << COM0B1);
+        _TCCR0B |= (BIT0 << WGM02);
+    }
 
-        _asyncDelayActive = false;
-        _asyncCurrentTicks = 0;
-        _asyncOverflowsCount = 0;
-        _asyncRemainingTicksValue = 0;
+    TCCR0B = 0; //stopped while TOP and the compare value change
+    TCNT0 = 0;
+    OCR0A = _top;
+    if (channel == clb::TOutputChannel::B) {
+        OCR0B = _compare;
     }
+    TCCR0A = _TCCR0A;
+    TCCR0B = _TCCR0B;
+    _clockSource = plan.clock;
+
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::OCRA, _top);
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TCCRA, _TCCR0A);
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 0, clb::TTraceRegister::TCCRB, _TCCR0B);
 }
 
 static uint32_t getPrescaler(clb::TSyncClock clock) {
@@ -598,7 +824,7 @@ static uint64_t calculateTicks(uint32_t value, clb::TTimeUnit unit, uint32_t pre
     return _ticks;
 }
 
-volatile uint8_t* getOcrRegister(clb::TOutputChannel channel) {
+static volatile uint8_t* getOcrRegister(clb::TOutputChannel channel) {
     switch (channel) {
         case clb::TOutputChannel::A: return &OCR0A;
         case clb::TOutputChannel::B: return &OCR0B;
@@ -606,7 +832,7 @@ volatile uint8_t* getOcrRegister(clb::TOutputChannel channel) {
     }
 }
 
-uint8_t getOcFlagBit(clb::TOutputChannel channel) {
+static uint8_t getOcFlagBit(clb::TOutputChannel channel) {
     switch (channel) {
         case clb::TOutputChannel::A: return OCF0A;
         case clb::TOutputChannel::B: return OCF0B;
@@ -1,128 +1,191 @@
 #include "clbTimer.h"
+#include "clbLatency.h"
+#include "clbStats.h"
+#include "clbTrace.h"
+#include "clbResource.h"
+#include "clbCriticalSection.h"
+#include "clbPreciseDelay.h"
 
-static clb::Timer1* s_active_timer1_instance = nullptr;
+CLB_CLAIM_TIMER(1);
 
-static uint32_t getPrescaler(clb::TAsynClock clock);
+static uint32_t getPrescaler(clb::TSyncClock clock);
 static uint64_t calculateTicks(uint32_t value, clb::TTimeUnit unit, uint32_t prescaler);
-volatile uint16_t* getOcrRegister(clb::TOutputChannel channel);
-uint16_t getOcFlagBit(clb::TOutputChannel channel);
+static volatile uint16_t* getOcrRegister(clb::TOutputChannel channel);
+static uint8_t getOcFlagBit(clb::TOutputChannel channel);
 
 static struct Timer1InterruptHandlers {
     void (*compareMatchACallback)() = nullptr;
+    const clb::Action* compareMatchAActions = nullptr; //PROGMEM action table, see clbAction.h
     void (*compareMatchBCallback)() = nullptr;
+    const clb::Action* compareMatchBActions = nullptr; //PROGMEM action table, see clbAction.h
+    void (*compareMatchCCallback)() = nullptr;
+    const clb::Action* compareMatchCActions = nullptr; //PROGMEM action table, see clbAction.h
     void (*overflowCallback)() = nullptr;
 } s_timer1_handlers;
 
+//async delay slots, one per compare channel, all on the same free running counter. Only one Timer1 can exist so they live
+//here and not in the instance
+static struct Timer1AsyncState {
+    uint32_t chunks[3] = {0, 0, 0}; //compare matches left per channel, every one after the first is a full 65536 ticks
+    volatile uint8_t active = 0; //BIT0 << channel for every running slot
+    uint8_t periodic = 0; //BIT0 << channel for every slot that re-arms itself
+    uint32_t reloadChunks[3] = {0, 0, 0}; //chunks of one period for the periodic slots
+    uint16_t reloadLead[3] = {0, 0, 0}; //ticks from the end of one period to the first match of the next
+} s_timer1_async;
+
+//registers saved when an async delay starts and put back when it ends
+static struct Timer1SavedConfig {
+    uint8_t tccra = 0;
+    uint8_t tccrb = 0;
+    uint8_t timsk = 0;
+    uint16_t tcnt = 0;
+    uint16_t ocra = 0;
+    uint16_t ocrb = 0;
+    uint16_t ocrc = 0;
+} s_timer1_saved;
+
+//puts the saved registers back, interrupts must be off
+static inline void restoreAsyncConfig() {
+    TCCR1A = s_timer1_saved.tccra;
+    TCCR1B = s_timer1_saved.tccrb;
+    TCNT1 = s_timer1_saved.tcnt;
+    OCR1A = s_timer1_saved.ocra;
+    OCR1B = s_timer1_saved.ocrb;
+    OCR1C = s_timer1_saved.ocrc;
+    TIMSK1 = s_timer1_saved.timsk;
+}
+
+//counts one compare match of a running async slot and returns true once its delay is over. The registers go back when
+//the last slot ends, interrupts must be off
+static inline bool asyncDelayMatch(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (--s_timer1_async.chunks[_index] != 0) {
+        return false;
+    }
+    if (s_timer1_async.periodic & (BIT0 << _index)) {
+        //next period, OCR moves on from this match so the period doesnt drift with the ISR latency
+        (&OCR1A)[_index] += s_timer1_async.reloadLead[_index]; //the OCRnx registers follow the channel order
+        s_timer1_async.chunks[_index] = s_timer1_async.reloadChunks[_index];
+        return true;
+    }
+    uint8_t _active = s_timer1_async.active & ~(BIT0 << _index);
+    s_timer1_async.active = _active;
+    CLB_TRACE(clb::TTraceEvent::ASYNC_STOP, 1, channel, 1);
+    if (_active == 0) {
+        restoreAsyncConfig();
+    }
+    else {
+        TIMSK1 &= ~(BIT0 << (OCIE1A + _index)); //OCIEnx and OCFnx bits follow the channel order
+    }
+    return true;
+}
+
+//overflow interrupts since the start, read by snapshot()
+static volatile uint32_t s_timer1_overflows = 0;
+
+//fixed cost in cpu cycles of a microsecond syncDelay, set by calibrateSyncDelay() or setSyncDelayOverhead()
+static uint16_t s_timer1_sync_overhead = 0; //timer path
+static uint16_t s_timer1_loop_overhead = 0; //counted loop path
+
+//TOP of the current waveform mode, see the TMode16 table in clbTimer.h
+static inline uint16_t currentTop() {
+    uint8_t _mode = (((TCCR1B >> WGM12) & 0b11) << 2) | (TCCR1A & (BIT1 | BIT0));
+    switch (_mode) {
+        case 0b0001: case 0b0101: return 0x00FF;
+        case 0b0010: case 0b0110: return 0x01FF;
+        case 0b0011: case 0b0111: return 0x03FF;
+        case 0b0100: case 0b1001: case 0b1011: case 0b1111: return OCR1A;
+        case 0b1000: case 0b1010: case 0b1100: case 0b1110: return ICR1;
+        default: return 0xFFFF;
+    }
+}
+
 //global ISRs for Timer1
 ISR(TIMER1_COMPA_vect) {
-    if (s_active_timer1_instance && s_active_timer1_instance->_asyncDelayActive && s_active_timer1_instance->_asyncDelayActiveChannel == clb::TOutputChannel::A) {
-        s_active_timer1_instance->_asyncOverflowsCount--;
-        if (s_active_timer1_instance->_asyncOverflowsCount == 0) {
-            s_active_timer1_instance->_asyncDelayActive = false;
-
-            TIMSK1 &= ~(BIT0 << OCIE1A);
+    CLB_LATENCY_RECORD(clb::TVector::TIMER1_COMPA, TCNT1, OCR1A, currentTop());
+    CLB_STATS_SCOPE(clb::TVector::TIMER1_COMPA);
+    CLB_TRACE(clb::TTraceEvent::COMPARE_MATCH, 1, clb::TOutputChannel::A, OCR1A);
 
-            uint8_t temp_sreg = SREG;
-            cli();
-            TCCR1A = s_active_timer1_instance->_asyncSavedTCCR1A;
-            TCCR1B = s_active_timer1_instance->_asyncSavedTCCR1B;
-            TCNT1  = s_active_timer1_instance->_asyncSavedTCNT1;
-            OCR1A  = s_active_timer1_instance->_asyncSavedOCR1A;
-            OCR1B  = s_active_timer1_instance->_asyncSavedOCR1B;
-            TIMSK1 = s_active_timer1_instance->_asyncSavedTIMSK1;
-            TIFR1  = s_active_timer1_instance->_asyncSavedTIFR1;
-            SREG   = temp_sreg;
-
-            if (s_timer1_handlers.compareMatchACallback) {
-                s_timer1_handlers.compareMatchACallback();
-            }
-        }
-        else {
-            if (s_active_timer1_instance->_asyncOverflowsCount == 1) {
-                OCR1A = s_active_timer1_instance->_asyncRemainingTicksValue;
-            }
-            else {
-                OCR1A = 255;
-            }
-        }
+    if ((s_timer1_async.active & (BIT0 << static_cast<uint8_t>(clb::TOutputChannel::A))) &&
+        !asyncDelayMatch(clb::TOutputChannel::A)) {
+        return;
     }
-    else {
-        if (s_timer1_handlers.compareMatchACallback) {
-            s_timer1_handlers.compareMatchACallback();
-        }
+
+    clb::Actions::run(s_timer1_handlers.compareMatchAActions);
+    if (s_timer1_handlers.compareMatchACallback) {
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_ENTER, 1, clb::TOutputChannel::A, 0);
+        s_timer1_handlers.compareMatchACallback();
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_EXIT, 1, clb::TOutputChannel::A, 0);
     }
 }
 
 ISR(TIMER1_COMPB_vect) {
-    if (s_active_timer1_instance && s_active_timer1_instance->_asyncDelayActive && s_active_timer1_instance->_asyncDelayActiveChannel == clb::TOutputChannel::B) {
-        s_active_timer1_instance->_asyncOverflowsCount--;
-        if (s_active_timer1_instance->_asyncOverflowsCount == 0) {
-            s_active_timer1_instance->_asyncDelayActive = false;
-            TIMSK1 &= ~(BIT0 << OCIE1B);
+    CLB_LATENCY_RECORD(clb::TVector::TIMER1_COMPB, TCNT1, OCR1B, currentTop());
+    CLB_STATS_SCOPE(clb::TVector::TIMER1_COMPB);
+    CLB_TRACE(clb::TTraceEvent::COMPARE_MATCH, 1, clb::TOutputChannel::B, OCR1B);
 
-            uint8_t temp_sreg = SREG;
-            cli();
-            TCCR1A = s_active_timer1_instance->_asyncSavedTCCR1A;
-            TCCR1B = s_active_timer1_instance->_asyncSavedTCCR1B;
-            TCNT1  = s_active_timer1_instance->_asyncSavedTCNT1;
-            OCR1A  = s_active_timer1_instance->_asyncSavedOCR1A;
-            OCR1B  = s_active_timer1_instance->_asyncSavedOCR1B;
-            TIMSK1 = s_active_timer1_instance->_asyncSavedTIMSK1;
-            TIFR1  = s_active_timer1_instance->_asyncSavedTIFR1;
-            SREG   = temp_sreg;
-
-            if (s_timer1_handlers.compareMatchBCallback) {
-                s_timer1_handlers.compareMatchBCallback();
-            }
-        }
-        else {
-            if (s_active_timer1_instance->_asyncOverflowsCount == 1) {
-                OCR1B = s_active_timer1_instance->_asyncRemainingTicksValue;
-            }
-            else {
-                OCR1B = 255;
-            }
-        }
+    if ((s_timer1_async.active & (BIT0 << static_cast<uint8_t>(clb::TOutputChannel::B))) &&
+        !asyncDelayMatch(clb::TOutputChannel::B)) {
+        return;
     }
-    else {
-        if (s_timer1_handlers.compareMatchBCallback) {
-            s_timer1_handlers.compareMatchBCallback();
-        }
+
+    clb::Actions::run(s_timer1_handlers.compareMatchBActions);
+    if (s_timer1_handlers.compareMatchBCallback) {
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_ENTER, 1, clb::TOutputChannel::B, 0);
+        s_timer1_handlers.compareMatchBCallback();
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_EXIT, 1, clb::TOutputChannel::B, 0);
+    }
+}
+
+ISR(TIMER1_COMPC_vect) {
+    CLB_LATENCY_RECORD(clb::TVector::TIMER1_COMPC, TCNT1, OCR1C, currentTop());
+    CLB_STATS_SCOPE(clb::TVector::TIMER1_COMPC);
+    CLB_TRACE(clb::TTraceEvent::COMPARE_MATCH, 1, clb::TOutputChannel::C, OCR1C);
+
+    if ((s_timer1_async.active & (BIT0 << static_cast<uint8_t>(clb::TOutputChannel::C))) &&
+        !asyncDelayMatch(clb::TOutputChannel::C)) {
+        return;
+    }
+
+    clb::Actions::run(s_timer1_handlers.compareMatchCActions);
+    if (s_timer1_handlers.compareMatchCCallback) {
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_ENTER, 1, clb::TOutputChannel::C, 0);
+        s_timer1_handlers.compareMatchCCallback();
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_EXIT, 1, clb::TOutputChannel::C, 0);
+    }
+}
+
+ISR(TIMER1_OVF_vect) {
+    CLB_LATENCY_RECORD(clb::TVector::TIMER1_OVF, TCNT1, 0, currentTop());
+    CLB_STATS_SCOPE(clb::TVector::TIMER1_OVF);
+    CLB_TRACE(clb::TTraceEvent::OVERFLOW, 1, CLB_TRACE_OVERFLOW, 0);
+
+    s_timer1_overflows++;
+    if (s_timer1_handlers.overflowCallback) {
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_ENTER, 1, CLB_TRACE_OVERFLOW, 0);
+        s_timer1_handlers.overflowCallback();
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_EXIT, 1, CLB_TRACE_OVERFLOW, 0);
     }
 }
 
 // Timer1 constructor/destructor
-clb::Timer1::Timer1() {
-    if (s_active_timer1_instance != nullptr) {
-        FATAL("There is already an instance of Timer1. Only one instance is allowed.");
-    }
-    s_active_timer1_instance = this;
-    _asyncDelayActive = false;
-    _asyncTargetTicks = 0;
-    _asyncOverflowsCount = 0;
-    _asyncRemainingTicksValue = 0;
-    _asyncDelayActiveChannel = clb::TOutputChannel::A;
-
-    _asyncSavedTCCR1A = 0;
-    _asyncSavedTCCR1B = 0;
-    _asyncSavedTCNT1 = 0;
-    _asyncSavedOCR1A = 0;
-    _asyncSavedOCR1B = 0;
-    _asyncSavedTIMSK1 = 0;
-    _asyncSavedTIFR1 = 0;
-    _asyncSavedSREG = 0;
+clb::Timer1& clb::Timer1::instance() {
+    static clb::Timer1 s_timer1;
+    return s_timer1;
 }
 
+clb::Timer1::Timer1() { }
+
 clb::Timer1::~Timer1() {
     deactivate();
 }
 
 void clb::Timer1::deactivate() {
-    if (_asyncDelayActive) {
+    if (s_timer1_async.active) {
         stopAsyncDelay();
     }
     
-    cli();
+    CLB_CRITICAL_SECTION();
 
     TIMSK1 = 0;
     TIFR1 = (BIT0 << OCF1A) | (BIT0 << OCF1B) | (BIT0 << TOV1);
@@ -132,10 +195,6 @@ void clb::Timer1::deactivate() {
     OCR1A = 0;
     OCR1B = 0;
     TCNT1 = 0;
-
-    sei();
-
-    s_active_timer1_instance = nullptr;
 }
 
 //set the mode in TCCR1A and TCCR1B
@@ -159,6 +218,9 @@ void clb::Timer1::setMode(TMode16 mode) {
 
     TCCR1A = _TCCR1A;
     TCCR1B = _TCCR1B;
+
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TCCRA, _TCCR1A);
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TCCRB, _TCCR1B);
 }
 
 //set the clock in TCCR1B
@@ -181,6 +243,7 @@ void clb::Timer1::setCompareMatchOutputModeA(TCMOM mode) {
     _TCCR1A |= (_bit1 | _bit0);
 
     TCCR1A = _TCCR1A;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TCCRA, _TCCR1A);
 }
 
 //set the compare match output mode for OC1B
@@ -198,13 +261,20 @@ void clb::Timer1::setCompareMatchOutputModeB(TCMOM mode) {
     _TCCR1A |= (_bit1 | _bit0);
 
     TCCR1A = _TCCR1A;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TCCRA, _TCCR1A);
 }
 
 //set the compare match value in OCR1A
-void clb::Timer1::setCompareMatchValueA(uint16_t value) { OCR1A = value; }
+void clb::Timer1::setCompareMatchValueA(uint16_t value) {
+    OCR1A = value;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::OCRA, value);
+}
 
 //set the compare match value in OCR1B
-void clb::Timer1::setCompareMatchValueB(uint16_t value) { OCR1B = value; }
+void clb::Timer1::setCompareMatchValueB(uint16_t value) {
+    OCR1B = value;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::OCRB, value);
+}
 
 //set the interrupt callback for the timer
 void clb::Timer1::setInterruptCallback(TInterrupt16 type, void (*callback)()) {
@@ -215,6 +285,9 @@ void clb::Timer1::setInterruptCallback(TInterrupt16 type, void (*callback)()) {
         case TInterrupt16::COMPMATCHB:
             s_timer1_handlers.compareMatchBCallback = callback;
             break;
+        case TInterrupt16::COMPMATCHC:
+            s_timer1_handlers.compareMatchCCallback = callback;
+            break;
         case TInterrupt16::OVERFLOW:
             s_timer1_handlers.overflowCallback = callback;
             break;
@@ -224,6 +297,25 @@ void clb::Timer1::setInterruptCallback(TInterrupt16 type, void (*callback)()) {
     }
 }
 
+//set the action table run by the compare match ISR, nullptr removes it
+void clb::Timer1::setInterruptActions(TInterrupt16 type, const clb::Action* actions) {
+    if (type != TInterrupt16::COMPMATCHA && type != TInterrupt16::COMPMATCHB && type != TInterrupt16::COMPMATCHC) {
+        CRITICAL("Action tables are only supported for COMPMATCHA, COMPMATCHB and COMPMATCHC");
+        return;
+    }
+
+    CLB_CRITICAL_SECTION();
+    if (type == TInterrupt16::COMPMATCHA) {
+        s_timer1_handlers.compareMatchAActions = actions;
+    }
+    else if (type == TInterrupt16::COMPMATCHB) {
+        s_timer1_handlers.compareMatchBActions = actions;
+    }
+    else {
+        s_timer1_handlers.compareMatchCActions = actions;
+    }
+}
+
 void clb::Timer1::enableInterrupt(TInterrupt16 type) {
     switch (type) {
         case TInterrupt16::COMPMATCHA:
@@ -232,6 +324,9 @@ void clb::Timer1::enableInterrupt(TInterrupt16 type) {
         case TInterrupt16::COMPMATCHB:
             TIMSK1 |= BIT0 << OCIE1B;
             break;
+        case TInterrupt16::COMPMATCHC:
+            TIMSK1 |= BIT0 << OCIE1C;
+            break;
         case TInterrupt16::OVERFLOW:
             TIMSK1 |= BIT0 << TOIE1;
             break;
@@ -239,6 +334,7 @@ void clb::Timer1::enableInterrupt(TInterrupt16 type) {
             CRITICAL("Invalid interrupt type for enabling interrupt");
             break;
     }
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TIMSK, TIMSK1);
 }
 
 void clb::Timer1::disableInterrupt(TInterrupt16 type) {
@@ -249,6 +345,9 @@ void clb::Timer1::disableInterrupt(TInterrupt16 type) {
         case TInterrupt16::COMPMATCHB:
             TIMSK1 &= ~(BIT0 << OCIE1B);
             break;
+        case TInterrupt16::COMPMATCHC:
+            TIMSK1 &= ~(BIT0 << OCIE1C);
+            break;
         case TInterrupt16::OVERFLOW:
             TIMSK1 &= ~(BIT0 << TOIE1);
             break;
@@ -256,6 +355,7 @@ void clb::Timer1::disableInterrupt(TInterrupt16 type) {
             CRITICAL("Invalid interrupt type for disabling interrupt");
             break;
     }
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TIMSK, TIMSK1);
 }
 
 bool clb::Timer1::getInterruptFlag(TInterrupt16 type) {
@@ -264,6 +364,8 @@ bool clb::Timer1::getInterruptFlag(TInterrupt16 type) {
             return (TIFR1 & BIT0 << OCF1A);
         case TInterrupt16::COMPMATCHB:
             return (TIFR1 & BIT0 << OCF1B);
+        case TInterrupt16::COMPMATCHC:
+            return (TIFR1 & BIT0 << OCF1C);
         case TInterrupt16::OVERFLOW:
             return (TIFR1 & BIT0 << TOV1);
         default:
@@ -281,6 +383,9 @@ void clb::Timer1::clearInterruptFlag(TInterrupt16 type) {
         case TInterrupt16::COMPMATCHB:
             TIFR1 |= BIT0 << OCF1B;
             break;
+        case TInterrupt16::COMPMATCHC:
+            TIFR1 |= BIT0 << OCF1C;
+            break;
         case TInterrupt16::OVERFLOW:
             TIFR1 |= BIT0 << TOV1;
             break;
@@ -300,10 +405,11 @@ void clb::Timer1::startTimer() {
     _TCCR1B |= _clockSource;
 
     TCCR1B = _TCCR1B;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TCCRB, _TCCR1B);
 }
 
 void clb::Timer1::stopTimer() {
-    if (_asyncDelayActive) {
+    if (s_timer1_async.active) {
         stopAsyncDelay();
     }
 
@@ -312,11 +418,49 @@ void clb::Timer1::stopTimer() {
     _TCCR1B &= ~(BIT2 | BIT1 | BIT0);
 
     TCCR1B = _TCCR1B;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TCCRB, _TCCR1B);
 }
 
-uint16_t clb::Timer1::getTimerValue16() { return TCNT1; }
+//16 bit accesses go through the shared TEMP register, an ISR touching another Timer1 16 bit register in between would corrupt them
+uint16_t clb::Timer1::getTimerValue16() {
+    CLB_CRITICAL_SECTION();
+    uint16_t _value = TCNT1;
+    return _value;
+}
+
+void clb::Timer1::setTimerValue(uint16_t value) {
+    CLB_CRITICAL_SECTION();
+    TCNT1 = value;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TCNT, value);
+}
 
-void clb::Timer1::setTimerValue(uint16_t value) { TCNT1 = value; }
+//the lock only covers the reads, 18 cycles (1.1us at 16MHz) counted from the generated code, the correction runs after it
+clb::TimerSnapshot clb::Timer1::snapshot() {
+    uint16_t _counter;
+    uint8_t _flags;
+    uint32_t _overflows;
+    uint8_t _timsk;
+    {
+        CLB_CRITICAL_SECTION();
+        _counter = TCNT1;
+        _flags = TIFR1;
+        _overflows = s_timer1_overflows;
+        _timsk = TIMSK1;
+    }
+
+    uint16_t _top = currentTop();
+    //TCNT1 was read first, so a pending overflow with a small count happened before the read and the ISR hasnt counted it yet
+    if ((_timsk & (BIT0 << TOIE1)) && (_flags & (BIT0 << TOV1)) && _counter < (_top >> 1)) {
+        _overflows++;
+    }
+
+    clb::TimerSnapshot _snapshot;
+    _snapshot.counter = _counter;
+    _snapshot.flags = _flags;
+    _snapshot.overflows = _overflows;
+    _snapshot.ticks = _overflows * ((uint32_t)_top + 1) + _counter;
+    return _snapshot;
+}
 
 void clb::Timer1::forceOutputCompareA() { TCCR1B |= BIT0 << FOC1A; }
 
@@ -340,11 +484,35 @@ void clb::Timer1::syncDelay(uint32_t time, clb::TTimeUnit unit, clb::TOutputChan
         _prescaler = getPrescaler(_clockSourceEnum);
     }
 
+#ifdef CLB_CYCLES_PER_US
+    //microseconds skip the 64 bit tick math and take the fixed cost of the call off the wait
+    if (unit == clb::TTimeUnit::MICROSECONDS && _prescaler != 0 && time <= 0xFFFFFFFFUL / CLB_CYCLES_PER_US) {
+        uint32_t _cycles = time * CLB_CYCLES_PER_US;
+        if (_cycles < CLB_SYNC_DELAY_LOOP_CYCLES) {
+            //shorter than setting the timer up, count cycles instead
+            clb::PreciseDelay::cycles((_cycles > s_timer1_loop_overhead) ? _cycles - s_timer1_loop_overhead : 0);
+            return;
+        }
+        _cycles = (_cycles > s_timer1_sync_overhead) ? _cycles - s_timer1_sync_overhead : 0;
+        while (_prescaler > 1) { //prescalers are powers of 2
+            _cycles >>= 1;
+            _prescaler >>= 1;
+        }
+        syncDelayLogic(_cycles, channel);
+        return;
+    }
+#endif
+
     uint64_t _ticks = calculateTicks(time, unit, _prescaler);
 
     syncDelayLogic(_ticks, channel);
 }
 
+void clb::Timer1::setSyncDelayOverhead(uint16_t timerCycles, uint16_t loopCycles) {
+    s_timer1_sync_overhead = timerCycles;
+    s_timer1_loop_overhead = loopCycles;
+}
+
 void clb::Timer1::asyncDelay(uint32_t time) {
     asyncDelay(time, clb::TTimeUnit::MILLISECONDS, clb::TOutputChannel::A);
 }
@@ -354,7 +522,14 @@ void clb::Timer1::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit) {
 }
 
 void clb::Timer1::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutputChannel channel) {
-    channel = static_cast<clb::TOutputChannel>(static_cast<uint8_t>(channel) & 0b11);
+    asyncDelay(time, timeUnit, channel, false);
+}
+
+void clb::Timer1::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutputChannel channel, bool periodic) {
+    if (static_cast<uint8_t>(channel) > static_cast<uint8_t>(clb::TOutputChannel::C)) {
+        CRITICAL("Invalid output channel for Timer1 asyncDelay.");
+        return;
+    }
 
     uint32_t _prescaler;
     clb::TSyncClock _clockSourceEnum = static_cast<clb::TSyncClock>(this->_clockSource);
@@ -372,193 +547,289 @@ void clb::Timer1::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutpu
 
     uint64_t calculatedTicks = calculateTicks(time, timeUnit, _prescaler);
 
-    asyncDelayLogic(calculatedTicks, channel);
+    asyncDelayLogic(calculatedTicks, channel, periodic);
 }
 
 //helpers
+//interrupts stay on while waiting, only the setup and the restore are locked. The Timer1 interrupts are masked for the
+//delay so no ISR clears the flags being polled. Other ISRs can run as long as none of them holds the cpu for a whole
+//timer period (65536 ticks), a longer one hides an overflow and stretches the delay by one period
 void clb::Timer1::syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) {
-    uint8_t _sreg = SREG;
-    cli();
-
-    uint8_t _tccr1a = TCCR1A;
-    uint8_t _tccr1b = TCCR1B;
-    uint8_t _tcnt1 = TCNT1;
-    uint8_t _ocr1a = OCR1A;
-    uint8_t _ocr1b = OCR1B;
-    uint8_t _timsk1 = TIMSK1;
-    uint8_t _tifr1 = TIFR1;
-
     volatile uint16_t* _ocr_reg = getOcrRegister(channel);
     uint8_t _oc_flag_bit = getOcFlagBit(channel);
 
-    TCCR1A = 0;
-    TCCR1B = 0;
-
-    uint32_t _prescaler = getPrescaler(static_cast<clb::TSyncClock>(this->_clockSource));
-    if (_prescaler == 0) {
-        TCCR1B = (BIT0 << CS12);
-    }
-    else {
-        TCCR1B = this->_clockSource;
-    }
-
-    TCNT1 = 0;
-    TIFR1 = (BIT0 << _oc_flag_bit) | (BIT0 << TOV1);
-
     const uint32_t MAX_TIMER1_TICKS = 65536;
 
     uint32_t _overflows = ticks / MAX_TIMER1_TICKS;
     uint16_t _remaining_ticks = ticks % MAX_TIMER1_TICKS;
 
-    for (uint32_t i = 0; i < _overflows; i++) {
-        while (!(TIFR1 & (BIT0 << TOV1))) {
+    uint8_t _tccr1a, _tccr1b, _timsk1, _tifr1;
+    uint16_t _tcnt1, _ocr1a, _ocr1b, _ocr1c;
+    {
+        CLB_CRITICAL_SECTION();
+
+        _tccr1a = TCCR1A;
+        _tccr1b = TCCR1B;
+        _tcnt1 = TCNT1;
+        _ocr1a = OCR1A;
+        _ocr1b = OCR1B;
+        _ocr1c = OCR1C;
+        _timsk1 = TIMSK1;
+        _tifr1 = TIFR1;
+
+        TIMSK1 = 0;
+        TCCR1A = 0;
+        TCCR1B = 0;
+        TCNT1 = 0;
+        if (_remaining_ticks > 0) {
+            *_ocr_reg = _remaining_ticks - 1;
+        }
+        TIFR1 = (BIT0 << _oc_flag_bit) | (BIT0 << TOV1);
+
+        uint32_t _prescaler = getPrescaler(static_cast<clb::TSyncClock>(this->_clockSource));
+        if (_prescaler == 0) {
+            TCCR1B = (BIT0 << CS12);
+        }
+        else {
+            TCCR1B = this->_clockSource;
         }
-        TIFR1 |= (BIT0 << TOV1);
+    }
+
+    for (uint32_t i = 0; i < _overflows; i++) {
+        while (!(TIFR1 & (BIT0 << TOV1))) { }
+        TIFR1 = (BIT0 << TOV1);
     }
     if (_remaining_ticks > 0) {
-        *_ocr_reg = _remaining_ticks - 1;
-        while (!(TIFR1 & (BIT0 << _oc_flag_bit))) { }
-        TIFR1 |= (BIT0 << _oc_flag_bit);
+        if (_overflows > 0) {
+            TIFR1 = (BIT0 << _oc_flag_bit); //the earlier periods set it too, only the match after the last overflow counts
+        }
+        //TCNT catches a match that an ISR delayed us past before the flag was cleared
+        while (!(TIFR1 & (BIT0 << _oc_flag_bit)) && TCNT1 < _remaining_ticks) { }
     }
 
+    CLB_CRITICAL_SECTION();
+
     TCCR1A = _tccr1a;
     TCCR1B = _tccr1b;
     TCNT1 = _tcnt1;
     OCR1A = _ocr1a;
     OCR1B = _ocr1b;
+    OCR1C = _ocr1c;
+    //clear what the delay raised, flags that were pending before stay pending
+    TIFR1 = ((BIT0 << OCF1A) | (BIT0 << OCF1B) | (BIT0 << OCF1C) | (BIT0 << TOV1)) & ~_tifr1;
     TIMSK1 = _timsk1;
-    TIFR1 = _tifr1;
-
-    SREG = _sreg;
 }
 
-void clb::Timer1::asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) {
-    if (_asyncDelayActive) {
-        WARNING("An asynchronous delay is already active on Timer1. Cannot start a new one.");
+//every channel is a slot of its own on the shared counter. The first slot saves the registers, puts the timer in normal
+//mode and starts it from 0, the ones after it set their OCR relative to the running TCNT
+void clb::Timer1::asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (s_timer1_async.active & (BIT0 << _index)) {
+        WARNING("An asynchronous delay is already active on this Timer1 channel. Cannot start a new one.");
         return;
     }
     if (ticks == 0) {
         WARNING("asyncDelay(0) called. Delay will complete immediately.");
-        _asyncDelayActive = false;
         return;
     }
 
-    _asyncSavedSREG = SREG;
-    cli();
-
-    _asyncSavedTCCR1A = TCCR1A;
-    _asyncSavedTCCR1B = TCCR1B;
-    _asyncSavedTCNT1 = TCNT1;
-    _asyncSavedOCR1A = OCR1A;
-    _asyncSavedOCR1B = OCR1B;
-    _asyncSavedTIMSK1 = TIMSK1;
-    _asyncSavedTIFR1 = TIFR1;
-
-    TCCR1A = 0;
-    TCCR1B = 0;
-    TCNT1 = 0;
-
     const uint32_t MAX_TIMER1_TICKS = 65536;
 
-    _asyncTargetTicks = ticks;
-
-    uint32_t numFullCycles = ticks / MAX_TIMER1_TICKS;
-    uint16_t remainderTicks = ticks % MAX_TIMER1_TICKS;
+    //the first match comes after the remainder, the rest a full counter period apart at the same OCR value
+    uint32_t _chunks = ticks / MAX_TIMER1_TICKS;
+    uint16_t _lead = ticks % MAX_TIMER1_TICKS;
+    if (_lead != 0) {
+        _chunks++;
+    }
 
-    if (remainderTicks == 0) {
-        _asyncOverflowsCount = numFullCycles;
-        _asyncRemainingTicksValue = MAX_TIMER1_TICKS - 1;
+    uint32_t _prescaler = getPrescaler(static_cast<clb::TSyncClock>(this->_clockSource));
+    uint8_t _clockBits = (_prescaler == 0) ? ((BIT0 << CS11) | (BIT0 << CS10)) : this->_clockSource;
+    if (_prescaler == 0) {
+        _prescaler = 64;
     }
-    else {
-        _asyncOverflowsCount = numFullCycles + 1;
-        _asyncRemainingTicksValue = remainderTicks - 1;
+    //a periodic slot moves OCR on in the ISR, the next match has to be far enough ahead (128 cycles) to still be in front of TCNT then
+    if (periodic && _lead != 0 && _lead < 128 / _prescaler + 2) {
+        CRITICAL("Periodic asyncDelay on Timer1 is too close above a whole number of counter periods, pick another period or a slower clock.");
+        return;
     }
+    uint32_t _reloadChunks = _chunks;
+    uint16_t _reloadLead = _lead;
+
+    CLB_CRITICAL_SECTION();
 
-    TCCR1A |= (BIT0 << WGM11);
+    uint8_t _active = s_timer1_async.active;
+    uint16_t _now = 0;
+    if (_active == 0) {
+        s_timer1_saved.tccra = TCCR1A;
+        s_timer1_saved.tccrb = TCCR1B;
+        s_timer1_saved.tcnt = TCNT1;
+        s_timer1_saved.ocra = OCR1A;
+        s_timer1_saved.ocrb = OCR1B;
+        s_timer1_saved.ocrc = OCR1C;
+        s_timer1_saved.timsk = TIMSK1;
 
-    uint32_t prescaler_val_for_setup = getPrescaler(static_cast<clb::TAsynClock>(this->_clockSource));
-    if (prescaler_val_for_setup == 0) {
-        TCCR1B |= (BIT0 << CS11) | (BIT0 << CS10);
+        //normal mode so TOP stays at 0xFFFF for every channel
+        TCCR1A = 0;
+        TCCR1B = 0;
+        TCNT1 = 0;
     }
     else {
-        TCCR1B |= this->_clockSource;
-    }
-
-    if (channel == clb::TOutputChannel::A) {
-        TIFR1 |= (BIT0 << OCF1A);
-        if (numFullCycles == 0 && remainderTicks > 0) {
-            OCR1A = _asyncRemainingTicksValue;
-        }
-        else {
-            OCR1A = MAX_TIMER1_TICKS - 1;
+        //the counter runs for the other slots, the match has to be far enough ahead that TCNT doesnt pass it before the
+        //OCR write below (64 cycles), a shorter first chunk is stretched to that
+        uint16_t _minLead = 64 / _prescaler + 2;
+        if (_lead < _minLead) {
+            if (_lead == 0) {
+                _chunks++;
+            }
+            _lead = _minLead;
         }
-        TIMSK1 |= (BIT0 << OCIE1A);
+        _now = TCNT1;
     }
-    else if (channel == clb::TOutputChannel::B) {
-        TIFR1 |= (BIT0 << OCF1B);
-        if (numFullCycles == 0 && remainderTicks > 0) {
-            OCR1B = _asyncRemainingTicksValue;
-        }
-        else {
-            OCR1B = MAX_TIMER1_TICKS - 1;
-        }
-        TIMSK1 |= (BIT0 << OCIE1B);
+
+    *getOcrRegister(channel) = _now + _lead - 1;
+    TIFR1 = (BIT0 << (OCF1A + _index));
+    TIMSK1 |= (BIT0 << (OCIE1A + _index));
+    s_timer1_async.chunks[_index] = _chunks;
+    s_timer1_async.reloadChunks[_index] = _reloadChunks;
+    s_timer1_async.reloadLead[_index] = _reloadLead;
+    if (periodic) {
+        s_timer1_async.periodic |= (BIT0 << _index);
     }
     else {
-        TIFR1 |= (BIT0 << OCF1C);
-        if (numFullCycles == 0 && remainderTicks > 0) {
-            OCR1C = _asyncRemainingTicksValue;
-        }
-        else {
-            OCR1C = MAX_TIMER1_TICKS - 1;
-        }
-        TIMSK1 |= (BIT0 << OCIE1C);
+        s_timer1_async.periodic &= ~(BIT0 << _index);
     }
+    s_timer1_async.active = _active | (BIT0 << _index);
 
-    _asyncDelayActive = true;
-    _asyncDelayActiveChannel = channel;
+    if (_active == 0) {
+        TCCR1B = _clockBits;
+    }
 
-    SREG = _asyncSavedSREG;
+    CLB_TRACE(clb::TTraceEvent::ASYNC_START, 1, channel, (_chunks > 0xFFFF) ? 0xFFFF : _chunks);
 }
 
 bool clb::Timer1::isAsyncDelayFinished() {
-    return !_asyncDelayActive;
+    return s_timer1_async.active == 0;
 }
 
-void clb::Timer1::stopAsyncDelay() {
-    if (_asyncDelayActive) {
-        WARNING("Stopping active asynchronous delay on Timer1.");
+bool clb::Timer1::isAsyncDelayFinished(clb::TOutputChannel channel) {
+    return !(s_timer1_async.active & (BIT0 << static_cast<uint8_t>(channel)));
+}
 
-        uint8_t temp_sreg = SREG;
-        cli();
+uint32_t clb::Timer1::remaining() {
+    return remaining(clb::TOutputChannel::A);
+}
 
-        if (_asyncDelayActiveChannel == clb::TOutputChannel::A) {
-            TIMSK1 &= ~(BIT0 << OCIE1A);
-            TIFR1 |= (BIT0 << OCF1A);
-        }
-        else if (_asyncDelayActiveChannel == clb::TOutputChannel::B) {
-            TIMSK1 &= ~(BIT0 << OCIE1B);
-            TIFR1 |= (BIT0 << OCF1B);
+uint32_t clb::Timer1::remaining(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (_index > static_cast<uint8_t>(clb::TOutputChannel::C)) {
+        CRITICAL("Invalid output channel for Timer1 remaining().");
+        return 0;
+    }
+
+    uint32_t _chunks;
+    uint16_t _distance;
+    bool _pending;
+    {
+        CLB_CRITICAL_SECTION();
+        if (!(s_timer1_async.active & (BIT0 << _index))) {
+            return 0;
         }
-        else {
-            TIMSK1 &= ~(BIT0 << OCIE1C);
-            TIFR1 |= (BIT0 << OCF1C);
+        _chunks = s_timer1_async.chunks[_index];
+        _distance = (&OCR1A)[_index] - TCNT1;
+        _pending = TIFR1 & (BIT0 << (OCF1A + _index));
+    }
+    if (_pending) {
+        //matched but the ISR hasnt counted it yet, the next match is a full period away
+        if (_chunks <= 1) {
+            return 0;
         }
+        _chunks--;
+    }
 
-        TCCR1A = _asyncSavedTCCR1A;
-        TCCR1B = _asyncSavedTCCR1B;
-        TCNT1 = _asyncSavedTCNT1;
-        OCR1A = _asyncSavedOCR1A;
-        OCR1B = _asyncSavedOCR1B;
-        TIMSK1 = _asyncSavedTIMSK1;
-        TIFR1 = _asyncSavedTIFR1;
-        SREG = _asyncSavedSREG;
+    //ticks to the next match, then a full period for every match after it
+    uint64_t _ticks = (uint64_t)_distance + 1 + (uint64_t)(_chunks - 1) * 65536;
+    uint32_t _prescaler = getPrescaler(static_cast<clb::TSyncClock>(this->_clockSource));
+    if (_prescaler == 0) {
+        _prescaler = 64;
+    }
+    uint64_t _microseconds = _ticks * _prescaler / (F_CPU / 1000000UL);
+    return (_microseconds > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : _microseconds;
+}
 
-        _asyncDelayActive = false;
-        _asyncCurrentTicks = 0;
-        _asyncOverflowsCount = 0;
-        _asyncRemainingTicksValue = 0;
+void clb::Timer1::stopAsyncDelay() {
+    stopAsyncDelay(clb::TOutputChannel::A);
+    stopAsyncDelay(clb::TOutputChannel::B);
+    stopAsyncDelay(clb::TOutputChannel::C);
+}
+
+void clb::Timer1::stopAsyncDelay(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (!(s_timer1_async.active & (BIT0 << _index))) {
+        return;
     }
+    WARNING("Stopping active asynchronous delay on Timer1.");
+
+    CLB_CRITICAL_SECTION();
+
+    uint8_t _active = s_timer1_async.active;
+    if (!(_active & (BIT0 << _index))) {
+        return; //ended by itself in the meantime
+    }
+    TIMSK1 &= ~(BIT0 << (OCIE1A + _index));
+    TIFR1 = (BIT0 << (OCF1A + _index));
+    s_timer1_async.chunks[_index] = 0;
+    s_timer1_async.periodic &= ~(BIT0 << _index);
+    _active &= ~(BIT0 << _index);
+    s_timer1_async.active = _active;
+    if (_active == 0) {
+        restoreAsyncConfig();
+    }
+
+    CLB_TRACE(clb::TTraceEvent::ASYNC_STOP, 1, channel, 0);
+}
+
+clb::FrequencyPlan clb::Timer1::setFrequency(float hz, clb::TOutputChannel channel) {
+    clb::FrequencyPlan _plan = planFrequency(hz, channel);
+    setFrequency(_plan, channel);
+    return _plan;
+}
+
+//TOP goes in ICR1 so every channel keeps its own compare register: CTC (mode 12) toggles the pin on every match, fast PWM
+//(mode 14) sets it at BOTTOM and clears it halfway. The period is shared by OC1A, OC1B and OC1C, only the bits of the
+//channel are changed and the pin still has to be made an output
+void clb::Timer1::setFrequency(const clb::FrequencyPlan& plan, clb::TOutputChannel channel) {
+    if (plan.timer != 1 || plan.clock == 0 || plan.clock > 5) {
+        CRITICAL("Timer1::setFrequency() needs a nonzero frequency and a plan from Timer1::planFrequency()");
+        return;
+    }
+    if (s_timer1_async.active) {
+        stopAsyncDelay();
+    }
+    uint8_t _index = static_cast<uint8_t>(channel);
+    uint16_t _compare = plan.toggle ? plan.top : (uint16_t)((plan.top + 1UL) / 2 - 1); //half of the period
+
+    CLB_CRITICAL_SECTION();
+
+    uint8_t _TCCR1A = TCCR1A & ~((BIT1 | BIT0) | ((BIT1 | BIT0) << (COM1A0 - 2 * _index))); //COM1A, COM1B and COM1C follow the channel order downwards
+    uint8_t _TCCR1B = (BIT0 << WGM13) | (BIT0 << WGM12) | plan.clock;
+    if (plan.toggle) {
+        _TCCR1A |= (BIT0 << (COM1A0 - 2 * _index));
+    }
+    else {
+        _TCCR1A |= (BIT0 << WGM11) | (BIT0 << (COM1A1 - 2 * _index));
+    }
+
+    TCCR1B = 0; //stopped while TOP and the compare value change
+    TCNT1 = 0;
+    ICR1 = plan.top;
+    *getOcrRegister(channel) = _compare;
+    TCCR1A = _TCCR1A;
+    TCCR1B = _TCCR1B;
+    _clockSource = plan.clock;
+
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::ICR, plan.top);
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TCCRA, _TCCR1A);
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 1, clb::TTraceRegister::TCCRB, _TCCR1B);
 }
 
 static uint32_t getPrescaler(clb::TSyncClock clock) {
@@ -566,9 +837,9 @@ static uint32_t getPrescaler(clb::TSyncClock clock) {
         case clb::TSyncClock::STOPPED: return 0;
         case clb::TSyncClock::DIV_1: return 1;
         case clb::TSyncClock::DIV_8: return 8;
-        case clb::TSyncClock::DIV_64: return 32;
-        case clb::TSyncClock::DIV_256: return 64;
-        case clb::TSyncClock::DIV_1024: return 128;
+        case clb::TSyncClock::DIV_64: return 64;
+        case clb::TSyncClock::DIV_256: return 256;
+        case clb::TSyncClock::DIV_1024: return 1024;
         default: return 1;
     }
 }
@@ -588,7 +859,7 @@ static uint64_t calculateTicks(uint32_t value, clb::TTimeUnit unit, uint32_t pre
     return _ticks;
 }
 
-volatile uint16_t* getOcrRegister(clb::TOutputChannel channel) {
+static volatile uint16_t* getOcrRegister(clb::TOutputChannel channel) {
     switch (channel) {
         case clb::TOutputChannel::A: return &OCR1A;
         case clb::TOutputChannel::B: return &OCR1B;
@@ -597,7 +868,7 @@ volatile uint16_t* getOcrRegister(clb::TOutputChannel channel) {
     }
 }
 
-uint16_t getOcFlagBit(clb::TOutputChannel channel) {
+static uint8_t getOcFlagBit(clb::TOutputChannel channel) {
     switch (channel) {
         case clb::TOutputChannel::A: return OCF1A;
         case clb::TOutputChannel::B: return OCF1B;
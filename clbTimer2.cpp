@@ -1,117 +1,154 @@
 #include "clbTimer.h"
+#include "clbLatency.h"
+#include "clbStats.h"
+#include "clbTrace.h"
+#include "clbResource.h"
+#include "clbCriticalSection.h"
+#include "clbPreciseDelay.h"
 
-static clb::Timer2* s_active_timer2_instance = nullptr;
+CLB_CLAIM_TIMER(2);
 
 static uint32_t getPrescaler(clb::TAsynClock clock);
 static uint64_t calculateTicks(uint32_t value, clb::TTimeUnit unit, uint32_t prescaler);
-volatile uint8_t* getOcrRegister(clb::TOutputChannel channel);
-uint8_t getOcFlagBit(clb::TOutputChannel channel);
+static volatile uint8_t* getOcrRegister(clb::TOutputChannel channel);
+static uint8_t getOcFlagBit(clb::TOutputChannel channel);
 
 static struct Timer2InterruptHandlers {
     void (*compareMatchACallback)() = nullptr;
+    const clb::Action* compareMatchAActions = nullptr; //PROGMEM action table, see clbAction.h
     void (*compareMatchBCallback)() = nullptr;
+    const clb::Action* compareMatchBActions = nullptr; //PROGMEM action table, see clbAction.h
     void (*overflowCallback)() = nullptr;
 } s_timer2_handlers;
 
+//async delay slots, one per compare channel, both on the same free running counter. Only one Timer2 can exist so they
+//live here and not in the instance
+static struct Timer2AsyncState {
+    uint32_t chunks[2] = {0, 0}; //compare matches left per channel, every one after the first is a full 256 ticks
+    volatile uint8_t active = 0; //BIT0 << channel for every running slot
+    uint8_t periodic = 0; //BIT0 << channel for every slot that re-arms itself
+    uint32_t reloadChunks[2] = {0, 0}; //chunks of one period for the periodic slots
+    uint8_t reloadLead[2] = {0, 0}; //ticks from the end of one period to the first match of the next
+} s_timer2_async;
+
+//registers saved when an async delay starts and put back when it ends
+static struct Timer2SavedConfig {
+    uint8_t tccra = 0;
+    uint8_t tccrb = 0;
+    uint8_t tcnt = 0;
+    uint8_t ocra = 0;
+    uint8_t ocrb = 0;
+    uint8_t timsk = 0;
+} s_timer2_saved;
+
+//puts the saved registers back, interrupts must be off
+static inline void restoreAsyncConfig() {
+    TCCR2A = s_timer2_saved.tccra;
+    TCCR2B = s_timer2_saved.tccrb;
+    TCNT2 = s_timer2_saved.tcnt;
+    OCR2A = s_timer2_saved.ocra;
+    OCR2B = s_timer2_saved.ocrb;
+    TIMSK2 = s_timer2_saved.timsk;
+}
+
+//counts one compare match of a running async slot and returns true once its delay is over. The registers go back when
+//the last slot ends, interrupts must be off
+static inline bool asyncDelayMatch(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (--s_timer2_async.chunks[_index] != 0) {
+        return false;
+    }
+    if (s_timer2_async.periodic & (BIT0 << _index)) {
+        //next period, OCR moves on from this match so the period doesnt drift with the ISR latency
+        (&OCR2A)[_index] += s_timer2_async.reloadLead[_index]; //the OCRnx registers follow the channel order
+        s_timer2_async.chunks[_index] = s_timer2_async.reloadChunks[_index];
+        return true;
+    }
+    uint8_t _active = s_timer2_async.active & ~(BIT0 << _index);
+    s_timer2_async.active = _active;
+    CLB_TRACE(clb::TTraceEvent::ASYNC_STOP, 2, channel, 1);
+    if (_active == 0) {
+        restoreAsyncConfig();
+    }
+    else {
+        TIMSK2 &= ~(BIT0 << (OCIE2A + _index)); //OCIEnx and OCFnx bits follow the channel order
+    }
+    return true;
+}
+
+//overflow interrupts since the start, read by snapshot()
+static volatile uint32_t s_timer2_overflows = 0;
+
+//fixed cost in cpu cycles of a microsecond syncDelay, set by calibrateSyncDelay() or setSyncDelayOverhead()
+static uint16_t s_timer2_sync_overhead = 0; //timer path
+static uint16_t s_timer2_loop_overhead = 0; //counted loop path
+
+//TOP of the current waveform mode, OCR2A for CTC and the OCR2A top PWM modes, 0xFF for the rest
+static inline uint8_t currentTop() {
+    if ((TCCR2B & (BIT0 << WGM22)) || ((TCCR2A & (BIT1 | BIT0)) == (BIT0 << WGM21))) {
+        return OCR2A;
+    }
+    return 0xFF;
+}
+
 //global ISRs for Timer2
 ISR(TIMER2_COMPA_vect) {
-    if (s_active_timer2_instance && s_active_timer2_instance->_asyncDelayActive && s_active_timer2_instance->_asyncDelayActiveChannel == clb::TOutputChannel::A) {
-        s_active_timer2_instance->_asyncOverflowsCount--;
-        if (s_active_timer2_instance->_asyncOverflowsCount == 0) {
-            s_active_timer2_instance->_asyncDelayActive = false;
+    CLB_LATENCY_RECORD(clb::TVector::TIMER2_COMPA, TCNT2, OCR2A, currentTop());
+    CLB_STATS_SCOPE(clb::TVector::TIMER2_COMPA);
+    CLB_TRACE(clb::TTraceEvent::COMPARE_MATCH, 2, clb::TOutputChannel::A, OCR2A);
 
-            TIMSK2 &= ~(BIT0 << OCIE2A);
-
-            uint8_t temp_sreg = SREG;
-            cli();
-            TCCR2A = s_active_timer2_instance->_asyncSavedTCCR2A;
-            TCCR2B = s_active_timer2_instance->_asyncSavedTCCR2B;
-            TCNT2  = s_active_timer2_instance->_asyncSavedTCNT2;
-            OCR2A  = s_active_timer2_instance->_asyncSavedOCR2A;
-            OCR2B  = s_active_timer2_instance->_asyncSavedOCR2B;
-            TIMSK2 = s_active_timer2_instance->_asyncSavedTIMSK2;
-            TIFR2  = s_active_timer2_instance->_asyncSavedTIFR2;
-            SREG   = temp_sreg;
-
-            if (s_timer2_handlers.compareMatchACallback) {
-                s_timer2_handlers.compareMatchACallback();
-            }
-        }
-        else {
-            if (s_active_timer2_instance->_asyncOverflowsCount == 1) {
-                OCR2A = s_active_timer2_instance->_asyncRemainingTicksValue;
-            }
-            else {
-                OCR2A = 255;
-            }
-        }
+    if ((s_timer2_async.active & (BIT0 << static_cast<uint8_t>(clb::TOutputChannel::A))) &&
+        !asyncDelayMatch(clb::TOutputChannel::A)) {
+        return;
     }
-    else {
-        if (s_timer2_handlers.compareMatchACallback) {
-            s_timer2_handlers.compareMatchACallback();
-        }
+
+    clb::Actions::run(s_timer2_handlers.compareMatchAActions);
+    if (s_timer2_handlers.compareMatchACallback) {
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_ENTER, 2, clb::TOutputChannel::A, 0);
+        s_timer2_handlers.compareMatchACallback();
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_EXIT, 2, clb::TOutputChannel::A, 0);
     }
 }
 
 ISR(TIMER2_COMPB_vect) {
-    if (s_active_timer2_instance && s_active_timer2_instance->_asyncDelayActive && s_active_timer2_instance->_asyncDelayActiveChannel == clb::TOutputChannel::B) {
-        s_active_timer2_instance->_asyncOverflowsCount--;
-        if (s_active_timer2_instance->_asyncOverflowsCount == 0) {
-            s_active_timer2_instance->_asyncDelayActive = false;
-            TIMSK2 &= ~(BIT0 << OCIE2B);
+    CLB_LATENCY_RECORD(clb::TVector::TIMER2_COMPB, TCNT2, OCR2B, currentTop());
+    CLB_STATS_SCOPE(clb::TVector::TIMER2_COMPB);
+    CLB_TRACE(clb::TTraceEvent::COMPARE_MATCH, 2, clb::TOutputChannel::B, OCR2B);
 
-            uint8_t temp_sreg = SREG;
-            cli();
-            TCCR2A = s_active_timer2_instance->_asyncSavedTCCR2A;
-            TCCR2B = s_active_timer2_instance->_asyncSavedTCCR2B;
-            TCNT2  = s_active_timer2_instance->_asyncSavedTCNT2;
-            OCR2A  = s_active_timer2_instance->_asyncSavedOCR2A;
-            OCR2B  = s_active_timer2_instance->_asyncSavedOCR2B;
-            TIMSK2 = s_active_timer2_instance->_asyncSavedTIMSK2;
-            TIFR2  = s_active_timer2_instance->_asyncSavedTIFR2;
-            SREG   = temp_sreg;
-
-            if (s_timer2_handlers.compareMatchBCallback) {
-                s_timer2_handlers.compareMatchBCallback();
-            }
-        }
-        else {
-            if (s_active_timer2_instance->_asyncOverflowsCount == 1) {
-                OCR2B = s_active_timer2_instance->_asyncRemainingTicksValue;
-            }
-            else {
-                OCR2B = 255;
-            }
-        }
+    if ((s_timer2_async.active & (BIT0 << static_cast<uint8_t>(clb::TOutputChannel::B))) &&
+        !asyncDelayMatch(clb::TOutputChannel::B)) {
+        return;
     }
-    else {
-        if (s_timer2_handlers.compareMatchBCallback) {
-            s_timer2_handlers.compareMatchBCallback();
-        }
+
+    clb::Actions::run(s_timer2_handlers.compareMatchBActions);
+    if (s_timer2_handlers.compareMatchBCallback) {
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_ENTER, 2, clb::TOutputChannel::B, 0);
+        s_timer2_handlers.compareMatchBCallback();
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_EXIT, 2, clb::TOutputChannel::B, 0);
+    }
+}
+
+ISR(TIMER2_OVF_vect) {
+    CLB_LATENCY_RECORD(clb::TVector::TIMER2_OVF, TCNT2, 0, currentTop());
+    CLB_STATS_SCOPE(clb::TVector::TIMER2_OVF);
+    CLB_TRACE(clb::TTraceEvent::OVERFLOW, 2, CLB_TRACE_OVERFLOW, 0);
+
+    s_timer2_overflows++;
+    if (s_timer2_handlers.overflowCallback) {
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_ENTER, 2, CLB_TRACE_OVERFLOW, 0);
+        s_timer2_handlers.overflowCallback();
+        CLB_TRACE(clb::TTraceEvent::CALLBACK_EXIT, 2, CLB_TRACE_OVERFLOW, 0);
     }
 }
 
 // Timer2 constructor/destructor
+clb::Timer2& clb::Timer2::instance() {
+    static clb::Timer2 s_timer2;
+    return s_timer2;
+}
+
 clb::Timer2::Timer2() {
     WARNING("Using Timer2 is not recommended since any change will basically break the tone() and noTone() functions.");
-    if (s_active_timer2_instance != nullptr) {
-        FATAL("There is already an instance of Timer2. Only one instance is allowed.");
-    }
-    s_active_timer2_instance = this;
-    _asyncDelayActive = false;
-    _asyncTargetTicks = 0;
-    _asyncOverflowsCount = 0;
-    _asyncRemainingTicksValue = 0;
-    _asyncDelayActiveChannel = clb::TOutputChannel::A;
-
-    _asyncSavedTCCR2A = 0;
-    _asyncSavedTCCR2B = 0;
-    _asyncSavedTCNT2 = 0;
-    _asyncSavedOCR2A = 0;
-    _asyncSavedOCR2B = 0;
-    _asyncSavedTIMSK2 = 0;
-    _asyncSavedTIFR2 = 0;
-    _asyncSavedSREG = 0;
 }
 
 clb::Timer2::~Timer2() {
@@ -119,11 +156,11 @@ clb::Timer2::~Timer2() {
 }
 
 void clb::Timer2::deactivate() {
-    if (_asyncDelayActive) {
+    if (s_timer2_async.active) {
         stopAsyncDelay();
     }
     
-    cli();
+    CLB_CRITICAL_SECTION();
 
     TIMSK2 = 0;
     TIFR2 = (BIT0 << OCF2A) | (BIT0 << OCF2B) | (BIT0 << TOV2);
@@ -133,10 +170,6 @@ void clb::Timer2::deactivate() {
     OCR2A = 0;
     OCR2B = 0;
     TCNT2 = 0;
-
-    sei();
-
-    s_active_timer2_instance = nullptr;
 }
 
 //set the mode in TCCR2A and TCCR2B
@@ -160,6 +193,9 @@ void clb::Timer2::setMode(TMode8 mode) {
 
     TCCR2A = _TCCR2A;
     TCCR2B = _TCCR2B;
+
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TCCRA, _TCCR2A);
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TCCRB, _TCCR2B);
 }
 
 //set the clock in TCCR2B
@@ -182,6 +218,7 @@ void clb::Timer2::setCompareMatchOutputModeA(TCMOM mode) {
     _TCCR2A |= (_bit1 | _bit0);
 
     TCCR2A = _TCCR2A;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TCCRA, _TCCR2A);
 }
 
 //set the compare match output mode for OC2B
@@ -199,13 +236,20 @@ void clb::Timer2::setCompareMatchOutputModeB(TCMOM mode) {
     _TCCR2A |= (_bit1 | _bit0);
 
     TCCR2A = _TCCR2A;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TCCRA, _TCCR2A);
 }
 
 //set the compare match value in OCR2A
-void clb::Timer2::setCompareMatchValueA(uint8_t value) { OCR2A = value; }
+void clb::Timer2::setCompareMatchValueA(uint8_t value) {
+    OCR2A = value;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::OCRA, value);
+}
 
 //set the compare match value in OCR2B
-void clb::Timer2::setCompareMatchValueB(uint8_t value) { OCR2B = value; }
+void clb::Timer2::setCompareMatchValueB(uint8_t value) {
+    OCR2B = value;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::OCRB, value);
+}
 
 //set the interrupt callback for the timer
 void clb::Timer2::setInterruptCallback(TInterrupt8 type, void (*callback)()) {
@@ -225,6 +269,22 @@ void clb::Timer2::setInterruptCallback(TInterrupt8 type, void (*callback)()) {
     }
 }
 
+//set the action table run by the compare match ISR, nullptr removes it
+void clb::Timer2::setInterruptActions(TInterrupt8 type, const clb::Action* actions) {
+    if (type != TInterrupt8::COMPMATCHA && type != TInterrupt8::COMPMATCHB) {
+        CRITICAL("Action tables are only supported for COMPMATCHA and COMPMATCHB");
+        return;
+    }
+
+    CLB_CRITICAL_SECTION();
+    if (type == TInterrupt8::COMPMATCHA) {
+        s_timer2_handlers.compareMatchAActions = actions;
+    }
+    else {
+        s_timer2_handlers.compareMatchBActions = actions;
+    }
+}
+
 void clb::Timer2::enableInterrupt(TInterrupt8 type) {
     switch (type) {
         case TInterrupt8::COMPMATCHA:
@@ -240,6 +300,7 @@ void clb::Timer2::enableInterrupt(TInterrupt8 type) {
             CRITICAL("Invalid interrupt type for enabling interrupt");
             break;
     }
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TIMSK, TIMSK2);
 }
 
 void clb::Timer2::disableInterrupt(TInterrupt8 type) {
@@ -257,6 +318,7 @@ void clb::Timer2::disableInterrupt(TInterrupt8 type) {
             CRITICAL("Invalid interrupt type for disabling interrupt");
             break;
     }
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TIMSK, TIMSK2);
 }
 
 bool clb::Timer2::getInterruptFlag(TInterrupt8 type) {
@@ -301,10 +363,11 @@ void clb::Timer2::startTimer() {
     _TCCR2B |= _clockSource;
 
     TCCR2B = _TCCR2B;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TCCRB, _TCCR2B);
 }
 
 void clb::Timer2::stopTimer() {
-    if (_asyncDelayActive) {
+    if (s_timer2_async.active) {
         stopAsyncDelay();
     }
 
@@ -313,18 +376,50 @@ void clb::Timer2::stopTimer() {
     _TCCR2B &= ~(BIT2 | BIT1 | BIT0);
 
     TCCR2B = _TCCR2B;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TCCRB, _TCCR2B);
 }
 
 uint8_t clb::Timer2::getTimerValue8() { return TCNT2; }
 
-void clb::Timer2::setTimerValue(uint8_t value) { TCNT2 = value; }
+void clb::Timer2::setTimerValue(uint8_t value) {
+    TCNT2 = value;
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TCNT, value);
+}
+
+//the lock only covers the reads, 16 cycles (1us at 16MHz) counted from the generated code, the correction runs after it
+clb::TimerSnapshot clb::Timer2::snapshot() {
+    uint8_t _counter;
+    uint8_t _flags;
+    uint32_t _overflows;
+    uint8_t _timsk;
+    {
+        CLB_CRITICAL_SECTION();
+        _counter = TCNT2;
+        _flags = TIFR2;
+        _overflows = s_timer2_overflows;
+        _timsk = TIMSK2;
+    }
+
+    uint8_t _top = currentTop();
+    //TCNT2 was read first, so a pending overflow with a small count happened before the read and the ISR hasnt counted it yet
+    if ((_timsk & (BIT0 << TOIE2)) && (_flags & (BIT0 << TOV2)) && _counter < (_top >> 1)) {
+        _overflows++;
+    }
+
+    clb::TimerSnapshot _snapshot;
+    _snapshot.counter = _counter;
+    _snapshot.flags = _flags;
+    _snapshot.overflows = _overflows;
+    _snapshot.ticks = _overflows * ((uint32_t)_top + 1) + _counter;
+    return _snapshot;
+}
 
 void clb::Timer2::forceOutputCompareA() { TCCR2B |= BIT0 << FOC2A; }
 
 void clb::Timer2::forceOutputCompareB() { TCCR2B |= BIT0 << FOC2B; }
 
 void clb::Timer2::setAsynchronousClock(clb::TACLK clk) {
-    cli();
+    CLB_CRITICAL_SECTION();
     uint8_t _CS2 = TCCR2B & (BIT0 | BIT1 | BIT2);
     uint8_t _TCNT2 = TCNT2;
     uint8_t _OCR2A = OCR2A;
@@ -373,8 +468,6 @@ void clb::Timer2::setAsynchronousClock(clb::TACLK clk) {
 
     TCCR2B = _TCCR2B | _CS2;
     if (ASSR & (BIT0 << AS2)) {while (ASSR & (BIT0 << TCR2BUB));}
-
-    sei();
 }
 
 bool clb::Timer2::getBusyFlag(clb::TBusyFlag flag) {
@@ -399,11 +492,35 @@ void clb::Timer2::syncDelay(uint32_t time, clb::TTimeUnit unit, clb::TOutputChan
         _prescaler = getPrescaler(_clockSourceEnum);
     }
 
+#ifdef CLB_CYCLES_PER_US
+    //microseconds skip the 64 bit tick math and take the fixed cost of the call off the wait
+    if (unit == clb::TTimeUnit::MICROSECONDS && _prescaler != 0 && time <= 0xFFFFFFFFUL / CLB_CYCLES_PER_US) {
+        uint32_t _cycles = time * CLB_CYCLES_PER_US;
+        if (_cycles < CLB_SYNC_DELAY_LOOP_CYCLES) {
+            //shorter than setting the timer up, count cycles instead
+            clb::PreciseDelay::cycles((_cycles > s_timer2_loop_overhead) ? _cycles - s_timer2_loop_overhead : 0);
+            return;
+        }
+        _cycles = (_cycles > s_timer2_sync_overhead) ? _cycles - s_timer2_sync_overhead : 0;
+        while (_prescaler > 1) { //prescalers are powers of 2
+            _cycles >>= 1;
+            _prescaler >>= 1;
+        }
+        syncDelayLogic(_cycles, channel);
+        return;
+    }
+#endif
+
     uint64_t _ticks = calculateTicks(time, unit, _prescaler);
 
     syncDelayLogic(_ticks, channel);
 }
 
+void clb::Timer2::setSyncDelayOverhead(uint16_t timerCycles, uint16_t loopCycles) {
+    s_timer2_sync_overhead = timerCycles;
+    s_timer2_loop_overhead = loopCycles;
+}
+
 void clb::Timer2::asyncDelay(uint32_t time) {
     asyncDelay(time, clb::TTimeUnit::MILLISECONDS, clb::TOutputChannel::A);
 }
@@ -413,6 +530,10 @@ void clb::Timer2::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit) {
 }
 
 void clb::Timer2::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutputChannel channel) {
+    asyncDelay(time, timeUnit, channel, false);
+}
+
+void clb::Timer2::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutputChannel channel, bool periodic) {
     if (channel != clb::TOutputChannel::A && channel != clb::TOutputChannel::B) {
         CRITICAL("Timer2 only supports TOutputChannel::A and TOutputChannel::B for asyncDelay.");
         return;
@@ -434,179 +555,293 @@ void clb::Timer2::asyncDelay(uint32_t time, clb::TTimeUnit timeUnit, clb::TOutpu
 
     uint64_t calculatedTicks = calculateTicks(time, timeUnit, _prescaler);
 
-    asyncDelayLogic(calculatedTicks, channel);
+    asyncDelayLogic(calculatedTicks, channel, periodic);
 }
 
 //helpers
+//interrupts stay on while waiting, only the setup and the restore are locked. The Timer2 interrupts are masked for the
+//delay so no ISR clears the flags being polled. Other ISRs can run as long as none of them holds the cpu for a whole
+//timer period (256 ticks), a longer one hides an overflow and stretches the delay by one period
 void clb::Timer2::syncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) {
-    uint8_t _sreg = SREG;
-    cli();
-
-    uint8_t _tccr2a = TCCR2A;
-    uint8_t _tccr2b = TCCR2B;
-    uint8_t _tcnt2 = TCNT2;
-    uint8_t _ocr2a = OCR2A;
-    uint8_t _ocr2b = OCR2B;
-    uint8_t _timsk2 = TIMSK2;
-    uint8_t _tifr2 = TIFR2;
-
     volatile uint8_t* _ocr_reg = getOcrRegister(channel);
     uint8_t _oc_flag_bit = getOcFlagBit(channel);
 
-    TCCR2A = 0;
-    TCCR2B = 0;
-
-    uint32_t _prescaler = getPrescaler(static_cast<clb::TAsynClock>(this->_clockSource));
-    if (_prescaler == 0) {
-        TCCR2B = (BIT0 << CS22);
-    }
-    else {
-        TCCR2B = this->_clockSource;
-    }
-
-    TCNT2 = 0;
-    TIFR2 = (BIT0 << _oc_flag_bit) | (BIT0 << TOV2);
-
     const uint16_t MAX_TIMER2_TICKS = 256;
 
     uint32_t _overflows = ticks / MAX_TIMER2_TICKS;
-    uint16_t _remaining_ticks = ticks % MAX_TIMER2_TICKS;
+    uint8_t _remaining_ticks = ticks % MAX_TIMER2_TICKS;
+
+    uint8_t _tccr2a, _tccr2b, _timsk2, _tifr2;
+    uint8_t _tcnt2, _ocr2a, _ocr2b;
+    {
+        CLB_CRITICAL_SECTION();
+
+        _tccr2a = TCCR2A;
+        _tccr2b = TCCR2B;
+        _tcnt2 = TCNT2;
+        _ocr2a = OCR2A;
+        _ocr2b = OCR2B;
+        _timsk2 = TIMSK2;
+        _tifr2 = TIFR2;
+
+        TIMSK2 = 0;
+        TCCR2A = 0;
+        TCCR2B = 0;
+        TCNT2 = 0;
+        if (_remaining_ticks > 0) {
+            *_ocr_reg = _remaining_ticks - 1;
+        }
+        TIFR2 = (BIT0 << _oc_flag_bit) | (BIT0 << TOV2);
 
-    for (uint32_t i = 0; i < _overflows; i++) {
-        while (!(TIFR2 & (BIT0 << TOV2))) {
+        uint32_t _prescaler = getPrescaler(static_cast<clb::TAsynClock>(this->_clockSource));
+        if (_prescaler == 0) {
+            TCCR2B = (BIT0 << CS22);
         }
-        TIFR2 |= (BIT0 << TOV2);
+        else {
+            TCCR2B = this->_clockSource;
+        }
+    }
+
+    for (uint32_t i = 0; i < _overflows; i++) {
+        while (!(TIFR2 & (BIT0 << TOV2))) { }
+        TIFR2 = (BIT0 << TOV2);
     }
     if (_remaining_ticks > 0) {
-        *_ocr_reg = _remaining_ticks - 1;
-        while (!(TIFR2 & (BIT0 << _oc_flag_bit))) { }
-        TIFR2 |= (BIT0 << _oc_flag_bit);
+        if (_overflows > 0) {
+            TIFR2 = (BIT0 << _oc_flag_bit); //the earlier periods set it too, only the match after the last overflow counts
+        }
+        //TCNT catches a match that an ISR delayed us past before the flag was cleared
+        while (!(TIFR2 & (BIT0 << _oc_flag_bit)) && TCNT2 < _remaining_ticks) { }
     }
 
+    CLB_CRITICAL_SECTION();
+
     TCCR2A = _tccr2a;
     TCCR2B = _tccr2b;
     TCNT2 = _tcnt2;
     OCR2A = _ocr2a;
     OCR2B = _ocr2b;
+    //clear what the delay raised, flags that were pending before stay pending
+    TIFR2 = ((BIT0 << OCF2A) | (BIT0 << OCF2B) | (BIT0 << TOV2)) & ~_tifr2;
     TIMSK2 = _timsk2;
-    TIFR2 = _tifr2;
-
-    SREG = _sreg;
 }
 
-void clb::Timer2::asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel) {
-    if (_asyncDelayActive) {
-        WARNING("An asynchronous delay is already active on Timer2. Cannot start a new one.");
+//every channel is a slot of its own on the shared counter. The first slot saves the registers, puts the timer in normal
+//mode and starts it from 0, the other one sets its OCR relative to the running TCNT
+void clb::Timer2::asyncDelayLogic(uint64_t ticks, clb::TOutputChannel channel, bool periodic) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (s_timer2_async.active & (BIT0 << _index)) {
+        WARNING("An asynchronous delay is already active on this Timer2 channel. Cannot start a new one.");
         return;
     }
     if (ticks == 0) {
         WARNING("asyncDelay(0) called. Delay will complete immediately.");
-        _asyncDelayActive = false;
         return;
     }
 
-    _asyncSavedSREG = SREG;
-    cli();
-
-    _asyncSavedTCCR2A = TCCR2A;
-    _asyncSavedTCCR2B = TCCR2B;
-    _asyncSavedTCNT2 = TCNT2;
-    _asyncSavedOCR2A = OCR2A;
-    _asyncSavedOCR2B = OCR2B;
-    _asyncSavedTIMSK2 = TIMSK2;
-    _asyncSavedTIFR2 = TIFR2;
-
-    TCCR2A = 0;
-    TCCR2B = 0;
-    TCNT2 = 0;
-
     const uint16_t MAX_TIMER2_TICKS = 256;
 
-    _asyncTargetTicks = ticks;
-
-    uint32_t numFullCycles = ticks / MAX_TIMER2_TICKS;
-    uint8_t remainderTicks = ticks % MAX_TIMER2_TICKS;
+    //the first match comes after the remainder, the rest a full counter period apart at the same OCR value
+    uint32_t _chunks = ticks / MAX_TIMER2_TICKS;
+    uint8_t _lead = ticks % MAX_TIMER2_TICKS;
+    if (_lead != 0) {
+        _chunks++;
+    }
 
-    if (remainderTicks == 0) {
-        _asyncOverflowsCount = numFullCycles;
-        _asyncRemainingTicksValue = MAX_TIMER2_TICKS - 1;
+    uint32_t _prescaler = getPrescaler(static_cast<clb::TAsynClock>(this->_clockSource));
+    uint8_t _clockBits = (_prescaler == 0) ? ((BIT0 << CS21) | (BIT0 << CS20)) : this->_clockSource;
+    if (_prescaler == 0) {
+        _prescaler = 32;
     }
-    else {
-        _asyncOverflowsCount = numFullCycles + 1;
-        _asyncRemainingTicksValue = remainderTicks - 1;
+    //a periodic slot moves OCR on in the ISR, the next match has to be far enough ahead (128 cycles) to still be in front of TCNT then
+    if (periodic && _lead != 0 && _lead < 128 / _prescaler + 2) {
+        CRITICAL("Periodic asyncDelay on Timer2 is too close above a whole number of counter periods, pick another period or a slower clock.");
+        return;
     }
+    uint32_t _reloadChunks = _chunks;
+    uint8_t _reloadLead = _lead;
 
-    TCCR2A |= (BIT0 << WGM21);
+    CLB_CRITICAL_SECTION();
 
-    uint32_t prescaler_val_for_setup = getPrescaler(static_cast<clb::TAsynClock>(this->_clockSource));
-    if (prescaler_val_for_setup == 0) {
-        TCCR2B |= (BIT0 << CS21) | (BIT0 << CS20);
+    uint8_t _active = s_timer2_async.active;
+    uint8_t _now = 0;
+    if (_active == 0) {
+        s_timer2_saved.tccra = TCCR2A;
+        s_timer2_saved.tccrb = TCCR2B;
+        s_timer2_saved.tcnt = TCNT2;
+        s_timer2_saved.ocra = OCR2A;
+        s_timer2_saved.ocrb = OCR2B;
+        s_timer2_saved.timsk = TIMSK2;
+
+        //normal mode so TOP stays at 255 for both channels
+        TCCR2A = 0;
+        TCCR2B = 0;
+        TCNT2 = 0;
     }
     else {
-        TCCR2B |= this->_clockSource;
+        //the counter runs for the other slot, the match has to be far enough ahead that TCNT doesnt pass it before the
+        //OCR write below (64 cycles), a shorter first chunk is stretched to that
+        uint8_t _minLead = 64 / _prescaler + 2;
+        if (_lead < _minLead) {
+            if (_lead == 0) {
+                _chunks++;
+            }
+            _lead = _minLead;
+        }
+        _now = TCNT2;
     }
 
-    if (channel == clb::TOutputChannel::A) {
-        TIFR2 |= (BIT0 << OCF2A);
-        if (numFullCycles == 0 && remainderTicks > 0) {
-            OCR2A = _asyncRemainingTicksValue;
-        }
-        else {
-            OCR2A = MAX_TIMER2_TICKS - 1;
-        }
-        TIMSK2 |= (BIT0 << OCIE2A);
+    *getOcrRegister(channel) = _now + _lead - 1;
+    TIFR2 = (BIT0 << (OCF2A + _index));
+    TIMSK2 |= (BIT0 << (OCIE2A + _index));
+    s_timer2_async.chunks[_index] = _chunks;
+    s_timer2_async.reloadChunks[_index] = _reloadChunks;
+    s_timer2_async.reloadLead[_index] = _reloadLead;
+    if (periodic) {
+        s_timer2_async.periodic |= (BIT0 << _index);
     }
     else {
-        TIFR2 |= (BIT0 << OCF2B);
-        if (numFullCycles == 0 && remainderTicks > 0) {
-            OCR2B = _asyncRemainingTicksValue;
-        }
-        else {
-            OCR2B = MAX_TIMER2_TICKS - 1;
-        }
-        TIMSK2 |= (BIT0 << OCIE2B);
+        s_timer2_async.periodic &= ~(BIT0 << _index);
     }
+    s_timer2_async.active = _active | (BIT0 << _index);
 
-    _asyncDelayActive = true;
-    _asyncDelayActiveChannel = channel;
+    if (_active == 0) {
+        TCCR2B = _clockBits;
+    }
 
-    SREG = _asyncSavedSREG;
+    CLB_TRACE(clb::TTraceEvent::ASYNC_START, 2, channel, (_chunks > 0xFFFF) ? 0xFFFF : _chunks);
 }
 
 bool clb::Timer2::isAsyncDelayFinished() {
-    return !_asyncDelayActive;
+    return s_timer2_async.active == 0;
 }
 
-void clb::Timer2::stopAsyncDelay() {
-    if (_asyncDelayActive) {
-        WARNING("Stopping active asynchronous delay on Timer2.");
+bool clb::Timer2::isAsyncDelayFinished(clb::TOutputChannel channel) {
+    return !(s_timer2_async.active & (BIT0 << static_cast<uint8_t>(channel)));
+}
 
-        uint8_t temp_sreg = SREG;
-        cli();
+uint32_t clb::Timer2::remaining() {
+    return remaining(clb::TOutputChannel::A);
+}
 
-        if (_asyncDelayActiveChannel == clb::TOutputChannel::A) {
-            TIMSK2 &= ~(BIT0 << OCIE2A);
-            TIFR2 |= (BIT0 << OCF2A);
+uint32_t clb::Timer2::remaining(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (_index > static_cast<uint8_t>(clb::TOutputChannel::B)) {
+        CRITICAL("Invalid output channel for Timer2 remaining().");
+        return 0;
+    }
+
+    uint32_t _chunks;
+    uint8_t _distance;
+    bool _pending;
+    {
+        CLB_CRITICAL_SECTION();
+        if (!(s_timer2_async.active & (BIT0 << _index))) {
+            return 0;
         }
-        else {
-            TIMSK2 &= ~(BIT0 << OCIE2B);
-            TIFR2 |= (BIT0 << OCF2B);
+        _chunks = s_timer2_async.chunks[_index];
+        _distance = (&OCR2A)[_index] - TCNT2;
+        _pending = TIFR2 & (BIT0 << (OCF2A + _index));
+    }
+    if (_pending) {
+        //matched but the ISR hasnt counted it yet, the next match is a full period away
+        if (_chunks <= 1) {
+            return 0;
         }
+        _chunks--;
+    }
+
+    //ticks to the next match, then a full period for every match after it
+    uint64_t _ticks = (uint64_t)_distance + 1 + (uint64_t)(_chunks - 1) * 256;
+    uint32_t _prescaler = getPrescaler(static_cast<clb::TAsynClock>(this->_clockSource));
+    if (_prescaler == 0) {
+        _prescaler = 32;
+    }
+    uint64_t _microseconds = _ticks * _prescaler / (F_CPU / 1000000UL);
+    return (_microseconds > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : _microseconds;
+}
 
-        TCCR2A = _asyncSavedTCCR2A;
-        TCCR2B = _asyncSavedTCCR2B;
-        TCNT2 = _asyncSavedTCNT2;
-        OCR2A = _asyncSavedOCR2A;
-        OCR2B = _asyncSavedOCR2B;
-        TIMSK2 = _asyncSavedTIMSK2;
-        TIFR2 = _asyncSavedTIFR2;
-        SREG = _asyncSavedSREG;
+void clb::Timer2::stopAsyncDelay() {
+    stopAsyncDelay(clb::TOutputChannel::A);
+    stopAsyncDelay(clb::TOutputChannel::B);
+}
+
+void clb::Timer2::stopAsyncDelay(clb::TOutputChannel channel) {
+    uint8_t _index = static_cast<uint8_t>(channel);
+    if (channel == clb::TOutputChannel::C || !(s_timer2_async.active & (BIT0 << _index))) {
+        return;
+    }
+    WARNING("Stopping active asynchronous delay on Timer2.");
 
-        _asyncDelayActive = false;
-        _asyncCurrentTicks = 0;
-        _asyncOverflowsCount = 0;
-        _asyncRemainingTicksValue = 0;
+    CLB_CRITICAL_SECTION();
+
+    uint8_t _active = s_timer2_async.active;
+    if (!(_active & (BIT0 << _index))) {
+        return; //ended by itself in the meantime
+    }
+    TIMSK2 &= ~(BIT0 << (OCIE2A + _index));
+    TIFR2 = (BIT0 << (OCF2A + _index));
+    s_timer2_async.chunks[_index] = 0;
+    s_timer2_async.periodic &= ~(BIT0 << _index);
+    _active &= ~(BIT0 << _index);
+    s_timer2_async.active = _active;
+    if (_active == 0) {
+        restoreAsyncConfig();
     }
+
+    CLB_TRACE(clb::TTraceEvent::ASYNC_STOP, 2, channel, 0);
+}
+
+clb::FrequencyPlan clb::Timer2::setFrequency(float hz, clb::TOutputChannel channel) {
+    clb::FrequencyPlan _plan = planFrequency(hz, channel);
+    setFrequency(_plan, channel);
+    return _plan;
+}
+
+//CTC (mode 2) toggles the pin on every match with OCR2A, fast PWM with TOP in OCR2A (mode 7) sets OC2B at BOTTOM and
+//clears it halfway. Only the bits of the channel are changed, the pin still has to be made an output
+void clb::Timer2::setFrequency(const clb::FrequencyPlan& plan, clb::TOutputChannel channel) {
+    if (plan.timer != 2 || plan.clock == 0 || plan.clock > 7 || channel == clb::TOutputChannel::C ||
+        (channel == clb::TOutputChannel::A && !plan.toggle)) {
+        CRITICAL("Timer2::setFrequency() needs a nonzero frequency and a plan from Timer2::planFrequency() for the same channel (A or B)");
+        return;
+    }
+    if (ASSR & (BIT0 << AS2)) {
+        CRITICAL("Timer2::setFrequency() plans are made for the io clock, switch Timer2 back to TACLK::CLKIO first");
+        return;
+    }
+    if (s_timer2_async.active) {
+        stopAsyncDelay();
+    }
+    uint8_t _index = static_cast<uint8_t>(channel);
+    uint8_t _top = (uint8_t)plan.top;
+    uint8_t _compare = plan.toggle ? _top : (uint8_t)((plan.top + 1) / 2 - 1); //half of the period
+
+    CLB_CRITICAL_SECTION();
+
+    uint8_t _TCCR2A = TCCR2A & ~((BIT1 | BIT0) | ((BIT1 | BIT0) << (COM2A0 - 2 * _index))); //COM2A and COM2B follow the channel order downwards
+    uint8_t _TCCR2B = plan.clock;
+    if (plan.toggle) {
+        _TCCR2A |= (BIT0 << WGM21) | (BIT0 << (COM2A0 - 2 * _index));
+    }
+    else {
+        _TCCR2A |= (BIT0 << WGM21) | (BIT0 << WGM20) | (BIT0 << COM2B1);
+        _TCCR2B |= (BIT0 << WGM22);
+    }
+
+    TCCR2B = 0; //stopped while TOP and the compare value change
+    TCNT2 = 0;
+    OCR2A = _top;
+    if (channel == clb::TOutputChannel::B) {
+        OCR2B = _compare;
+    }
+    TCCR2A = _TCCR2A;
+    TCCR2B = _TCCR2B;
+    _clockSource = plan.clock;
+
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::OCRA, _top);
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TCCRA, _TCCR2A);
+    CLB_TRACE(clb::TTraceEvent::REGISTER_WRITE, 2, clb::TTraceRegister::TCCRB, _TCCR2B);
 }
 
 static uint32_t getPrescaler(clb::TAsynClock clock) {
@@ -638,7 +873,7 @@ static uint64_t calculateTicks(uint32_t value, clb::TTimeUnit unit, uint32_t pre
     return _ticks;
 }
 
-volatile uint8_t* getOcrRegister(clb::TOutputChannel channel) {
+static volatile uint8_t* getOcrRegister(clb::TOutputChannel channel) {
     switch (channel) {
         case clb::TOutputChannel::A: return &OCR2A;
         case clb::TOutputChannel::B: return &OCR2B;
@@ -646,7 +881,7 @@ volatile uint8_t* getOcrRegister(clb::TOutputChannel channel) {
     }
 }
 
-uint8_t getOcFlagBit(clb::TOutputChannel channel) {
+static uint8_t getOcFlagBit(clb::TOutputChannel channel) {
     switch (channel) {
         case clb::TOutputChannel::A: return OCF2A;
         case clb::TOutputChannel::B: return OCF2B;
@@ -0,0 +1,304 @@
+#include "clbTimerPool.h"
+
+#include <avr/pgmspace.h>
+
+#ifndef CLB_TIMER_POOL_RESERVED
+#define CLB_TIMER_POOL_RESERVED 0
+#endif
+
+//claim symbols of the modules that own a timer (see clbResource.h), weak so the pool doesnt link the modules in, a
+//timer nobody claimed has its symbol at address 0
+extern "C" {
+    extern const uint8_t clb_timer0_claimed __attribute__((weak));
+    extern const uint8_t clb_timer1_claimed __attribute__((weak));
+    extern const uint8_t clb_timer2_claimed __attribute__((weak));
+    extern const uint8_t clb_timer3_claimed __attribute__((weak));
+    extern const uint8_t clb_timer4_claimed __attribute__((weak));
+    extern const uint8_t clb_timer5_claimed __attribute__((weak));
+}
+
+//what each timer offers, bits 0 for a timer the MCU doesnt have
+static const struct TimerInfo {
+    uint8_t bits;
+    uint8_t channels;
+    uint8_t inputCapture;
+    uint8_t asyncClock;
+} s_timer_info[6] PROGMEM = {
+    { 8, 2, 0, 0 },
+#ifdef OCR1C
+    { 16, 3, 1, 0 },
+#else
+    { 16, 2, 1, 0 },
+#endif
+    { 8, 2, 0, 1 },
+#ifdef TCCR3A
+    { 16, 3, 1, 0 },
+#else
+    { 0, 0, 0, 0 },
+#endif
+#ifdef TCCR4A
+    { 16, 3, 1, 0 },
+#else
+    { 0, 0, 0, 0 },
+#endif
+#ifdef TCCR5A
+    { 16, 3, 1, 0 },
+#else
+    { 0, 0, 0, 0 },
+#endif
+};
+
+static uint8_t s_pool_leased = 0; //BIT0 << n for every leased timer
+static uint8_t s_pool_reserved = 0; //BIT0 << n for every timer passed to reserve()
+
+//timers that are never in the pool, fixed once the program is linked
+static uint8_t lockedTimers() {
+    uint8_t _locked = CLB_TIMER_POOL_RESERVED;
+#ifndef CLB_ALLOW_TIMER0
+    _locked |= (BIT0 << 0);
+#endif
+    if (&clb_timer0_claimed) {
+        _locked |= (BIT0 << 0);
+    }
+    if (&clb_timer1_claimed) {
+        _locked |= (BIT0 << 1);
+    }
+    if (&clb_timer2_claimed) {
+        _locked |= (BIT0 << 2);
+    }
+    if (&clb_timer3_claimed) {
+        _locked |= (BIT0 << 3);
+    }
+    if (&clb_timer4_claimed) {
+        _locked |= (BIT0 << 4);
+    }
+    if (&clb_timer5_claimed) {
+        _locked |= (BIT0 << 5);
+    }
+    for (uint8_t i = 0; i < 6; i++) {
+        if (pgm_read_byte(&s_timer_info[i].bits) == 0) {
+            _locked |= (BIT0 << i);
+        }
+    }
+    return _locked;
+}
+
+//clock off, outputs disconnected, compare and capture registers 0, interrupts off and flags cleared, then the PRR bit set
+//or cleared. The timer is powered up first, a module gated off in PRR ignores writes. Interrupts must be off
+static void resetTimer(uint8_t number, bool powerDown) {
+    volatile uint8_t* _prr = nullptr;
+    uint8_t _prrBit = 0;
+    switch (number) {
+        case 0: _prr = &PRR0; _prrBit = PRTIM0; break;
+        case 1: _prr = &PRR0; _prrBit = PRTIM1; break;
+        case 2: _prr = &PRR0; _prrBit = PRTIM2; break;
+#ifdef TCCR3A
+        case 3: _prr = &PRR1; _prrBit = PRTIM3; break;
+#endif
+#ifdef TCCR4A
+        case 4: _prr = &PRR1; _prrBit = PRTIM4; break;
+#endif
+#ifdef TCCR5A
+        case 5: _prr = &PRR1; _prrBit = PRTIM5; break;
+#endif
+        default: return;
+    }
+    *_prr &= ~(BIT0 << _prrBit);
+
+    switch (number) {
+        case 0:
+            TCCR0B = 0;
+            TIMSK0 = 0;
+            TCCR0A = 0;
+            TCNT0 = 0;
+            OCR0A = 0;
+            OCR0B = 0;
+            TIFR0 = (BIT0 << OCF0B) | (BIT0 << OCF0A) | (BIT0 << TOV0);
+            break;
+        case 1:
+            TCCR1B = 0;
+            TIMSK1 = 0;
+            TCCR1A = 0;
+            TCCR1C = 0;
+            TCNT1 = 0;
+            OCR1A = 0;
+            OCR1B = 0;
+            OCR1C = 0;
+            ICR1 = 0;
+            TIFR1 = 0xFF; //writing a 1 clears a flag, the unused bits ignore it
+            break;
+        case 2:
+            TCCR2B = 0;
+            TIMSK2 = 0;
+            TCCR2A = 0;
+            ASSR = 0;
+            TCNT2 = 0;
+            OCR2A = 0;
+            OCR2B = 0;
+            TIFR2 = (BIT0 << OCF2B) | (BIT0 << OCF2A) | (BIT0 << TOV2);
+            break;
+#ifdef TCCR3A
+        case 3:
+            TCCR3B = 0;
+            TIMSK3 = 0;
+            TCCR3A = 0;
+            TCCR3C = 0;
+            TCNT3 = 0;
+            OCR3A = 0;
+            OCR3B = 0;
+            OCR3C = 0;
+            ICR3 = 0;
+            TIFR3 = 0xFF;
+            break;
+#endif
+#ifdef TCCR4A
+        case 4:
+            TCCR4B = 0;
+            TIMSK4 = 0;
+            TCCR4A = 0;
+            TCCR4C = 0;
+            TCNT4 = 0;
+            OCR4A = 0;
+            OCR4B = 0;
+            OCR4C = 0;
+            ICR4 = 0;
+            TIFR4 = 0xFF;
+            break;
+#endif
+#ifdef TCCR5A
+        case 5:
+            TCCR5B = 0;
+            TIMSK5 = 0;
+            TCCR5A = 0;
+            TCCR5C = 0;
+            TCNT5 = 0;
+            OCR5A = 0;
+            OCR5B = 0;
+            OCR5C = 0;
+            ICR5 = 0;
+            TIFR5 = 0xFF;
+            break;
+#endif
+    }
+    if (powerDown) {
+        *_prr |= (BIT0 << _prrBit);
+    }
+}
+
+clb::TimerLease::TimerLease(clb::TimerLease&& other) : _number(other._number) {
+    other._number = CLB_NO_TIMER;
+}
+
+clb::TimerLease& clb::TimerLease::operator=(clb::TimerLease&& other) {
+    if (this != &other) {
+        release();
+        _number = other._number;
+        other._number = CLB_NO_TIMER;
+    }
+    return *this;
+}
+
+clb::TimerLease::~TimerLease() {
+    release();
+}
+
+void clb::TimerLease::release() {
+    if (_number != CLB_NO_TIMER) {
+        clb::TimerPool::release(_number);
+        _number = CLB_NO_TIMER;
+    }
+}
+
+clb::TimerLease clb::TimerPool::acquire(const clb::TimerNeeds& needs) {
+    uint8_t _locked = lockedTimers();
+
+    uint8_t _best = CLB_NO_TIMER;
+    {
+        CLB_CRITICAL_SECTION();
+
+        uint8_t _bestSpare = 0xFF;
+        for (uint8_t i = 0; i < 6; i++) {
+            if ((_locked | s_pool_leased | s_pool_reserved) & (BIT0 << i)) {
+                continue;
+            }
+            uint8_t _bits = pgm_read_byte(&s_timer_info[i].bits);
+            uint8_t _channels = pgm_read_byte(&s_timer_info[i].channels);
+            bool _inputCapture = pgm_read_byte(&s_timer_info[i].inputCapture);
+            bool _asyncClock = pgm_read_byte(&s_timer_info[i].asyncClock);
+            if (_bits < needs.bits || _channels < needs.channels || (needs.inputCapture && !_inputCapture) ||
+                (needs.asyncClock && !_asyncClock)) {
+                continue;
+            }
+
+            //what the timer has beyond the needs, the lowest wins so the bigger timers stay free for bigger needs
+            uint8_t _spare = (_bits - needs.bits) / 2 + (_channels - needs.channels);
+            if (_inputCapture && !needs.inputCapture) {
+                _spare += 2;
+            }
+            if (_asyncClock && !needs.asyncClock) {
+                _spare += 2;
+            }
+            if (_spare < _bestSpare) {
+                _best = i;
+                _bestSpare = _spare;
+            }
+        }
+
+        if (_best != CLB_NO_TIMER) {
+            s_pool_leased |= (BIT0 << _best);
+            resetTimer(_best, false);
+        }
+    }
+
+    //outside the lock, WARNING prints and waits for Serial
+    if (_best == CLB_NO_TIMER) {
+        WARNING("TimerPool has no free timer with the requested capabilities");
+        return clb::TimerLease();
+    }
+    return clb::TimerLease(_best);
+}
+
+void clb::TimerPool::release(uint8_t number) {
+    CLB_CRITICAL_SECTION();
+    resetTimer(number, true);
+    s_pool_leased &= ~(BIT0 << number);
+}
+
+bool clb::TimerPool::reserve(uint8_t number) {
+    if (number > 5) {
+        CRITICAL("TimerPool::reserve() timer number must be 0 to 5");
+        return false;
+    }
+    CLB_CRITICAL_SECTION();
+    if (s_pool_leased & (BIT0 << number)) {
+        return false;
+    }
+    s_pool_reserved |= (BIT0 << number);
+    return true;
+}
+
+void clb::TimerPool::unreserve(uint8_t number) {
+    if (number > 5) {
+        CRITICAL("TimerPool::unreserve() timer number must be 0 to 5");
+        return;
+    }
+    CLB_CRITICAL_SECTION();
+    s_pool_reserved &= ~(BIT0 << number);
+}
+
+bool clb::TimerPool::isFree(uint8_t number) {
+    if (number > 5) {
+        return false;
+    }
+    uint8_t _locked = lockedTimers();
+    CLB_CRITICAL_SECTION();
+    return !((_locked | s_pool_leased | s_pool_reserved) & (BIT0 << number));
+}
+
+clb::TimerNeeds clb::TimerPool::capabilities(uint8_t number) {
+    if (number > 5) {
+        return clb::TimerNeeds(0, 0, false, false);
+    }
+    return clb::TimerNeeds(pgm_read_byte(&s_timer_info[number].bits), pgm_read_byte(&s_timer_info[number].channels),
+                           pgm_read_byte(&s_timer_info[number].inputCapture), pgm_read_byte(&s_timer_info[number].asyncClock));
+}
@@ -0,0 +1,86 @@
+#ifndef CLBTIMERPOOL_H
+#define CLBTIMERPOOL_H
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbBits.h"
+#include "clbException.h"
+#include "clbCriticalSection.h"
+
+/* TIMER POOL
+ *
+ * Hands out free hardware timers at runtime by what they can do instead of by number:
+ *
+ *     clb::TimerLease _lease = clb::TimerPool::acquire({16, 2, true}); //16 bits, 2 compare channels, input capture
+ *     if (_lease) {
+ *         uint8_t _n = _lease.number(); //drive timer _n through its registers
+ *     } //released here: registers cleared and the timer clock gated off in PRR
+ *
+ * acquire() picks the free timer with the least to spare (an 8 bit timer before a 16 bit one, no input capture or
+ * asynchronous clock unless asked for) and powers it up with all its registers cleared. The lease gives the timer back
+ * when it goes out of scope or on release(), which stops the timer, clears its registers and interrupt flags and sets its
+ * PRR bit so it draws no power.
+ *
+ * Timers the pool never hands out:
+ *   - Timer0 unless CLB_ALLOW_TIMER0 is defined, it runs millis(), micros() and delay()
+ *   - timers claimed with CLB_CLAIM_TIMER by any object file in the program (clb::Timer1, clb::Stepper::axis3(), the
+ *     cycle clock and so on, see clbResource.h). The pool checks the claim symbols with weak references, so it doesnt pull
+ *     any of those modules in itself
+ *   - the timers in CLB_TIMER_POOL_RESERVED (see clbConfig.h), for Servo, tone() and other code that doesnt claim
+ *   - timers passed to reserve() at runtime
+ *
+ * A leased timer is driven through its registers by number. The clb timer classes and modules claim their timers at link
+ * time, so a timer used through one of them is never in the pool.
+ */
+
+#define CLB_NO_TIMER 0xFF
+
+namespace clb {
+    //what a timer must offer, TimerNeeds() accepts any timer
+    struct TimerNeeds {
+        TimerNeeds(uint8_t bits = 8, uint8_t channels = 1, bool inputCapture = false, bool asyncClock = false)
+            : bits(bits), channels(channels), inputCapture(inputCapture), asyncClock(asyncClock) { }
+
+        uint8_t bits; //counter width, 8 or 16
+        uint8_t channels; //output compare channels (OCnA, OCnB, OCnC)
+        bool inputCapture; //ICPn pin and ICRn register
+        bool asyncClock; //can count a 32 kHz crystal on TOSC1/TOSC2 (Timer2)
+    };
+
+    //one timer taken from the pool, given back when destroyed. Can be moved but not copied
+    class TimerLease {
+        public:
+            TimerLease() { }
+            TimerLease(TimerLease&& other);
+            TimerLease& operator=(TimerLease&& other);
+            TimerLease(const TimerLease&) = delete;
+            TimerLease& operator=(const TimerLease&) = delete;
+            ~TimerLease();
+
+            explicit operator bool() const { return _number != CLB_NO_TIMER; }
+            uint8_t number() const { return _number; } //timer number, CLB_NO_TIMER if the lease is empty
+            void release(); //gives the timer back now, the lease is empty afterwards
+        private:
+            friend class TimerPool;
+            explicit TimerLease(uint8_t number) : _number(number) { }
+
+            uint8_t _number = CLB_NO_TIMER;
+    };
+
+    class TimerPool {
+        public:
+            static TimerLease acquire(const TimerNeeds& needs); //best free timer for the needs, an empty lease if there is none
+            static bool reserve(uint8_t number); //keeps a timer out of the pool, false if it is leased or doesnt exist
+            static void unreserve(uint8_t number); //puts a timer reserved at runtime back into the pool
+            static bool isFree(uint8_t number); //true if acquire() could hand the timer out right now
+            static TimerNeeds capabilities(uint8_t number); //what the timer offers, all 0 if it doesnt exist on this MCU
+        private:
+            friend class TimerLease;
+            static void release(uint8_t number);
+    };
+}
+
+#endif
@@ -0,0 +1,151 @@
+#include "clbTrace.h"
+
+#if (CLB_TRACE_BUFFER_SIZE & (CLB_TRACE_BUFFER_SIZE - 1)) != 0 || CLB_TRACE_BUFFER_SIZE > 128
+#error "CLB_TRACE_BUFFER_SIZE must be a power of 2 and at most 128"
+#endif
+
+static uint8_t crc8(const uint8_t* data, uint8_t length) {
+    uint8_t _crc = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        _crc ^= data[i];
+        for (uint8_t b = 0; b < 8; b++) {
+            _crc = (_crc & 0x80) ? (_crc << 1) ^ 0x07 : (_crc << 1);
+        }
+    }
+    return _crc;
+}
+
+void clb::Trace::encodeFrame(const clb::TraceRecord& record, uint8_t* frame) {
+    frame[0] = CLB_TRACE_FRAME_SYNC;
+    frame[1] = static_cast<uint8_t>(record.event);
+    frame[2] = record.source;
+    frame[3] = record.value & 0xFF;
+    frame[4] = record.value >> 8;
+    frame[5] = record.time & 0xFF;
+    frame[6] = (record.time >> 8) & 0xFF;
+    frame[7] = (record.time >> 16) & 0xFF;
+    frame[8] = record.time >> 24;
+    frame[9] = crc8(&frame[1], 8);
+}
+
+#ifdef CLB_ENABLE_TRACE
+
+static clb::TraceRecord s_trace_buffer[CLB_TRACE_BUFFER_SIZE];
+static volatile uint8_t s_trace_head = 0; //next slot to write
+static volatile uint8_t s_trace_tail = 0; //oldest record
+static volatile uint16_t s_trace_dropped = 0;
+
+void clb::Trace::begin() {
+    clb::CycleClock::begin();
+
+    uint8_t _sreg = SREG;
+    cli();
+    s_trace_head = 0;
+    s_trace_tail = 0;
+    s_trace_dropped = 0;
+    SREG = _sreg;
+
+    record(clb::TTraceEvent::START, 0, F_CPU / 1000UL);
+}
+
+void clb::Trace::record(clb::TTraceEvent event, uint8_t source, uint16_t value) {
+    uint8_t _sreg = SREG;
+    cli();
+
+    //a gap is marked with a DROPPED record in front of the first record that fits again, so the records stay in time order
+    uint8_t _free = (s_trace_tail - s_trace_head - 1) & (CLB_TRACE_BUFFER_SIZE - 1);
+    if (_free < (s_trace_dropped != 0 ? 2 : 1)) {
+        if (s_trace_dropped != 0xFFFF) {
+            s_trace_dropped++;
+        }
+    }
+    else {
+        uint32_t _time = clb::CycleClock::now32();
+        if (s_trace_dropped != 0) {
+            clb::TraceRecord& _gap = s_trace_buffer[s_trace_head];
+            _gap.time = _time;
+            _gap.event = clb::TTraceEvent::DROPPED;
+            _gap.source = 0;
+            _gap.value = s_trace_dropped;
+            s_trace_dropped = 0;
+            s_trace_head = (s_trace_head + 1) & (CLB_TRACE_BUFFER_SIZE - 1);
+        }
+        clb::TraceRecord& _record = s_trace_buffer[s_trace_head];
+        _record.time = _time;
+        _record.event = event;
+        _record.source = source;
+        _record.value = value;
+        s_trace_head = (s_trace_head + 1) & (CLB_TRACE_BUFFER_SIZE - 1);
+    }
+
+    SREG = _sreg;
+}
+
+bool clb::Trace::read(clb::TraceRecord& record) {
+    uint8_t _sreg = SREG;
+    cli();
+
+    if (s_trace_head == s_trace_tail) {
+        if (s_trace_dropped == 0) {
+            SREG = _sreg;
+            return false;
+        }
+        //nothing recorded since the gap, the DROPPED record comes after everything that was in the buffer
+        record.time = clb::CycleClock::now32();
+        record.event = clb::TTraceEvent::DROPPED;
+        record.source = 0;
+        record.value = s_trace_dropped;
+        s_trace_dropped = 0;
+        SREG = _sreg;
+        return true;
+    }
+
+    record = s_trace_buffer[s_trace_tail];
+    s_trace_tail = (s_trace_tail + 1) & (CLB_TRACE_BUFFER_SIZE - 1);
+
+    SREG = _sreg;
+    return true;
+}
+
+uint8_t clb::Trace::available() {
+    uint8_t _sreg = SREG;
+    cli();
+    uint8_t _count = (s_trace_head - s_trace_tail) & (CLB_TRACE_BUFFER_SIZE - 1);
+    SREG = _sreg;
+    return _count;
+}
+
+uint16_t clb::Trace::dropped() {
+    uint8_t _sreg = SREG;
+    cli();
+    uint16_t _dropped = s_trace_dropped;
+    SREG = _sreg;
+    return _dropped;
+}
+
+uint8_t clb::Trace::stream(Stream& out, uint8_t maxRecords) {
+    uint8_t _written = 0;
+    clb::TraceRecord _record;
+    uint8_t _frame[CLB_TRACE_FRAME_SIZE];
+
+    while (_written < maxRecords && read(_record)) {
+        encodeFrame(_record, _frame);
+        out.write(_frame, CLB_TRACE_FRAME_SIZE);
+        _written++;
+    }
+    return _written;
+}
+
+bool clb::Trace::isEnabled() { return true; }
+
+#else
+
+void clb::Trace::begin() { }
+void clb::Trace::record(clb::TTraceEvent event, uint8_t source, uint16_t value) { }
+bool clb::Trace::read(clb::TraceRecord& record) { return false; }
+uint8_t clb::Trace::available() { return 0; }
+uint16_t clb::Trace::dropped() { return 0; }
+uint8_t clb::Trace::stream(Stream& out, uint8_t maxRecords) { return 0; }
+bool clb::Trace::isEnabled() { return false; }
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef CLBTRACE_H
+#define CLBTRACE_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include "clbConfig.h"
+#include "clbTimer.h"
+#include "clbCycleClock.h"
+
+/* TIMER EVENT TRACE
+ *
+ * When CLB_ENABLE_TRACE is defined (see clbConfig.h) the timer classes record what they do into a ring buffer:
+ * compare matches, overflows, async delay start/stop, callback entry/exit and register writes made through the class methods.
+ * Every record is stamped with the 32 bit cycle clock (see clbCycleClock.h), so ISR events are stamped on ISR entry, not on the hardware event.
+ *
+ * clb::Trace::stream() drains the buffer to a Stream (Serial by default) as binary frames, call it from loop().
+ * extras/clbTraceToVcd converts a capture of that stream into a VCD file for GTKWave.
+ *
+ * Frame layout (10 bytes, little endian):
+ *   0xA5 | event | source | value (2 bytes) | time (4 bytes) | crc8 of the 8 bytes after 0xA5 (poly 0x07, init 0)
+ * source is (timer << 4) | detail, detail is the TOutputChannel for compare events, CLB_TRACE_OVERFLOW for overflow events
+ * and a TTraceRegister for register writes.
+ *
+ * If the buffer fills up new records are dropped and counted. A DROPPED record with the count goes into the buffer in front
+ * of the first record that fits again, or is read once the buffer is empty, so it sits in the stream where the gap was.
+ * When the define is off CLB_TRACE expands to nothing.
+ */
+
+#ifndef CLB_TRACE_BUFFER_SIZE
+#define CLB_TRACE_BUFFER_SIZE 64 //records in the ring buffer, must be a power of 2 and at most 128, each record is 8 bytes of RAM
+#endif
+
+#define CLB_TRACE_FRAME_SYNC 0xA5 //first byte of every frame
+#define CLB_TRACE_FRAME_SIZE 10 //bytes per frame including sync and crc
+#define CLB_TRACE_OVERFLOW 3 //detail value used for overflow events and callbacks
+
+#ifdef CLB_ENABLE_TRACE
+#define CLB_TRACE(event, timer, detail, value) clb::Trace::record(event, ((timer) << 4) | static_cast<uint8_t>(detail), value)
+#else
+#define CLB_TRACE(event, timer, detail, value)
+#endif
+
+namespace clb {
+    //event types, the first byte after the frame sync
+    enum class TTraceEvent : uint8_t {
+        COMPARE_MATCH = 0, //compare match ISR entered, value = OCRnx
+        OVERFLOW = 1, //overflow ISR entered, value = 0
+        ASYNC_START = 2, //async delay started, value = number of compare matches it will take (saturates at 0xFFFF)
+        ASYNC_STOP = 3, //async delay ended, value = 1 if it ran out, 0 if it was stopped early
+        CALLBACK_ENTER = 4, //user callback about to run
+        CALLBACK_EXIT = 5, //user callback returned
+        REGISTER_WRITE = 6, //register written by a class method, value = new register value
+        DROPPED = 7, //records were lost because the buffer was full, value = how many (saturates at 0xFFFF)
+        START = 8 //sent by begin(), value = F_CPU in kHz so the converter knows the cycle length
+    };
+    //registers reported by REGISTER_WRITE events
+    enum class TTraceRegister : uint8_t {
+        TCCRA = 0,
+        TCCRB = 1,
+        TCNT = 2,
+        OCRA = 3,
+        OCRB = 4,
+        OCRC = 5,
+        TIMSK = 6,
+        ICR = 7
+    };
+
+    struct TraceRecord {
+        uint32_t time; //cycle clock when the event was recorded
+        TTraceEvent event;
+        uint8_t source; //(timer << 4) | detail
+        uint16_t value;
+    };
+
+    class Trace {
+        public:
+            static void begin(); //starts the cycle clock, clears the buffer and queues a START record
+            static void record(TTraceEvent event, uint8_t source, uint16_t value); //adds a record, safe from ISRs, use through CLB_TRACE
+            static bool read(TraceRecord& record); //takes the oldest record out of the buffer, returns false if it is empty
+            static uint8_t available(); //number of records waiting in the buffer
+            static uint16_t dropped(); //records dropped and not yet reported in a DROPPED record
+            static uint8_t stream(Stream& out = Serial, uint8_t maxRecords = CLB_TRACE_BUFFER_SIZE); //writes waiting records as frames, returns how many were written
+            static void encodeFrame(const TraceRecord& record, uint8_t* frame); //fills CLB_TRACE_FRAME_SIZE bytes with the frame for a record
+            static bool isEnabled(); //returns true if CLB_ENABLE_TRACE was defined when the library was built
+    };
+}
+
+#endif
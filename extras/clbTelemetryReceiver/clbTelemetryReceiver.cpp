@@ -0,0 +1,245 @@
+/* clbTelemetryReceiver
+ *
+ * Host side tool that checks the frames of clb::Telemetry and measures the throughput of the link.
+ * The frame layout is documented in clbTelemetry.h.
+ *
+ * build: g++ -std=c++11 -O2 -o clbTelemetryReceiver clbTelemetryReceiver.cpp
+ * usage: clbTelemetryReceiver capture.bin|- [--every seconds] [--dump] [--baud bits]
+ *        reads until the end of the input, "-" reads stdin
+ *
+ * read the serial port live, for example on linux:
+ *        stty -F /dev/ttyUSB0 2000000 raw && clbTelemetryReceiver /dev/ttyUSB0 --every 1 --baud 2000000
+ *
+ * Every frame is COBS decoded up to its 0x00 delimiter and its crc16 checked. Frames with a bad crc or a broken COBS
+ * block are counted and skipped, the next 0x00 resyncs. Gaps in the sequence numbers of a stream are counted as lost
+ * frames (dropped on the device or lost on the line). With --every the statistics are printed every that many seconds
+ * of wall clock time, throughput is measured against the wall clock, --baud adds the link usage in percent.
+ * --dump prints every good frame, ANALOG and CAPTURE payloads as uint16_t values.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+static const size_t STREAMS = 4;
+static const char* const STREAM_NAMES[STREAMS] = { "analog", "capture", "trace", "user" };
+static const size_t MAX_FRAME = 256; //encoded, with the delimiter
+
+struct Stats {
+    uint64_t bytes = 0; //everything read, delimiters and broken frames included
+    uint64_t frames = 0;
+    uint64_t payloadBytes = 0;
+    uint64_t crcErrors = 0;
+    uint64_t cobsErrors = 0; //broken COBS blocks, runts and frames too long to be from the device
+    uint64_t lost = 0;
+    uint64_t perStream[STREAMS] = { 0, 0, 0, 0 };
+    uint64_t lostPerStream[STREAMS] = { 0, 0, 0, 0 };
+};
+
+static uint16_t crc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t x = (uint8_t)((crc >> 8) ^ data[i]);
+        x ^= x >> 4;
+        crc = (uint16_t)((crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x);
+    }
+    return crc;
+}
+
+//decodes one COBS block without its delimiter, returns false if it is broken
+static bool cobsDecode(const std::vector<uint8_t>& in, std::vector<uint8_t>& out) {
+    out.clear();
+    size_t i = 0;
+    while (i < in.size()) {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > in.size()) {
+            return false;
+        }
+        for (uint8_t k = 1; k < code; k++) {
+            out.push_back(in[i++]);
+        }
+        if (code != 0xFF && i < in.size()) {
+            out.push_back(0);
+        }
+    }
+    return true;
+}
+
+class Receiver {
+    public:
+        Receiver(bool dump) : _dump(dump) { }
+
+        void feed(const uint8_t* data, size_t length) {
+            for (size_t i = 0; i < length; i++) {
+                _stats.bytes++;
+                if (data[i] != 0) {
+                    if (_encoded.size() < MAX_FRAME) {
+                        _encoded.push_back(data[i]);
+                    }
+                    else {
+                        _tooLong = true;
+                    }
+                    continue;
+                }
+                frame();
+                _encoded.clear();
+                _tooLong = false;
+            }
+        }
+
+        const Stats& stats() const { return _stats; }
+
+    private:
+        void frame() {
+            if (_encoded.empty()) {
+                return; //back to back delimiters, or the first byte after a resync
+            }
+            if (_tooLong || !cobsDecode(_encoded, _decoded) || _decoded.size() < 4) {
+                _stats.cobsErrors++;
+                return;
+            }
+            size_t length = _decoded.size() - 2;
+            uint16_t crc = (uint16_t)(_decoded[length] | (_decoded[length + 1] << 8));
+            if (crc16(_decoded.data(), length) != crc) {
+                _stats.crcErrors++;
+                return;
+            }
+            uint8_t stream = _decoded[0];
+            uint8_t sequence = _decoded[1];
+            if (stream >= STREAMS) {
+                _stats.crcErrors++; //a good crc on an unknown stream, treat it as noise
+                return;
+            }
+            if (_seen[stream]) {
+                uint8_t gap = (uint8_t)(sequence - _next[stream]);
+                _stats.lost += gap;
+                _stats.lostPerStream[stream] += gap;
+            }
+            _seen[stream] = true;
+            _next[stream] = (uint8_t)(sequence + 1);
+
+            _stats.frames++;
+            _stats.perStream[stream]++;
+            _stats.payloadBytes += length - 2;
+            if (_dump) {
+                dump(stream, sequence, &_decoded[2], length - 2);
+            }
+        }
+
+        static void dump(uint8_t stream, uint8_t sequence, const uint8_t* payload, size_t length) {
+            printf("%s #%u %zu bytes:", STREAM_NAMES[stream], (unsigned)sequence, length);
+            if (stream <= 1) {
+                for (size_t i = 0; i + 1 < length; i += 2) {
+                    printf(" %u", (unsigned)(payload[i] | (payload[i + 1] << 8)));
+                }
+            }
+            else {
+                for (size_t i = 0; i < length; i++) {
+                    printf(" %02x", (unsigned)payload[i]);
+                }
+            }
+            printf("\n");
+        }
+
+        bool _dump;
+        bool _tooLong = false;
+        std::vector<uint8_t> _encoded;
+        std::vector<uint8_t> _decoded;
+        bool _seen[STREAMS] = { false, false, false, false };
+        uint8_t _next[STREAMS] = { 0, 0, 0, 0 };
+        Stats _stats;
+};
+
+static void report(const Stats& now, const Stats& before, double seconds, uint64_t baud) {
+    double bytes = (double)(now.bytes - before.bytes);
+    double rate = (seconds > 0) ? bytes / seconds : 0;
+    fprintf(stderr, "%.2f s: %.0f B/s, %.0f frames/s, %.0f payload B/s", seconds, rate,
+            (seconds > 0) ? (now.frames - before.frames) / seconds : 0,
+            (seconds > 0) ? (now.payloadBytes - before.payloadBytes) / seconds : 0);
+    if (baud != 0) {
+        fprintf(stderr, ", %.1f%% of the link", rate * 10 * 100 / baud); //8N1 is 10 bits per byte
+    }
+    fprintf(stderr, " | lost %llu, crc %llu, cobs %llu\n", (unsigned long long)(now.lost - before.lost),
+            (unsigned long long)(now.crcErrors - before.crcErrors), (unsigned long long)(now.cobsErrors - before.cobsErrors));
+}
+
+int main(int argc, char** argv) {
+    const char* inPath = nullptr;
+    double every = 0;
+    bool dump = false;
+    uint64_t baud = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--every") == 0 && i + 1 < argc) {
+            every = strtod(argv[++i], nullptr);
+        }
+        else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc) {
+            baud = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--dump") == 0) {
+            dump = true;
+        }
+        else if (!inPath) {
+            inPath = argv[i];
+        }
+        else {
+            fprintf(stderr, "unexpected argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (!inPath) {
+        fprintf(stderr, "usage: %s capture.bin|- [--every seconds] [--dump] [--baud bits]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* in = (strcmp(inPath, "-") == 0) ? stdin : fopen(inPath, "rb");
+    if (!in) {
+        perror(inPath);
+        return 1;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    Receiver receiver(dump);
+    Stats last;
+    const Clock::time_point start = Clock::now();
+    Clock::time_point lastReport = start;
+    uint8_t buffer[4096];
+
+    for (;;) {
+        //the serial port returns what it has, a file fills the buffer, either way the clock is checked per read
+        size_t got = fread(buffer, 1, (every > 0) ? 64 : sizeof(buffer), in);
+        if (got == 0) {
+            break;
+        }
+        receiver.feed(buffer, got);
+        if (every > 0) {
+            Clock::time_point now = Clock::now();
+            double seconds = std::chrono::duration<double>(now - lastReport).count();
+            if (seconds >= every) {
+                report(receiver.stats(), last, seconds, baud);
+                last = receiver.stats();
+                lastReport = now;
+            }
+        }
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    const Stats& total = receiver.stats();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    fprintf(stderr, "total ");
+    report(total, Stats(), seconds, baud);
+    for (size_t s = 0; s < STREAMS; s++) {
+        if (total.perStream[s] != 0 || total.lostPerStream[s] != 0) {
+            fprintf(stderr, "  %-8s %llu frames, %llu lost\n", STREAM_NAMES[s], (unsigned long long)total.perStream[s],
+                    (unsigned long long)total.lostPerStream[s]);
+        }
+    }
+    fprintf(stderr, "%llu bytes, %llu good frames\n", (unsigned long long)total.bytes, (unsigned long long)total.frames);
+    return (total.crcErrors != 0 || total.cobsErrors != 0) ? 1 : 0;
+}
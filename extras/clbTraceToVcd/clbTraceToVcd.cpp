@@ -0,0 +1,348 @@
+/* clbTraceToVcd
+ *
+ * Host side tool that turns a capture of the clb::Trace::stream() output into a VCD file for GTKWave.
+ * The frame layout is documented in clbTrace.h.
+ *
+ * build: g++ -std=c++11 -O2 -o clbTraceToVcd clbTraceToVcd.cpp
+ * usage: clbTraceToVcd capture.bin [out.vcd] [--fcpu 16000000]
+ *        capture.bin can be "-" for stdin, out.vcd defaults to stdout
+ *
+ * capture the stream with anything that saves raw serial bytes, for example on linux:
+ *        stty -F /dev/ttyACM0 115200 raw && cat /dev/ttyACM0 > capture.bin
+ *
+ * Signals per timer that shows up in the trace:
+ *   tN_compA/B/C, tN_ovf      one cycle pulse on every compare match / overflow ISR entry
+ *   tN_asyncA/B/C             high while an async delay runs on that channel
+ *   tN_cbA/B/C, tN_cbOvf      high while the user callback runs
+ *   tN_TCCRA ... tN_ICR       last value written through the timer class
+ * plus trace_dropped, a pulse wherever the device ran out of buffer space.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+static const uint8_t FRAME_SYNC = 0xA5;
+static const size_t FRAME_SIZE = 10;
+
+enum Event : uint8_t {
+    COMPARE_MATCH = 0,
+    OVERFLOW_ = 1,
+    ASYNC_START = 2,
+    ASYNC_STOP = 3,
+    CALLBACK_ENTER = 4,
+    CALLBACK_EXIT = 5,
+    REGISTER_WRITE = 6,
+    DROPPED = 7,
+    START = 8
+};
+
+static const uint8_t DETAIL_OVERFLOW = 3;
+static const char* const CHANNEL_NAMES[] = { "A", "B", "C", "Ovf" };
+static const char* const REGISTER_NAMES[] = { "TCCRA", "TCCRB", "TCNT", "OCRA", "OCRB", "OCRC", "TIMSK", "ICR" };
+
+struct Record {
+    uint64_t cycles; //unwrapped cycle count
+    uint8_t event;
+    uint8_t source;
+    uint16_t value;
+};
+
+struct Signal {
+    std::string id; //short VCD identifier
+    std::string name;
+    unsigned width;
+};
+
+struct Change {
+    uint64_t time; //picoseconds
+    size_t order; //keeps changes at the same time in stream order
+    size_t signal;
+    uint32_t value;
+};
+
+static uint8_t crc8(const uint8_t* data, size_t length) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+//VCD identifiers are any printable characters, build them base 94 from '!'
+static std::string makeId(size_t index) {
+    std::string id;
+    do {
+        id.push_back((char)('!' + index % 94));
+        index /= 94;
+    } while (index > 0);
+    return id;
+}
+
+class VcdWriter {
+    public:
+        size_t signal(const std::string& name, unsigned width) {
+            std::map<std::string, size_t>::iterator it = _byName.find(name);
+            if (it != _byName.end()) {
+                return it->second;
+            }
+            Signal s;
+            s.id = makeId(_signals.size());
+            s.name = name;
+            s.width = width;
+            _signals.push_back(s);
+            _byName[name] = _signals.size() - 1;
+            return _signals.size() - 1;
+        }
+        void change(uint64_t time, size_t signal, uint32_t value) {
+            Change c;
+            c.time = time;
+            c.order = _changes.size();
+            c.signal = signal;
+            c.value = value;
+            _changes.push_back(c);
+        }
+        void write(FILE* out) {
+            std::sort(_changes.begin(), _changes.end(), [](const Change& a, const Change& b) {
+                return (a.time != b.time) ? a.time < b.time : a.order < b.order;
+            });
+
+            fprintf(out, "$date clb trace $end\n");
+            fprintf(out, "$version clbTraceToVcd $end\n");
+            fprintf(out, "$timescale 1ps $end\n");
+            fprintf(out, "$scope module clb $end\n");
+            for (size_t i = 0; i < _signals.size(); i++) {
+                fprintf(out, "$var wire %u %s %s $end\n", _signals[i].width, _signals[i].id.c_str(), _signals[i].name.c_str());
+            }
+            fprintf(out, "$upscope $end\n$enddefinitions $end\n");
+
+            fprintf(out, "$dumpvars\n");
+            for (size_t i = 0; i < _signals.size(); i++) {
+                writeValue(out, _signals[i], 0);
+            }
+            fprintf(out, "$end\n");
+
+            bool first = true;
+            uint64_t current = 0;
+            for (size_t i = 0; i < _changes.size(); i++) {
+                if (first || _changes[i].time != current) {
+                    current = _changes[i].time;
+                    first = false;
+                    fprintf(out, "#%llu\n", (unsigned long long)current);
+                }
+                writeValue(out, _signals[_changes[i].signal], _changes[i].value);
+            }
+        }
+    private:
+        static void writeValue(FILE* out, const Signal& s, uint32_t value) {
+            if (s.width == 1) {
+                fprintf(out, "%u%s\n", value ? 1u : 0u, s.id.c_str());
+                return;
+            }
+            fprintf(out, "b");
+            for (int bit = (int)s.width - 1; bit >= 0; bit--) {
+                fputc((value >> bit) & 1 ? '1' : '0', out);
+            }
+            fprintf(out, " %s\n", s.id.c_str());
+        }
+
+        std::vector<Signal> _signals;
+        std::map<std::string, size_t> _byName;
+        std::vector<Change> _changes;
+};
+
+static std::string timerSignal(uint8_t source, const char* what, const char* channel) {
+    char name[64];
+    snprintf(name, sizeof(name), "t%u_%s%s", (unsigned)(source >> 4), what, channel);
+    return name;
+}
+
+static const char* channelName(uint8_t source) {
+    uint8_t detail = source & 0x0F;
+    return (detail <= DETAIL_OVERFLOW) ? CHANNEL_NAMES[detail] : "?";
+}
+
+//cycles to ps without overflowing, cycles * 1e12 alone doesnt fit 64 bits after about 1 s
+static uint64_t cyclesToPs(uint64_t cycles, uint64_t fcpu) {
+    uint64_t seconds = cycles / fcpu;
+    uint64_t rest = cycles % fcpu;
+    uint64_t us = rest * 1000000u / fcpu; //rest < fcpu, so rest * 1e6 fits
+    uint64_t ps = ((rest * 1000000u) % fcpu) * 1000000u / fcpu;
+    return seconds * 1000000000000ull + us * 1000000u + ps;
+}
+
+//reads frames, skipping bytes until the sync and crc line up again after noise or a partial capture
+static std::vector<Record> readRecords(FILE* in, uint64_t& fcpu, size_t& badFrames) {
+    std::vector<Record> records;
+    std::vector<uint8_t> window;
+    uint64_t wraps = 0;
+    uint32_t last = 0;
+    bool haveLast = false;
+    bool lastDropped = false;
+    badFrames = 0;
+
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        window.push_back((uint8_t)c);
+        if (window.size() < FRAME_SIZE) {
+            continue;
+        }
+        if (window[0] != FRAME_SYNC) {
+            window.erase(window.begin());
+            continue;
+        }
+        if (crc8(&window[1], 8) != window[9]) {
+            badFrames++;
+            window.erase(window.begin());
+            continue;
+        }
+
+        Record r;
+        uint32_t time = (uint32_t)window[5] | ((uint32_t)window[6] << 8) | ((uint32_t)window[7] << 16) | ((uint32_t)window[8] << 24);
+        r.event = window[1];
+        r.source = window[2];
+        r.value = (uint16_t)(window[3] | (window[4] << 8));
+        window.erase(window.begin(), window.begin() + FRAME_SIZE);
+
+        if (r.event == START) {
+            fcpu = (uint64_t)r.value * 1000u; //value is F_CPU in kHz
+            wraps = 0;
+            haveLast = false;
+        }
+        if (haveLast && time < last) {
+            if (lastDropped && last - time < 0x80000000u) {
+                time = last; //older firmware stamped DROPPED with the read time, a step back after it isnt a wrap
+            }
+            else {
+                wraps++; //the 32 bit cycle clock wrapped
+            }
+        }
+        last = time;
+        haveLast = true;
+        lastDropped = (r.event == DROPPED);
+        r.cycles = (wraps << 32) | time;
+        records.push_back(r);
+    }
+    return records;
+}
+
+int main(int argc, char** argv) {
+    const char* inPath = nullptr;
+    const char* outPath = nullptr;
+    uint64_t fcpu = 16000000u;
+    bool fcpuForced = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fcpu") == 0 && i + 1 < argc) {
+            fcpu = strtoull(argv[++i], nullptr, 10);
+            fcpuForced = true;
+        }
+        else if (!inPath) {
+            inPath = argv[i];
+        }
+        else if (!outPath) {
+            outPath = argv[i];
+        }
+        else {
+            fprintf(stderr, "unexpected argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (!inPath) {
+        fprintf(stderr, "usage: %s capture.bin [out.vcd] [--fcpu hz]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* in = (strcmp(inPath, "-") == 0) ? stdin : fopen(inPath, "rb");
+    if (!in) {
+        perror(inPath);
+        return 1;
+    }
+    uint64_t streamFcpu = fcpu;
+    size_t badFrames = 0;
+    std::vector<Record> records = readRecords(in, streamFcpu, badFrames);
+    if (in != stdin) {
+        fclose(in);
+    }
+    if (!fcpuForced) {
+        fcpu = streamFcpu;
+    }
+    if (fcpu == 0) {
+        fprintf(stderr, "cpu frequency is 0\n");
+        return 1;
+    }
+
+    VcdWriter vcd;
+    const uint64_t base = records.empty() ? 0 : records[0].cycles;
+    const uint64_t pulse = 1000000000000ull / fcpu; //one cpu cycle in ps
+
+    for (size_t i = 0; i < records.size(); i++) {
+        const Record& r = records[i];
+        uint64_t t = cyclesToPs(r.cycles - base, fcpu);
+        const char* ch = channelName(r.source);
+
+        switch (r.event) {
+            case COMPARE_MATCH: {
+                size_t s = vcd.signal(timerSignal(r.source, "comp", ch), 1);
+                vcd.change(t, s, 1);
+                vcd.change(t + pulse, s, 0);
+                break;
+            }
+            case OVERFLOW_: {
+                size_t s = vcd.signal(timerSignal(r.source, "ovf", ""), 1);
+                vcd.change(t, s, 1);
+                vcd.change(t + pulse, s, 0);
+                break;
+            }
+            case ASYNC_START:
+            case ASYNC_STOP:
+                vcd.change(t, vcd.signal(timerSignal(r.source, "async", ch), 1), r.event == ASYNC_START);
+                break;
+            case CALLBACK_ENTER:
+            case CALLBACK_EXIT:
+                vcd.change(t, vcd.signal(timerSignal(r.source, "cb", ch), 1), r.event == CALLBACK_ENTER);
+                break;
+            case REGISTER_WRITE: {
+                uint8_t reg = r.source & 0x0F;
+                if (reg < sizeof(REGISTER_NAMES) / sizeof(REGISTER_NAMES[0])) {
+                    vcd.change(t, vcd.signal(timerSignal(r.source, REGISTER_NAMES[reg], ""), 16), r.value);
+                }
+                break;
+            }
+            case DROPPED: {
+                size_t s = vcd.signal("trace_dropped", 1);
+                vcd.change(t, s, 1);
+                vcd.change(t + pulse, s, 0);
+                fprintf(stderr, "warning: device dropped %u records before t=%llu ps\n", (unsigned)r.value, (unsigned long long)t);
+                break;
+            }
+            case START:
+                break;
+            default:
+                fprintf(stderr, "warning: unknown event %u skipped\n", (unsigned)r.event);
+                break;
+        }
+    }
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        perror(outPath);
+        return 1;
+    }
+    vcd.write(out);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    fprintf(stderr, "%zu records, %zu bad frames skipped, %llu Hz\n", records.size(), badFrames, (unsigned long long)fcpu);
+    return 0;
+}